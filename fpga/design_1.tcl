@@ -40,7 +40,7 @@ if { [string first $scripts_vivado_version $current_vivado_version] == -1 } {
 
 # The design that will be created by this Tcl script contains the following 
 # module references:
-# NES_KV260, nes_dp, pmod_audio
+# NES_KV260, dp_audio, nes_dp, pmod_audio
 
 # Please add the sources of those modules before sourcing this Tcl script.
 
@@ -131,6 +131,7 @@ set bCheckIPsPassed 1
 set bCheckIPs 1
 if { $bCheckIPs == 1 } {
    set list_check_ips "\ 
+xilinx.com:ip:axi_dma:7.1\
 xilinx.com:ip:clk_wiz:6.0\
 xilinx.com:ip:proc_sys_reset:5.0\
 xilinx.com:ip:zynq_ultra_ps_e:3.3\
@@ -160,6 +161,7 @@ set bCheckModules 1
 if { $bCheckModules == 1 } {
    set list_check_mods "\ 
 NES_KV260\
+dp_audio\
 nes_dp\
 pmod_audio\
 "
@@ -242,29 +244,56 @@ proc create_root_design { parentCell } {
   # Create instance: axi_interconnect_0, and set properties
   set axi_interconnect_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_interconnect:2.1 axi_interconnect_0 ]
   set_property -dict [ list \
-   CONFIG.NUM_MI {1} \
+   CONFIG.NUM_MI {3} \
  ] $axi_interconnect_0
 
+  # Create instance: axi_dma_0, and set properties
+  # MM2S only, streams ROM images from DDR into NES_KV260/s00_axis
+  set axi_dma_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:axi_dma:7.1 axi_dma_0 ]
+  set_property -dict [ list \
+   CONFIG.c_include_s2mm {0} \
+   CONFIG.c_include_sg {0} \
+   CONFIG.c_m_axi_mm2s_data_width {32} \
+   CONFIG.c_m_axis_mm2s_tdata_width {32} \
+   CONFIG.c_mm2s_burst_size {64} \
+   CONFIG.c_sg_include_stscntrl_strm {0} \
+   CONFIG.c_sg_length_width {23} \
+ ] $axi_dma_0
+
   # Create instance: clk_wiz_0, and set properties
+  # Pixel clock. PS reprograms it at boot for the output timing (displayport.c),
+  # so it is generated for the fastest one, 1440p at 241.5Mhz, to be timed at that.
+  # Safe clock startup gates the output until the MMCM has locked, so the pixel
+  # clock domain never sees the glitches of a relock.
   set clk_wiz_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:clk_wiz:6.0 clk_wiz_0 ]
   set_property -dict [ list \
    CONFIG.CLKIN1_JITTER_PS {40.0} \
-   CONFIG.CLKOUT1_JITTER {157.344} \
-   CONFIG.CLKOUT1_PHASE_ERROR {288.842} \
-   CONFIG.CLKOUT1_REQUESTED_OUT_FREQ {148.5} \
-   CONFIG.CLKOUT2_JITTER {109.471} \
-   CONFIG.CLKOUT2_PHASE_ERROR {82.897} \
+   CONFIG.CLKOUT1_REQUESTED_OUT_FREQ {241.5} \
    CONFIG.CLKOUT2_USED {false} \
-   CONFIG.MMCM_CLKFBOUT_MULT_F {126.375} \
+   CONFIG.MMCM_CLKFBOUT_MULT_F {60.375} \
    CONFIG.MMCM_CLKIN1_PERIOD {4.000} \
    CONFIG.MMCM_CLKIN2_PERIOD {10.0} \
-   CONFIG.MMCM_CLKOUT0_DIVIDE_F {9.250} \
+   CONFIG.MMCM_CLKOUT0_DIVIDE_F {6.250} \
    CONFIG.MMCM_CLKOUT1_DIVIDE {1} \
-   CONFIG.MMCM_DIVCLK_DIVIDE {23} \
+   CONFIG.MMCM_DIVCLK_DIVIDE {10} \
    CONFIG.NUM_OUT_CLKS {1} \
+   CONFIG.USE_DYN_RECONFIG {true} \
+   CONFIG.USE_LOCKED {true} \
    CONFIG.USE_RESET {false} \
+   CONFIG.USE_SAFE_CLOCK_STARTUP {true} \
  ] $clk_wiz_0
 
+  # Create instance: dp_audio_0, and set properties
+  set block_name dp_audio
+  set block_cell_name dp_audio_0
+  if { [catch {set dp_audio_0 [create_bd_cell -type module -reference $block_name $block_cell_name] } errmsg] } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2095 -severity "ERROR" "Unable to add referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   } elseif { $dp_audio_0 eq "" } {
+     catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
+     return 1
+   }
+  
   # Create instance: nes_dp_0, and set properties
   set block_name nes_dp
   set block_cell_name nes_dp_0
@@ -275,6 +304,9 @@ proc create_root_design { parentCell } {
      catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
      return 1
    }
+  set_property -dict [ list \
+   CONFIG.FB_COUNT {3} \
+ ] $nes_dp_0
   
   # Create instance: pmod_audio_0, and set properties
   set block_name pmod_audio
@@ -286,6 +318,9 @@ proc create_root_design { parentCell } {
      catch {common::send_gid_msg -ssname BD::TCL -id 2096 -severity "ERROR" "Unable to referenced block <$block_name>. Please add the files for ${block_name}'s definition into the project."}
      return 1
    }
+  set_property -dict [ list \
+   CONFIG.FILTER {1} \
+ ] $pmod_audio_0
   
   # Create instance: proc_sys_reset_0, and set properties
   set proc_sys_reset_0 [ create_bd_cell -type ip -vlnv xilinx.com:ip:proc_sys_reset:5.0 proc_sys_reset_0 ]
@@ -692,12 +727,13 @@ sclk_out#miso_mo1#mo2#mo3#mosi_mi0#n_ss_out#rxd#txd#gpio0[8]#gpio0[9]#gpio0[10]#
    CONFIG.PSU__CRF_APB__DPLL_CTRL__SRCSEL {PSS_REF_CLK} \
    CONFIG.PSU__CRF_APB__DPLL_FRAC_CFG__ENABLED {0} \
    CONFIG.PSU__CRF_APB__DPLL_TO_LPD_CTRL__DIVISOR0 {2} \
-   CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__ACT_FREQMHZ {24.242182} \
-   CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__DIVISOR0 {22} \
+   CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__ACT_FREQMHZ {24.576002} \
+   CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__DIVISOR0 {21} \
    CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__DIVISOR1 {1} \
+   CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__FREQMHZ {24.576} \
    CONFIG.PSU__CRF_APB__DP_AUDIO_REF_CTRL__SRCSEL {RPLL} \
-   CONFIG.PSU__CRF_APB__DP_AUDIO__FRAC_ENABLED {0} \
-   CONFIG.PSU__CRF_APB__DP_STC_REF_CTRL__ACT_FREQMHZ {26.666401} \
+   CONFIG.PSU__CRF_APB__DP_AUDIO__FRAC_ENABLED {1} \
+   CONFIG.PSU__CRF_APB__DP_STC_REF_CTRL__ACT_FREQMHZ {25.804802} \
    CONFIG.PSU__CRF_APB__DP_STC_REF_CTRL__DIVISOR0 {20} \
    CONFIG.PSU__CRF_APB__DP_STC_REF_CTRL__DIVISOR1 {1} \
    CONFIG.PSU__CRF_APB__DP_STC_REF_CTRL__SRCSEL {RPLL} \
@@ -748,7 +784,7 @@ sclk_out#miso_mo1#mo2#mo3#mosi_mi0#n_ss_out#rxd#txd#gpio0[8]#gpio0[9]#gpio0[10]#
    CONFIG.PSU__CRL_APB__CAN1_REF_CTRL__DIVISOR1 {1} \
    CONFIG.PSU__CRL_APB__CAN1_REF_CTRL__FREQMHZ {100} \
    CONFIG.PSU__CRL_APB__CAN1_REF_CTRL__SRCSEL {IOPLL} \
-   CONFIG.PSU__CRL_APB__CPU_R5_CTRL__ACT_FREQMHZ {533.328003} \
+   CONFIG.PSU__CRL_APB__CPU_R5_CTRL__ACT_FREQMHZ {516.096069} \
    CONFIG.PSU__CRL_APB__CPU_R5_CTRL__DIVISOR0 {2} \
    CONFIG.PSU__CRL_APB__CPU_R5_CTRL__FREQMHZ {533.333} \
    CONFIG.PSU__CRL_APB__CPU_R5_CTRL__SRCSEL {RPLL} \
@@ -825,10 +861,11 @@ sclk_out#miso_mo1#mo2#mo3#mosi_mi0#n_ss_out#rxd#txd#gpio0[8]#gpio0[9]#gpio0[10]#
    CONFIG.PSU__CRL_APB__QSPI_REF_CTRL__FREQMHZ {125} \
    CONFIG.PSU__CRL_APB__QSPI_REF_CTRL__SRCSEL {IOPLL} \
    CONFIG.PSU__CRL_APB__RPLL_CTRL__DIV2 {1} \
-   CONFIG.PSU__CRL_APB__RPLL_CTRL__FBDIV {64} \
-   CONFIG.PSU__CRL_APB__RPLL_CTRL__FRACDATA {0.000000} \
+   CONFIG.PSU__CRL_APB__RPLL_CTRL__FBDIV {61} \
+   CONFIG.PSU__CRL_APB__RPLL_CTRL__FRACDATA {0.932144} \
+   CONFIG.PSU__CRL_APB__RPLL_CTRL__FRACFREQ {24.576} \
    CONFIG.PSU__CRL_APB__RPLL_CTRL__SRCSEL {PSS_REF_CLK} \
-   CONFIG.PSU__CRL_APB__RPLL_FRAC_CFG__ENABLED {0} \
+   CONFIG.PSU__CRL_APB__RPLL_FRAC_CFG__ENABLED {1} \
    CONFIG.PSU__CRL_APB__RPLL_TO_FPD_CTRL__DIVISOR0 {2} \
    CONFIG.PSU__CRL_APB__SDIO0_REF_CTRL__DIVISOR0 {7} \
    CONFIG.PSU__CRL_APB__SDIO0_REF_CTRL__DIVISOR1 {1} \
@@ -1106,40 +1143,69 @@ Port;FD4A0000;FD4AFFFF;1|FPD;DPDMA;FD4C0000;FD4CFFFF;1|FPD;DDR_XMPU5_CFG;FD05000
    CONFIG.PSU__USB3_0__PERIPHERAL__IO {GT Lane2} \
    CONFIG.PSU__USB__RESET__MODE {Boot Pin} \
    CONFIG.PSU__USB__RESET__POLARITY {Active Low} \
-   CONFIG.PSU__USE__AUDIO {0} \
+   CONFIG.PSU__USE__AUDIO {1} \
    CONFIG.PSU__USE__IRQ0 {1} \
    CONFIG.PSU__USE__M_AXI_GP0 {1} \
    CONFIG.PSU__USE__M_AXI_GP1 {0} \
    CONFIG.PSU__USE__M_AXI_GP2 {0} \
+   CONFIG.PSU__USE__S_AXI_GP2 {1} \
+   CONFIG.PSU__SAXIGP2__DATA_WIDTH {32} \
+   CONFIG.PSU__USE__S_AXI_GP3 {1} \
+   CONFIG.PSU__SAXIGP3__DATA_WIDTH {64} \
    CONFIG.PSU__USE__VIDEO {1} \
  ] $zynq_ultra_ps_e_0
 
   # Create interface connections
+  connect_bd_intf_net -intf_net NES_KV260_0_m00_axi [get_bd_intf_pins NES_KV260_0/m00_axi] [get_bd_intf_pins zynq_ultra_ps_e_0/S_AXI_HP1_FPD]
+  connect_bd_intf_net -intf_net axi_dma_0_M_AXIS_MM2S [get_bd_intf_pins NES_KV260_0/s00_axis] [get_bd_intf_pins axi_dma_0/M_AXIS_MM2S]
+  connect_bd_intf_net -intf_net axi_dma_0_M_AXI_MM2S [get_bd_intf_pins axi_dma_0/M_AXI_MM2S] [get_bd_intf_pins zynq_ultra_ps_e_0/S_AXI_HP0_FPD]
   connect_bd_intf_net -intf_net axi_interconnect_0_M00_AXI [get_bd_intf_pins NES_KV260_0/s00_axi] [get_bd_intf_pins axi_interconnect_0/M00_AXI]
+  connect_bd_intf_net -intf_net axi_interconnect_0_M01_AXI [get_bd_intf_pins axi_dma_0/S_AXI_LITE] [get_bd_intf_pins axi_interconnect_0/M01_AXI]
+  connect_bd_intf_net -intf_net axi_interconnect_0_M02_AXI [get_bd_intf_pins axi_interconnect_0/M02_AXI] [get_bd_intf_pins clk_wiz_0/s_axi_lite]
   connect_bd_intf_net -intf_net zynq_ultra_ps_e_0_M_AXI_HPM0_FPD [get_bd_intf_pins axi_interconnect_0/S00_AXI] [get_bd_intf_pins zynq_ultra_ps_e_0/M_AXI_HPM0_FPD]
 
   # Create port connections
   connect_bd_net -net NES_KV260_0_clk_ppu [get_bd_pins NES_KV260_0/clk_ppu] [get_bd_pins nes_dp_0/ppu_clk]
   connect_bd_net -net NES_KV260_0_color [get_bd_pins NES_KV260_0/color] [get_bd_pins nes_dp_0/ppu_video]
   connect_bd_net -net NES_KV260_0_cycle [get_bd_pins NES_KV260_0/cycle] [get_bd_pins nes_dp_0/ppu_cycle]
-  connect_bd_net -net NES_KV260_0_sample [get_bd_pins NES_KV260_0/sample] [get_bd_pins pmod_audio_0/sample]
+  connect_bd_net -net NES_KV260_0_emphasis [get_bd_pins NES_KV260_0/emphasis] [get_bd_pins nes_dp_0/ppu_emphasis]
+  connect_bd_net -net NES_KV260_0_pal_addr [get_bd_pins NES_KV260_0/pal_addr] [get_bd_pins nes_dp_0/pal_addr]
+  connect_bd_net -net NES_KV260_0_pal_data [get_bd_pins NES_KV260_0/pal_data] [get_bd_pins nes_dp_0/pal_data]
+  connect_bd_net -net NES_KV260_0_pal_write [get_bd_pins NES_KV260_0/pal_write] [get_bd_pins nes_dp_0/pal_write]
+  connect_bd_net -net NES_KV260_0_frame_irq [get_bd_pins NES_KV260_0/frame_irq] [get_bd_pins zynq_ultra_ps_e_0/pl_ps_irq0]
+  connect_bd_net -net NES_KV260_0_sample [get_bd_pins NES_KV260_0/sample] [get_bd_pins dp_audio_0/sample] [get_bd_pins pmod_audio_0/sample]
   connect_bd_net -net NES_KV260_0_scanline [get_bd_pins NES_KV260_0/scanline] [get_bd_pins nes_dp_0/ppu_scanline]
-  connect_bd_net -net clk_wiz_0_clk_out1 [get_bd_pins clk_wiz_0/clk_out1] [get_bd_pins nes_dp_0/clk_pixel] [get_bd_pins proc_sys_reset_0/slowest_sync_clk] [get_bd_pins zynq_ultra_ps_e_0/dp_video_in_clk]
+  connect_bd_net -net NES_KV260_0_video_genlock [get_bd_pins NES_KV260_0/video_genlock] [get_bd_pins nes_dp_0/genlock]
+  connect_bd_net -net NES_KV260_0_video_scale [get_bd_pins NES_KV260_0/video_scale] [get_bd_pins nes_dp_0/scale]
+  connect_bd_net -net NES_KV260_0_video_timing [get_bd_pins NES_KV260_0/video_timing] [get_bd_pins nes_dp_0/timing]
+  connect_bd_net -net clk_wiz_0_locked [get_bd_pins clk_wiz_0/locked] [get_bd_pins proc_sys_reset_0/dcm_locked]
+  connect_bd_net -net clk_wiz_0_clk_out1 [get_bd_pins clk_wiz_0/clk_out1] [get_bd_pins dp_audio_0/clk_pixel] [get_bd_pins nes_dp_0/clk_pixel] [get_bd_pins proc_sys_reset_0/slowest_sync_clk] [get_bd_pins zynq_ultra_ps_e_0/dp_s_axis_audio_clk] [get_bd_pins zynq_ultra_ps_e_0/dp_video_in_clk]
+  connect_bd_net -net dp_audio_0_fir_now [get_bd_pins dp_audio_0/fir_now] [get_bd_pins pmod_audio_0/fir_now]
+  connect_bd_net -net dp_audio_0_fir_out [get_bd_pins dp_audio_0/fir_out] [get_bd_pins pmod_audio_0/fir_out]
+  connect_bd_net -net dp_audio_0_m_axis_audio_tdata [get_bd_pins dp_audio_0/m_axis_audio_tdata] [get_bd_pins zynq_ultra_ps_e_0/dp_s_axis_audio_tdata]
+  connect_bd_net -net dp_audio_0_m_axis_audio_tid [get_bd_pins dp_audio_0/m_axis_audio_tid] [get_bd_pins zynq_ultra_ps_e_0/dp_s_axis_audio_tid]
+  connect_bd_net -net dp_audio_0_m_axis_audio_tvalid [get_bd_pins dp_audio_0/m_axis_audio_tvalid] [get_bd_pins zynq_ultra_ps_e_0/dp_s_axis_audio_tvalid]
+  connect_bd_net -net zynq_ultra_ps_e_0_dp_s_axis_audio_tready [get_bd_pins dp_audio_0/m_axis_audio_tready] [get_bd_pins zynq_ultra_ps_e_0/dp_s_axis_audio_tready]
   connect_bd_net -net nes_dp_0_active_video [get_bd_pins nes_dp_0/de] [get_bd_pins zynq_ultra_ps_e_0/dp_live_video_in_de]
   connect_bd_net -net nes_dp_0_hsync [get_bd_pins nes_dp_0/hsync] [get_bd_pins zynq_ultra_ps_e_0/dp_live_video_in_hsync]
+  connect_bd_net -net nes_dp_0_locked [get_bd_pins NES_KV260_0/video_locked] [get_bd_pins nes_dp_0/locked]
   connect_bd_net -net nes_dp_0_video [get_bd_pins nes_dp_0/video] [get_bd_pins zynq_ultra_ps_e_0/dp_live_video_in_pixel1]
   connect_bd_net -net nes_dp_0_vsync [get_bd_pins nes_dp_0/vsync] [get_bd_pins zynq_ultra_ps_e_0/dp_live_video_in_vsync]
   connect_bd_net -net pmod_audio_0_output_pmod [get_bd_ports pmod] [get_bd_pins pmod_audio_0/output_pmod]
-  connect_bd_net -net proc_sys_reset_0_peripheral_reset [get_bd_pins nes_dp_0/rst_pixel] [get_bd_pins proc_sys_reset_0/peripheral_reset]
-  connect_bd_net -net proc_sys_reset_1_interconnect_aresetn [get_bd_pins axi_interconnect_0/ARESETN] [get_bd_pins axi_interconnect_0/M00_ARESETN] [get_bd_pins axi_interconnect_0/S00_ARESETN] [get_bd_pins proc_sys_reset_1/interconnect_aresetn]
-  connect_bd_net -net proc_sys_reset_1_peripheral_aresetn [get_bd_pins NES_KV260_0/s00_axi_aresetn] [get_bd_pins proc_sys_reset_1/peripheral_aresetn]
+  connect_bd_net -net proc_sys_reset_0_peripheral_reset [get_bd_pins dp_audio_0/rst_pixel] [get_bd_pins nes_dp_0/rst_pixel] [get_bd_pins proc_sys_reset_0/peripheral_reset]
+  connect_bd_net -net proc_sys_reset_1_interconnect_aresetn [get_bd_pins axi_interconnect_0/ARESETN] [get_bd_pins axi_interconnect_0/M00_ARESETN] [get_bd_pins axi_interconnect_0/M01_ARESETN] [get_bd_pins axi_interconnect_0/M02_ARESETN] [get_bd_pins axi_interconnect_0/S00_ARESETN] [get_bd_pins proc_sys_reset_1/interconnect_aresetn]
+  connect_bd_net -net proc_sys_reset_1_peripheral_aresetn [get_bd_pins NES_KV260_0/s00_axi_aresetn] [get_bd_pins axi_dma_0/axi_resetn] [get_bd_pins clk_wiz_0/s_axi_aresetn] [get_bd_pins proc_sys_reset_1/peripheral_aresetn]
   connect_bd_net -net proc_sys_reset_1_peripheral_reset [get_bd_pins NES_KV260_0/reset] [get_bd_pins proc_sys_reset_1/peripheral_reset]
   connect_bd_net -net zynq_ultra_ps_e_0_pl_clk0 [get_bd_pins clk_wiz_0/clk_in1] [get_bd_pins zynq_ultra_ps_e_0/pl_clk0]
-  connect_bd_net -net zynq_ultra_ps_e_0_pl_clk1 [get_bd_pins NES_KV260_0/clk] [get_bd_pins NES_KV260_0/s00_axi_aclk] [get_bd_pins axi_interconnect_0/ACLK] [get_bd_pins axi_interconnect_0/M00_ACLK] [get_bd_pins axi_interconnect_0/S00_ACLK] [get_bd_pins nes_dp_0/clk_nes] [get_bd_pins pmod_audio_0/clk] [get_bd_pins proc_sys_reset_1/slowest_sync_clk] [get_bd_pins zynq_ultra_ps_e_0/maxihpm0_fpd_aclk] [get_bd_pins zynq_ultra_ps_e_0/pl_clk1]
+  connect_bd_net -net zynq_ultra_ps_e_0_pl_clk1 [get_bd_pins NES_KV260_0/clk] [get_bd_pins NES_KV260_0/s00_axi_aclk] [get_bd_pins axi_dma_0/m_axi_mm2s_aclk] [get_bd_pins axi_dma_0/s_axi_lite_aclk] [get_bd_pins axi_interconnect_0/ACLK] [get_bd_pins axi_interconnect_0/M00_ACLK] [get_bd_pins axi_interconnect_0/M01_ACLK] [get_bd_pins axi_interconnect_0/M02_ACLK] [get_bd_pins axi_interconnect_0/S00_ACLK] [get_bd_pins clk_wiz_0/s_axi_aclk] [get_bd_pins dp_audio_0/clk] [get_bd_pins nes_dp_0/clk_nes] [get_bd_pins pmod_audio_0/clk] [get_bd_pins proc_sys_reset_1/slowest_sync_clk] [get_bd_pins zynq_ultra_ps_e_0/maxihpm0_fpd_aclk] [get_bd_pins zynq_ultra_ps_e_0/pl_clk1] [get_bd_pins zynq_ultra_ps_e_0/saxihp0_fpd_aclk] [get_bd_pins zynq_ultra_ps_e_0/saxihp1_fpd_aclk]
   connect_bd_net -net zynq_ultra_ps_e_0_pl_resetn0 [get_bd_pins proc_sys_reset_0/ext_reset_in] [get_bd_pins proc_sys_reset_1/ext_reset_in] [get_bd_pins zynq_ultra_ps_e_0/pl_resetn0]
 
   # Create address segments
   assign_bd_address -offset 0xA0000000 -range 0x00010000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs NES_KV260_0/s00_axi/reg0] -force
+  assign_bd_address -offset 0xA0010000 -range 0x00010000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs axi_dma_0/S_AXI_LITE/Reg] -force
+  assign_bd_address -offset 0xA0020000 -range 0x00010000 -target_address_space [get_bd_addr_spaces zynq_ultra_ps_e_0/Data] [get_bd_addr_segs clk_wiz_0/s_axi_lite/Reg] -force
+  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces axi_dma_0/Data_MM2S] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP2/HP0_DDR_LOW] -force
+  assign_bd_address -offset 0x00000000 -range 0x80000000 -target_address_space [get_bd_addr_spaces NES_KV260_0/m00_axi] [get_bd_addr_segs zynq_ultra_ps_e_0/SAXIGP3/HP1_DDR_LOW] -force
 
 
   # Restore current instance
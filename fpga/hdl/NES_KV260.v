@@ -10,6 +10,10 @@
 // Define this to enable static embedded game data (Battle City)
 //`define EMBED_GAME
 
+// Define this to keep cartridge ROM in PS DDR instead of UltraRAM, see RomCache.
+// Allows PRG ROM up to 2MB.
+//`define DDR_ROM
+
 // Module reads bytes and writes to proper address in ram.
 // Done is asserted when the whole game is loaded.
 // This parses iNES headers too.
@@ -97,6 +101,54 @@ module GameLoader(input clk, input reset,
   end
 endmodule
 
+// Small FIFO of packed ROM words in front of GameLoader.
+// Every entry holds up to 4 bytes (little-endian, byte 0 goes first) and the
+// number of valid bytes in it. Bytes are handed out one per clock, which is
+// as fast as GameLoader can take them, so a 32-bit bus write or stream beat
+// turns into 4 back-to-back loader bytes.
+module LoaderFifo(input clk, input reset,
+                  input push, input [31:0] din, input [2:0] din_count,   // din_count: 1-4 valid bytes
+                  output full, output almost_full,
+                  output [7:0] dout, output dout_clk);
+
+  parameter DEPTH_BITS = 4;     // 16 words
+
+  reg [31:0] words [0:(1<<DEPTH_BITS)-1];
+  reg [2:0] counts [0:(1<<DEPTH_BITS)-1];
+  reg [DEPTH_BITS:0] wptr = 0, rptr = 0;
+  reg [1:0] idx = 0;            // byte being sent out of the head word
+
+  wire empty = wptr == rptr;
+  wire [DEPTH_BITS:0] level = wptr - rptr;
+  assign full = wptr == {~rptr[DEPTH_BITS], rptr[DEPTH_BITS-1:0]};
+  assign almost_full = level >= (1<<DEPTH_BITS) - 1;   // at most one more push fits
+  wire [31:0] head = words[rptr[DEPTH_BITS-1:0]];
+  wire [2:0] head_count = counts[rptr[DEPTH_BITS-1:0]];
+  assign dout = head >> {idx, 3'b0};
+  assign dout_clk = !empty;
+
+  always @(posedge clk) begin
+    if (reset) begin
+      wptr <= 0;
+      rptr <= 0;
+      idx <= 0;
+    end else begin
+      if (push && !full && din_count != 0) begin
+        words[wptr[DEPTH_BITS-1:0]] <= din;
+        counts[wptr[DEPTH_BITS-1:0]] <= din_count;
+        wptr <= wptr + 1;
+      end
+      if (!empty) begin
+        if ({1'b0, idx} == head_count - 1) begin   // last byte of this word
+          idx <= 0;
+          rptr <= rptr + 1;
+        end else
+          idx <= idx + 1;
+      end
+    end
+  end
+endmodule
+
 `ifdef EMBED_GAME
 // zf: Feed INES data to Game_Loader
 module GameData (input clk, input reset,
@@ -133,13 +185,255 @@ module GameData (input clk, input reset,
 endmodule
 `endif
 
+`ifdef DDR_ROM
+// Cartridge ROM cache.
+// The whole ROM image stays in PS DDR, put there by PS with the same layout as
+// the NES address space (PRG ROM at 0, CHR ROM at 2MB), and only the 8KB pages
+// in use are kept in UltraRAM. The cache is 4-way set associative with 8 sets
+// of 8KB pages, 256KB in total. Sets 0-3 are for PRG and 4-7 for CHR. Pages are
+// tagged with the address after bank switching, i.e. memory_addr.
+//
+// Pages are read from DDR with an AXI4 read master in 1KB bursts, first the
+// block the NES is waiting for, then the rest of the page in the background.
+// While a byte the NES reads is not there yet, stall is set and NES_KV260
+// stops the NES clock enable, for the whole machine: CPU, PPU and APU. Every
+// such miss is a glitch in video and audio timing. hits/misses/stall_cycles
+// show how often it happens, max_stall is the longest stall in clk cycles.
+//
+// To keep misses rare, pages are prefetched as soon as the mapper banks them
+// in. probe walks the 4 PRG and 8 CHR windows, one per cycle, and MultiMapper
+// says where each is mapped to now (MMC1, MMC3 and the UxROM family only).
+// When the fill engine is idle, a mapped page that is missing, or only
+// partly filled, is filled in the background, without evicting another
+// mapped page. A CHR bank switch is then usually filled long before the PPU
+// gets to it. A PRG switch that the CPU jumps into right away can still miss,
+// as can any access with other mappers.
+// CHR RAM is not cached, it stays in UltraRAM as usual.
+module RomCache(input clk, input reset,      // reset empties the cache
+                input [31:0] base,           // DDR address of ROM image, 4KB aligned
+                input enable,                // ROM image in DDR is ready
+                input has_chr_ram,
+                input access,                // NES memory read this cycle
+                input [21:0] addr,           // and its address
+                output cached,               // addr is cartridge ROM, and goes through the cache
+                output [21:0] cache_addr,    // where addr is in UltraRAM
+                output stall,                // access has to wait for a fill
+                input port_free,             // UltraRAM is not used by NES this cycle
+                output fill,                 // write fill_data to fill_addr
+                output [21:0] fill_addr,
+                output [63:0] fill_data,
+                output reg [31:0] hits = 0, output reg [31:0] misses = 0,
+                output reg [31:0] stall_cycles = 0, output reg [31:0] max_stall = 0,
+                output reg [3:0] probe = 0,  // window to ask MultiMapper about
+                input [21:0] probe_addr,     // where it is mapped
+                input probe_ok,              // the mapper can tell
+                // AXI4 read master, clocked by clk
+                output [31:0] m_axi_araddr, output [7:0] m_axi_arlen, output [2:0] m_axi_arsize,
+                output [1:0] m_axi_arburst, output [3:0] m_axi_arcache, output [2:0] m_axi_arprot,
+                output m_axi_arvalid, input m_axi_arready,
+                input [63:0] m_axi_rdata, input [1:0] m_axi_rresp, input m_axi_rlast,
+                input m_axi_rvalid, output m_axi_rready);
+
+  reg [5:0] tags [0:31];        // addr[20:15] of every page
+  reg [7:0] blk_valid [0:31];   // 1KB blocks of every page that are filled
+  reg [31:0] page_valid = 0;
+  reg [1:0] next_way [0:7];     // round robin replacement
+  integer k;
+  initial for (k = 0; k < 8; k = k + 1) next_way[k] = 0;
+
+  wire [2:0] set = {addr[21], addr[14:13]};
+  wire [5:0] tag = addr[20:15];
+  wire [2:0] blk = addr[12:10];
+  wire [3:0] way_hit;
+  genvar w;
+  generate
+    for (w = 0; w < 4; w = w + 1) begin : lookup
+      assign way_hit[w] = page_valid[set*4 + w] && tags[set*4 + w] == tag;
+    end
+  endgenerate
+  wire page_hit = way_hit != 0;
+  wire [1:0] way = way_hit[3] ? 3 : way_hit[2] ? 2 : way_hit[1] ? 1 : 0;
+  wire [4:0] slot = {set, way};
+  wire [4:0] victim = {set, next_way[set]};
+
+  // The same lookup for the prefetch probe
+  reg [9:0] mapped [0:15];      // {valid, addr[21:13]} of the page of every window
+  initial for (k = 0; k < 16; k = k + 1) mapped[k] = 0;
+  wire p_cached = probe_ok && (!probe_addr[21] || !probe_addr[20] && !has_chr_ram);
+  wire [2:0] p_set = {probe_addr[21], probe_addr[14:13]};
+  wire [5:0] p_tag = probe_addr[20:15];
+  wire [4:0] p_victim = {p_set, next_way[p_set]};
+  wire [3:0] p_way_hit;
+  wire [15:0] p_victim_mapped;      // the page p_victim would evict is in use
+  generate
+    for (w = 0; w < 4; w = w + 1) begin : p_lookup
+      assign p_way_hit[w] = page_valid[p_set*4 + w] && tags[p_set*4 + w] == p_tag;
+    end
+    for (w = 0; w < 16; w = w + 1) begin : p_mapped
+      assign p_victim_mapped[w] = mapped[w][9] && page_valid[p_victim] &&
+                                  mapped[w][8:0] == {p_set[2], tags[p_victim], p_set[1:0]};
+    end
+  endgenerate
+  wire p_hit = p_way_hit != 0;
+  wire [4:0] p_slot = {p_set, p_way_hit[3] ? 2'd3 : p_way_hit[2] ? 2'd2 : p_way_hit[1] ? 2'd1 : 2'd0};
+
+  // Fill engine
+  reg [1:0] state = 0;          // 0: idle, 1: address, 2: data
+  reg drop = 0;                 // cache was reset during this burst, throw the data away
+  reg [4:0] f_slot;             // block being filled
+  reg [2:0] f_blk;
+  reg [8:0] f_page;             // addr[21:13] of it
+  reg [7:0] f_beat;             // 8-byte words of it done
+  reg bg = 0;                   // fill rest of bg_slot in the background
+  reg [4:0] bg_slot;
+  reg [8:0] bg_page;
+  wire [7:0] bg_missing = ~blk_valid[bg_slot];
+  wire [2:0] bg_blk = bg_missing[0] ? 0 : bg_missing[1] ? 1 : bg_missing[2] ? 2 : bg_missing[3] ? 3 :
+                      bg_missing[4] ? 4 : bg_missing[5] ? 5 : bg_missing[6] ? 6 : 7;
+
+  wire filling = state == 2 && !drop && f_slot == slot && f_blk == blk;
+  wire ready = page_hit && (blk_valid[slot][blk] || filling && f_beat > addr[9:3]);
+  assign cached = !addr[21] || !addr[20] && !has_chr_ram;
+  assign cache_addr = cached ? {4'b0, slot, addr[12:0]} : addr;
+  assign stall = access && cached && !ready;
+
+  assign m_axi_araddr = base + {f_page, f_blk, 10'b0};
+  assign m_axi_arlen = 127;     // 128 beats of 8 bytes
+  assign m_axi_arsize = 3;
+  assign m_axi_arburst = 1;     // INCR
+  assign m_axi_arcache = 4'b0011;
+  assign m_axi_arprot = 0;
+  assign m_axi_arvalid = state == 1;
+  assign m_axi_rready = state == 2 && port_free;
+  wire beat = m_axi_rvalid && m_axi_rready;
+  assign fill = beat && !drop;
+  assign fill_addr = {4'b0, f_slot, f_blk, f_beat[6:0], 3'b0};
+  assign fill_data = m_axi_rdata;
+
+  always @(posedge clk) begin
+    case (state)
+    0: if (stall && enable) begin
+         // demand fill, allocate the page if needed
+         if (!page_hit) begin
+           tags[victim] <= tag;
+           page_valid[victim] <= 1;
+           blk_valid[victim] <= 0;
+           next_way[set] <= next_way[set] + 1;
+         end
+         f_slot <= page_hit ? slot : victim;
+         f_blk <= blk;
+         f_page <= addr[21:13];
+         bg <= 1;
+         bg_slot <= page_hit ? slot : victim;
+         bg_page <= addr[21:13];
+         state <= 1;
+       end else if (bg && bg_missing != 0) begin
+         f_slot <= bg_slot;
+         f_blk <= bg_blk;
+         f_page <= bg_page;
+         state <= 1;
+       end else if (enable && p_cached && !p_hit) begin
+         // prefetch a page that was just banked in
+         if (p_victim_mapped == 0) begin
+           tags[p_victim] <= p_tag;
+           page_valid[p_victim] <= 1;
+           blk_valid[p_victim] <= 0;
+           bg <= 1;
+           bg_slot <= p_victim;
+           bg_page <= probe_addr[21:13];
+         end else
+           bg <= 0;
+         next_way[p_set] <= next_way[p_set] + 1;    // try another way next time
+       end else if (enable && p_cached && blk_valid[p_slot] != 8'hff) begin
+         // or finish one
+         bg <= 1;
+         bg_slot <= p_slot;
+         bg_page <= probe_addr[21:13];
+       end else
+         bg <= 0;
+    1: if (m_axi_arready) begin
+         f_beat <= 0;
+         state <= 2;
+       end
+    2: if (beat) begin
+         f_beat <= f_beat + 1;
+         if (m_axi_rlast) begin
+           if (!drop)
+             blk_valid[f_slot] <= blk_valid[f_slot] | (8'b1 << f_blk);
+           drop <= 0;
+           state <= 0;
+         end
+       end
+    endcase
+    probe <= probe + 1;
+    mapped[probe] <= {p_cached, probe_addr[21:13]};
+    if (reset) begin
+      page_valid <= 0;
+      bg <= 0;
+      if (state == 1 || state == 2 && !(beat && m_axi_rlast))
+        drop <= 1;              // an AXI burst cannot be cancelled, let it finish
+    end
+  end
+
+  // Counters
+  reg stalled = 0;              // stall in last cycle
+  reg [31:0] stall_len;
+  always @(posedge clk) begin
+    stalled <= stall && enable;
+    if (stall && enable) begin
+      stall_cycles <= stall_cycles + 1;
+      stall_len <= stalled ? stall_len + 1 : 1;
+      if (!stalled)
+        misses <= misses + 1;
+    end else begin
+      if (stalled && stall_len > max_stall)
+        max_stall <= stall_len;
+      if (access && cached && !stalled)
+        hits <= hits + 1;
+    end
+    if (reset) begin
+      hits <= 0;
+      misses <= 0;
+      stall_cycles <= 0;
+      max_stall <= 0;
+    end
+  end
+endmodule
+`endif
+
+// Internal RAM (2KB, CPU side) and VRAM (2KB, PPU side) in one true dual-port
+// block RAM, so CPU and PPU can use them in the same cycle, and without going
+// through MemoryController. Like MemoryController, dout keeps the result of
+// the last read.
+module NesRam(input clk,
+              input read_a, input write_a, input [10:0] addr_a, input [7:0] din_a, output reg [7:0] dout_a,
+              input read_b, input write_b, input [10:0] addr_b, input [7:0] din_b, output reg [7:0] dout_b);
+
+  (* ram_style = "block" *)
+  reg [7:0] mem [0:4095];
+
+  always @(posedge clk) begin
+    if (write_a)
+      mem[{1'b0, addr_a}] <= din_a;
+    if (read_a)
+      dout_a <= mem[{1'b0, addr_a}];
+  end
+
+  always @(posedge clk) begin
+    if (write_b)
+      mem[{1'b1, addr_b}] <= din_b;
+    if (read_b)
+      dout_b <= mem[{1'b1, addr_b}];
+  end
+endmodule
+
 // 2M+256K memory backed by UltraRAM
+// With DDR_ROM, only $00_0000 - $03_ffff of PRG ROM is used, as RomCache pages,
+// and CHR ROM is only used for CHR RAM.
 // $00_0000 - $0f_ffff: PRG ROM 1MB
 // $10_0000 - $1f_ffff: Hole, write has no effect, reads garbage
 // $20_0000 - $2f_ffff: CHR ROM 1MB
-// $30_0000 - $37_ffff: Hole, write has no effect, reads garbage
-// $38_0000 - $38_07ff: Internal RAM (2KB), and 126KB unused
-// $3a_0000 - $3b_ffff: Hole
+// $30_0000 - $3b_ffff: Hole, VRAM and internal RAM are in NesRam
 // $3c_0000 - $3d_ffff: PRG RAM 128KB
 // $3e_0000 - $3f_ffff: Hole
 module MemoryController(
@@ -149,8 +443,10 @@ module MemoryController(
     input write,              // Set to 1 to write to RAM
     input [21:0] addr,        // Address to read / write
     input [7:0] din,          // Data to write
-    output reg [7:0] dout_a,  // Last read data a, available 2 cycles after read_a is set
-    output reg [7:0] dout_b,  // Last read data b, available 2 cycles after read_b is set
+    input fill,               // Set to 1 to write 8 bytes of fill_data to ROM at addr, 8-byte aligned
+    input [63:0] fill_data,
+    output [7:0] dout_a,      // Last read data a, available 1 cycle after read_a is set
+    output [7:0] dout_b,      // Last read data b, available 1 cycle after read_b is set
     output reg busy           // 1 while an operation is in progress
 );
 
@@ -160,21 +456,17 @@ module MemoryController(
 //    0 +------------+------------------+
 //      |  PRG RAM   |      PRG ROM     |
 // 128K +------------+------------------+
-//      |Internal RAM|      CHR ROM     |
-//      |    VRAM    |                  |
+//      |  (unused)  |      CHR ROM     |
 // 256K +------------+------------------+
 // 2M+256K RAM buffer to hold everything
-wire is_internal_ram = addr[21:16] == 'b11_1000; // 'h38_0000 - 'h38_ffff (64K), actually only uses lower 2KB
-wire is_vram = addr[21:16] == 'b11_0000;         // 'h30_0000 - 'h30_ffff (64K), actually only uses lower 2KB
 wire is_prg_ram = addr[21:17] == 'b11_110;       // 'h3c_0000 - 'h3d_ffff, 128KB of address space is PRG RAM
-wire is_hole = addr[21:20] == 'b01 || (addr[21:20] == 'b11 && !is_prg_ram && !is_internal_ram && !is_vram);   // memory hole
+wire is_hole = addr[21:20] == 'b01 || (addr[21:20] == 'b11 && !is_prg_ram);   // memory hole
 wire [17:0] ram_addr = is_prg_ram ? {'b0, addr[16:0]}:
-                       is_internal_ram ? {'b10, addr[15:0]} :
-                       is_vram ? {'b11, addr[15:0]} :
                        {addr[21], addr[19:3]};
-wire [3:0] ram_offset = (is_vram || is_internal_ram || is_prg_ram) ? 'b1000 : {'b0, addr[2:0]};
-wire [8:0] ram_we = is_hole ? 0 : framwe(ram_offset, write);
-wire [71:0] edin= ram_offset == 0 ? din :
+wire [3:0] ram_offset = is_prg_ram ? 'b1000 : {'b0, addr[2:0]};
+wire [8:0] ram_we = fill ? 'b0_1111_1111 : is_hole ? 0 : framwe(ram_offset, write);
+wire [71:0] edin= fill ? {8'h00, fill_data} :
+                  ram_offset == 0 ? din :
                   ram_offset == 1 ? din << 8 :
                   ram_offset == 2 ? din << 16 :
                   ram_offset == 3 ? din << 24 :
@@ -217,6 +509,13 @@ bytewrite_ram_1b ram(clk, ram_we, ram_addr, edin, edout);     // UG901 byte writ
 
 reg r_read_a, r_read_b; // read_a/read_b delayed by 1
 reg [3:0] r_ram_offset;
+reg [7:0] last_a, last_b;
+wire [7:0] rdata = fdout(r_ram_offset, edout);   // shift right by ram_offset*8
+
+// Data comes straight from the RAM in the cycle after the read, and is kept
+// for later cycles. This is what lets NES run every 2nd cycle in turbo mode.
+assign dout_a = r_read_a ? rdata : last_a;
+assign dout_b = r_read_b ? rdata : last_b;
 
 always @(posedge clk) begin
     busy <= 0;
@@ -224,31 +523,269 @@ always @(posedge clk) begin
     r_read_b <= read_b;
     r_ram_offset <= ram_offset;
     if (r_read_a) begin
-        dout_a <= fdout(r_ram_offset, edout);   // shift right by ram_offset*8
+        last_a <= rdata;
     end else if (r_read_b) begin
-        dout_b <= fdout(r_ram_offset, edout);
+        last_b <= rdata;
     end
 end
 
 endmodule
 
 
+// Clock enables for the NES machine. Normally the NES steps once every 4 clk
+// cycles: memory access at cycle #0, NES at cycle #3, which is real NES speed.
+// In turbo mode it goes #0, #3, #0, #3..., twice as fast. That works because
+// MemoryController and NesRam have read data ready 1 cycle after the access.
+// stall holds it at cycle #0 (RomCache waiting for DDR).
+module NesClock(input clk, input turbo, input stall,
+                output run_mem, output run_nes,
+                output clk_ppu);
+  reg [1:0] nes_ce = 0;
+  assign run_mem = nes_ce == 0;
+  assign run_nes = nes_ce == 3;
+  assign clk_ppu = nes_ce == 3 || nes_ce == 0 && !turbo;   // posedge @ nes_ce == 3
+
+  always @(posedge clk)
+    if (!stall)
+      nes_ce <= !turbo ? nes_ce + 1 :
+                nes_ce == 3 ? 0 : 3;
+endmodule
+
+
+// Save states. On freeze, the NES is stopped at the start of vertical
+// blanking (scanline 240, cycle 0, in the memory slot), and its whole state
+// can then be read and written by PS through AXI, as a byte address space:
+// $00000-$007ff: NES memories through ss_mem (OAM, palette, MMC5 expansion RAM)
+// $00800-$00bff: chain buffer, every register of the NES, 1 bit each
+// $00c00-$00c0f: dirty blocks, read only (see below)
+// $01000-$017ff: internal RAM (NesRam)
+// $01800-$01fff: VRAM (NesRam)
+// $10000-$1ffff: PRG RAM ($3c_0000 in MemoryController)
+// $20000-$3ffff: CHR ROM/RAM ($20_0000 in MemoryController)
+//
+// The registers are on one scan chain (see NES). After the freeze it is
+// shifted out into the chain buffer, and then its length is measured by
+// shifting a single 1 through it. Resume shifts the buffer back in, so the
+// NES continues with whatever state PS left in there and in the memories.
+// Memory read data the NES has not used yet is also part of the state, as
+// MemoryController and NesRam only keep the result of their last read. It
+// is saved in latch, the first 32 bits of the chain, and after resume the
+// NES gets it instead of the memory output until it reads that memory again.
+//
+// To save often (rewind), PS keeps a copy of the state and only reads what
+// changed. Bit n of the dirty blocks is set when the NES writes 256-byte block
+// n of RAM (0-7), VRAM (8-15), PRG RAM (16-47) or CHR RAM (48-79). They are
+// snapshotted and cleared at every freeze, so they tell what changed since the
+// last one.
+module SaveState(input clk, input reset,
+                 input freeze,                  // freeze at the next frame end
+                 input resume,                  // load the chain buffer and continue
+                 input at_frame_end,            // NES is at the freeze point
+                 output hold,                   // stop the NES and its memory accesses
+                 output frozen,                 // state is accessible
+                 output reg error,              // chain longer than SS_MAX bits
+                 output reg [13:0] chain_len,   // in bits
+                 input [31:0] latch_in,         // memory read data the NES sees, {cpu, ppu, ram, vram}
+                 output reg [31:0] latch,
+                 output reg [3:0] latch_hold,   // NES gets latch bytes instead of memory data
+                 input [3:0] latch_read,        // NES reads the memory again
+                 input [127:0] mark_dirty,      // NES writes these blocks
+                 output ss_shift, output ss_chain_in, input ss_chain_out, output ss_reload,
+                 input set_addr,                // start accessing at addr_in, 4-byte aligned
+                 input [17:0] addr_in,
+                 input word_write,              // write word_in (little endian) and go to the next word
+                 input [31:0] word_in,
+                 input word_read,               // word_out is used, go to the next word
+                 output reg [31:0] word_out,
+                 output busy,                   // an access is in progress
+                 output reg ready,              // word_out is valid
+                 output [17:0] acc_addr,        // byte access to the state outside of the chain buffer
+                 output acc_read, output acc_write, output [7:0] acc_data,
+                 input [7:0] acc_q);            // 1 cycle after acc_read
+  localparam RUN = 0, UNLOAD = 1, MEASURE = 2, FROZEN = 3, LOAD0 = 4, LOAD = 5, RELOAD = 6;
+  localparam SS_MAX = 8192;         // chain buffer size in bits
+
+  reg [2:0] state = RUN;
+  reg want = 0;                     // freeze asked for
+  reg resumed = 0;                  // still at the frame end it was frozen at
+  reg [13:0] k;                     // bit counter
+  reg [7:0] sbyte;                  // bits shifted out, LSB first
+  reg [7:0] cbuf [0:1023];
+  reg [7:0] cbuf_q;
+  reg [127:0] dirty = ~128'd0, dirty_snap = ~128'd0;
+
+  // Byte access
+  reg [15:0] base;                  // word address
+  reg [1:0] bi;                     // byte in word
+  reg [1:0] ast = 0;                // 0: idle, 1: write, 2: read, 3: read data
+  reg [31:0] wbuf;
+  assign acc_addr = {base, bi};
+  assign acc_read = ast == 2;
+  assign acc_write = ast == 1;
+  assign acc_data = wbuf[bi*8 +: 8];
+  assign busy = ast != 0;
+  wire in_cbuf = acc_addr[17:10] == 8'b0000_0010;
+  wire in_dirty = acc_addr[17:4] == 14'h00c0;
+
+  wire freeze_now = want && at_frame_end && !resumed;
+  assign hold = state != RUN || freeze_now;
+  assign frozen = state == FROZEN;
+  assign ss_shift = state == UNLOAD || state == MEASURE && !ss_chain_out && k != SS_MAX || state == LOAD;
+  assign ss_reload = state == RELOAD;
+  assign ss_chain_in = latch[31];
+  wire shift_bit = state == MEASURE ? k == 0 :
+                   state == LOAD ? cbuf_q[k[2:0]] : 1'b0;
+  wire [13:0] k1 = k + 1;
+  wire [9:0] cbuf_addr = state == UNLOAD ? k[12:3] :
+                         state == LOAD0 ? 10'd0 :
+                         state == LOAD ? k1[12:3] : acc_addr[9:0];
+  wire cbuf_write = state == UNLOAD && k[2:0] == 7 || acc_write && in_cbuf;
+
+  always @(posedge clk) begin
+    if (cbuf_write)
+      cbuf[cbuf_addr] <= state == UNLOAD ? {ss_chain_out, sbyte[7:1]} : acc_data;
+    cbuf_q <= cbuf[cbuf_addr];
+  end
+
+  always @(posedge clk) if (reset) begin
+    state <= RUN;
+    want <= 0;
+    resumed <= 0;
+    error <= 0;
+    chain_len <= 0;
+    latch_hold <= 0;
+    dirty <= ~128'd0;               // new game, everything is new
+    dirty_snap <= ~128'd0;
+  end else begin
+    latch_hold <= latch_hold & ~latch_read;
+    dirty <= dirty | mark_dirty;
+    if (freeze)
+      want <= 1;
+    if (ss_shift)
+      latch <= {latch[30:0], shift_bit};
+    case (state)
+    RUN: if (freeze_now) begin
+      latch <= latch_in;
+      dirty_snap <= dirty | mark_dirty;
+      dirty <= 0;
+      k <= 0;
+      state <= UNLOAD;
+    end else begin
+      if (at_frame_end)
+        resumed <= 0;
+      if (resume)
+        want <= 0;                  // not frozen yet, cancel
+    end
+    UNLOAD: begin
+      sbyte <= {ss_chain_out, sbyte[7:1]};
+      k <= k + 1;
+      if (k == SS_MAX - 1) begin
+        k <= 0;
+        state <= MEASURE;
+      end
+    end
+    MEASURE: if (ss_chain_out || k == SS_MAX) begin
+      chain_len <= k;
+      error <= !ss_chain_out;
+      state <= FROZEN;
+    end else begin
+      k <= k + 1;
+    end
+    FROZEN: if (resume) begin
+      want <= 0;                    // a freeze from here on is for the next frame
+      state <= LOAD0;
+    end
+    LOAD0: begin
+      k <= 0;
+      state <= chain_len == 0 ? RELOAD : LOAD;
+    end
+    LOAD: begin
+      k <= k + 1;
+      if (k == chain_len - 1)
+        state <= RELOAD;
+    end
+    RELOAD: begin
+      latch_hold <= 4'b1111;
+      resumed <= 1;
+      state <= RUN;
+    end
+    endcase
+  end
+
+  always @(posedge clk) if (reset) begin
+    ast <= 0;
+    ready <= 0;
+  end else begin
+    case (ast)
+    0: if (frozen) begin
+      if (set_addr) begin
+        base <= addr_in[17:2];
+        bi <= 0;
+        ast <= 2;
+        ready <= 0;
+      end else if (word_write) begin
+        wbuf <= word_in;
+        bi <= 0;
+        ast <= 1;
+        ready <= 0;
+      end else if (word_read && ready) begin
+        base <= base + 1;
+        bi <= 0;
+        ast <= 2;
+        ready <= 0;
+      end
+    end
+    1: begin
+      bi <= bi + 1;
+      if (bi == 3) begin
+        base <= base + 1;
+        ast <= 0;
+      end
+    end
+    2: ast <= 3;
+    3: begin
+      word_out[bi*8 +: 8] <= in_cbuf ? cbuf_q : in_dirty ? dirty_snap[acc_addr[3:0]*8 +: 8] : acc_q;
+      bi <= bi + 1;
+      if (bi == 3) begin
+        ast <= 0;
+        ready <= 1;
+      end else
+        ast <= 2;
+    end
+    endcase
+  end
+endmodule
+
+
 module NES_KV260(
     // main clock 21.477272 MHz
+    (* X_INTERFACE_INFO = "xilinx.com:signal:clock:1.0 clk CLK" *)
+    (* X_INTERFACE_PARAMETER = "ASSOCIATED_BUSIF s00_axis:m00_axi" *)
     input clk,
     input reset,
 
-    output clk_ppu,             // 1/4 of clk
+    output clk_ppu,             // 1/4 of clk, 1/2 in turbo mode
     output [5:0] color,         // pixel color from PPU
+    output [2:0] emphasis,      // color emphasis from PPU, red, green, blue
     output [8:0] scanline,      // current scanline from PPU
     output [8:0] cycle,         // current cycle from PPU
     
     output [15:0] sample,        // audio sample
 
+    output video_genlock,       // to nes_dp: lock output frames to NES frames
+    output [3:0] video_scale,   // to nes_dp: scaling mode and filters
+    output reg [1:0] video_timing = 0,  // to nes_dp: 0 1080p, 1 720p, 2 1440p, set by PS at boot
+    input video_locked,         // from nes_dp (pixel clock domain): genlock is holding
+    output reg pal_write = 0,   // to nes_dp: write pal_data (RGB) into palette entry pal_addr
+    output reg [8:0] pal_addr = 0,
+    output reg [23:0] pal_data = 0,
+
+    output reg frame_irq = 0,   // to PS (pl_ps_irq0, rising edge): NES enters vblank
+
     // Ports of Axi Slave Bus Interface S00_AXI
     input wire  s00_axi_aclk,
     input wire  s00_axi_aresetn,
-    input wire [3:0] s00_axi_awaddr,
+    input wire [6:0] s00_axi_awaddr,
     input wire [2:0] s00_axi_awprot,
     input wire  s00_axi_awvalid,
     output wire  s00_axi_awready,
@@ -259,14 +796,37 @@ module NES_KV260(
     output wire [1 : 0] s00_axi_bresp,
     output wire  s00_axi_bvalid,
     input wire  s00_axi_bready,
-    input wire [3:0] s00_axi_araddr,
+    input wire [6:0] s00_axi_araddr,
     input wire [2:0] s00_axi_arprot,
     input wire  s00_axi_arvalid,
     output wire  s00_axi_arready,
     output wire [31:0] s00_axi_rdata,
     output wire [1:0] s00_axi_rresp,
     output wire  s00_axi_rvalid,
-    input wire  s00_axi_rready
+    input wire  s00_axi_rready,
+
+    // Ports of Axi Stream Slave Bus Interface S00_AXIS, ROM data from AXI DMA (clocked by clk)
+    input wire [31:0] s00_axis_tdata,
+    input wire [3:0] s00_axis_tkeep,
+    input wire  s00_axis_tlast,
+    input wire  s00_axis_tvalid,
+    output wire  s00_axis_tready,
+
+    // Ports of Axi Master Bus Interface M00_AXI, read only, cartridge ROM in DDR (clocked by clk)
+    // Only used with DDR_ROM.
+    output wire [31:0] m00_axi_araddr,
+    output wire [7:0] m00_axi_arlen,
+    output wire [2:0] m00_axi_arsize,
+    output wire [1:0] m00_axi_arburst,
+    output wire [3:0] m00_axi_arcache,
+    output wire [2:0] m00_axi_arprot,
+    output wire  m00_axi_arvalid,
+    input wire  m00_axi_arready,
+    input wire [63:0] m00_axi_rdata,
+    input wire [1:0] m00_axi_rresp,
+    input wire  m00_axi_rlast,
+    input wire  m00_axi_rvalid,
+    output wire  m00_axi_rready
 );
 
   // internal wiring and state
@@ -277,20 +837,50 @@ module NES_KV260(
   wire memory_write;
   wire [7:0] memory_din_cpu, memory_din_ppu;
   wire [7:0] memory_dout;
+  wire [10:0] ram_addr, vram_addr;
+  wire ram_read, ram_write, vram_read, vram_write;
+  wire [7:0] ram_din, ram_dout, vram_din, vram_dout;
   reg [7:0] joypad_bits, joypad_bits2;
   reg [1:0] last_joypad_clock;
   wire [31:0] dbgadr;
   wire [1:0] dbgctr;
-  reg [1:0] nes_ce = 0;
+  wire [21:0] mem_addr;         // memory_addr, after RomCache
+  wire rom_cached, rom_stall;
+  wire rom_fill;
+  wire [21:0] rom_fill_addr;
+  wire [63:0] rom_fill_data;
+  wire [31:0] rom_hits, rom_misses, rom_stall_cycles, rom_max_stall;
+  wire [3:0] rom_probe;         // RomCache prefetch asks the mapper
+  wire [21:0] rom_probe_addr;
+  wire rom_probe_ok;
+  wire [7:0] mem_q_cpu, mem_q_ppu, ram_q, vram_q;   // memory read data, before the save state latch
+  wire ss_hold, ss_frozen, ss_error, ss_busy, ss_ready;
+  wire [13:0] ss_chain_len;
+  wire [31:0] ss_latch;
+  wire [3:0] ss_latch_hold;
+  wire ss_shift, ss_chain_in, ss_chain_out, ss_reload;
+  wire [31:0] ss_word_out;
+  wire [17:0] ss_addr;
+  wire ss_read, ss_write;
+  wire [7:0] ss_data, ss_q;
+  wire vblank_start;
+  reg [31:0] frame_count;       // frames since the game started
+  wire [4:0] nes_perf;
+  reg [511:0] perf;             // performance counters, see below
   wire [15:0] SW = 16'b1111_1111_1111_1111;   // every switch is on
 
     // Instantiation of Axi Bus Interface S00_AXI
   nes_axi # ( 
     .C_S_AXI_DATA_WIDTH(32),
-    .C_S_AXI_ADDR_WIDTH(4)
+    .C_S_AXI_ADDR_WIDTH(7)
   ) axi (
     .value(axi_cmd),
     .result(axi_status),
+    .result2(axi_counter),
+    .result3(ss_word_out),
+    .counters(perf),
+    .wr_hold(axi_wr_hold),
+    .rd_hold(axi_rd_hold),
     .S_AXI_ACLK(s00_axi_aclk),.S_AXI_ARESETN(s00_axi_aresetn),
     .S_AXI_AWADDR(s00_axi_awaddr),.S_AXI_AWPROT(s00_axi_awprot),.S_AXI_AWVALID(s00_axi_awvalid),.S_AXI_AWREADY(s00_axi_awready),
     .S_AXI_WDATA(s00_axi_wdata),.S_AXI_WSTRB(s00_axi_wstrb),.S_AXI_WVALID(s00_axi_wvalid),.S_AXI_WREADY(s00_axi_wready),
@@ -301,32 +891,95 @@ module NES_KV260(
 
   wire [31:0] axi_cmd;
   wire [31:0] axi_status;
+  wire [31:0] axi_counter = counter_sel == 0 ? rom_hits :       // reg2
+                            counter_sel == 1 ? rom_misses :
+                            counter_sel == 2 ? rom_stall_cycles :
+                            counter_sel == 3 ? rom_max_stall :
+                            counter_sel == 4 ? ss_chain_len :
+                            counter_sel == 5 ? frame_count : 0;
   assign axi_status[0] = loader_done;
   assign axi_status[1] = loader_fail;
   assign axi_status[3:2] = axi_state;
+  assign axi_status[4] = video_locked_sync[1];
+`ifdef DDR_ROM
+  assign axi_status[5] = 1;     // PS needs to put ROM in DDR, and send rom_base
+`else
+  assign axi_status[5] = 0;
+`endif
+  assign axi_status[6] = turbo;
+  assign axi_status[7] = ss_frozen;
+  assign axi_status[8] = ss_error;
+  assign axi_status[31:16] = {loader_btn_2, loader_btn};   // buttons the NES has now
 
   // Drive loader from AXI
-  reg [1:0] axi_state = 0;     // 0: idle, 1: loader_expect_len, 2: loader_loading
+  reg [1:0] axi_state = 0;     // 0: idle, 1: loader_expect_len, 2: loader_loading, 3: expect_rom_base
+  reg loader_packed = 0;       // 1: every write in loader_loading carries 4 ROM bytes
   wire [7:0] wbyte = s00_axi_wdata[7:0];
   wire [31:0] wdata = s00_axi_wdata;
 
   reg  [7:0] loader_conf;     // bit 0 is reset
-  reg [7:0] loader_btn, loader_btn_2;
+  reg [7:0] loader_btn = 0, loader_btn_2 = 0;     // what the NES reads
+  reg [7:0] btn_pending = 0, btn_pending_2 = 0;   // from PS, taken at the next vblank
+  reg [7:0] video_conf = 0;   // bit 0 is genlock, bits 4:1 scale of nes_dp
+  reg [1:0] video_locked_sync = 0;
+  reg [31:0] rom_base = 0;    // DDR address of ROM image, for DDR_ROM
+  reg rom_base_valid = 0;
+  reg [7:0] counter_sel = 0;  // which counter to show in reg2
+  reg [7:0] speed = 1;        // emulation speed asked for by PS, 1x, 2x, ...
+  wire turbo = speed >= 2;    // only 2x is possible at this clk, faster asks get 2x
+  assign video_genlock = video_conf[0] && !turbo;
+  assign video_scale = video_conf[4:1];
+  always @(posedge clk)
+    video_locked_sync <= {video_locked_sync[0], video_locked};
+
+  // While loading, ROM data comes either as AXI-Lite writes to reg4 (one byte
+  // per write, or 4 bytes per write in packed mode), or as packed 32-bit words
+  // on the AXI-Stream port (bursts from AXI DMA). reg0 keeps taking commands
+  // meanwhile, so buttons and the rest never end up in the ROM.
+  // Note s00_axi_aclk and clk are the same clock (pl_clk1).
+  reg [31:0] loader_len = 0;
+  reg [31:0] loader_count = 0;      // bytes pushed into the loader FIFO
+  wire loader_fifo_full, loader_fifo_almost_full;
+  wire lite_push = (axi_state == 2) && s00_axi_aresetn == 1'b1 && axi.slv_reg_wren && s00_axi_awaddr == 7'h10;
+  wire axis_push = s00_axis_tvalid && s00_axis_tready;
+  assign s00_axis_tready = (axi_state == 2) && !loader_fifo_full && !lite_push;
+
+  // tkeep is contiguous from byte 0, only the last beat of a transfer may be partial
+  wire [2:0] axis_count = s00_axis_tkeep[3] ? 4 : s00_axis_tkeep[2] ? 3 : s00_axis_tkeep[1] ? 2 : s00_axis_tkeep[0] ? 1 : 0;
+  wire [31:0] loader_left = loader_len - loader_count;
+  wire [2:0] lite_count = loader_packed ? 4 : 1;
+  wire [2:0] push_max = lite_push ? lite_count : axis_count;
+  wire [2:0] push_count = loader_left < push_max ? loader_left[2:0] : push_max;   // drop bytes past loader_len
+  wire [31:0] push_data = !lite_push ? s00_axis_tdata : loader_packed ? wdata : {24'b0, wbyte};
+  // Packed writes can come in faster than the FIFO drains, so hold off the
+  // AXI-Lite write handshake of reg4 while the FIFO is nearly full. Commands
+  // in reg0 are not held up by a DMA transfer keeping the FIFO full.
+  wire axi_wr_hold = (axi_state == 2) && loader_fifo_almost_full && s00_axi_awaddr == 7'h10 || ss_busy;
+  // reg3 reads wait until the next word of save state is there
+  wire axi_rd_hold = s00_axi_araddr[6:2] == 3 && ss_frozen && !ss_ready;
 
 `ifdef EMBED_GAME
   // Static compiled-in game data 
   wire [7:0] loader_input;
   wire loader_clk;
   wire loader_reset = reset;
+  assign loader_fifo_full = 0;      // AXI data is discarded
+  assign loader_fifo_almost_full = 0;
   GameData ines(clk, reset, loader_input, loader_clk);
 `else
-  // Game data comes from AXI
-  wire [7:0] loader_input = wbyte;
-  wire       loader_clk   = (axi_state == 2) && s00_axi_aresetn == 1'b1 && axi.slv_reg_wren && s00_axi_awaddr == 4'b0;
+  // Game data comes from AXI, through the loader FIFO which feeds GameLoader one byte per clk.
+  wire [7:0] loader_input;
+  wire       loader_clk;
   wire loader_reset = loader_conf[0];
+  LoaderFifo loader_fifo(clk, loader_reset,
+                         lite_push || axis_push, push_data, push_count,
+                         loader_fifo_full, loader_fifo_almost_full,
+                         loader_input, loader_clk);
 `endif
 
-  always @(posedge clk) begin
+  always @(posedge clk) if (ss_shift) begin
+    {joypad_bits, joypad_bits2, last_joypad_clock} <= {joypad_bits, joypad_bits2, last_joypad_clock, ss_chain_in};
+  end else begin
     if (joypad_strobe) begin
       joypad_bits <= loader_btn;
       joypad_bits2 <= loader_btn_2;
@@ -337,6 +990,7 @@ module NES_KV260(
       joypad_bits2 <= {1'b0, joypad_bits2[7:1]};
     last_joypad_clock <= joypad_clock;
   end
+  wire ss_joypad = joypad_bits[7];
 
   // ROM loader
   wire [21:0] loader_addr;
@@ -352,73 +1006,261 @@ module NES_KV260(
 
   // The NES machine
   wire reset_nes = !loader_done;
-  wire run_mem = (nes_ce == 0) && !reset_nes;       // memory runs at clock cycle #0
-  wire run_nes = (nes_ce == 3) && !reset_nes;       // nes runs at clock cycle #3
-  assign clk_ppu = (nes_ce == 3 || nes_ce == 0);      // posedge @ nes_ce == 3
+  wire mem_slot, nes_slot;
+  wire run_mem = mem_slot && !reset_nes;            // memory runs at clock cycle #0
+  wire run_nes = nes_slot && !reset_nes;            // nes runs at clock cycle #3
+  wire nes_stall = rom_stall || ss_hold;
+  wire mem_go = run_mem && !nes_stall;              // NES memory access happens
+
+  // NES is clocked at every 4th cycle, or every 2nd in turbo mode. It waits
+  // at cycle #0 while RomCache fetches ROM data, and while frozen for a save state.
+  NesClock nes_clock(clk, turbo, nes_stall, mem_slot, nes_slot, clk_ppu);
+
+  // Save states
+  reg ss_freeze = 0, ss_resume = 0, ss_set_addr = 0;
+  reg [17:0] ss_addr_in;
+  wire [8:0] nes_scanline, nes_cycle;
+  wire at_frame_end = run_mem && nes_scanline == 240 && nes_cycle == 0;
+  SaveState save_state(clk, loader_reset,
+        ss_freeze, ss_resume, at_frame_end,
+        ss_hold, ss_frozen, ss_error, ss_chain_len,
+        {memory_din_cpu, memory_din_ppu, ram_din, vram_din}, ss_latch, ss_latch_hold,
+        {memory_read_cpu, memory_read_ppu, ram_read, vram_read} & {4{mem_go}},
+        ss_mark_dirty,
+        ss_shift, ss_chain_in, ss_chain_out, ss_reload,
+        ss_set_addr, ss_addr_in,
+        axi.slv_reg_wren && s00_axi_awaddr == 7'h0c, wdata,
+        axi.slv_reg_rden && axi.axi_araddr[6:2] == 3,
+        ss_word_out, ss_busy, ss_ready,
+        ss_addr, ss_read, ss_write, ss_data, ss_q);
 
-  // NES is clocked at every 4th cycle.
+  // Memory read data the NES has not used when the state was saved
+  assign memory_din_cpu = ss_latch_hold[3] ? ss_latch[31:24] : mem_q_cpu;
+  assign memory_din_ppu = ss_latch_hold[2] ? ss_latch[23:16] : mem_q_ppu;
+  assign ram_din = ss_latch_hold[1] ? ss_latch[15:8] : ram_q;
+  assign vram_din = ss_latch_hold[0] ? ss_latch[7:0] : vram_q;
+
+  // Where the save state accesses go, see SaveState
+  wire ss_nes = ss_addr[17:11] == 0;
+  wire ss_ram = ss_addr[17:11] == 7'b0000_010;
+  wire ss_vram = ss_addr[17:11] == 7'b0000_011;
+  wire ss_uram = ss_addr[17:16] != 0;
+  wire [21:0] ss_uram_addr = ss_addr[17] ? {5'b10_000, ss_addr[16:0]} : {6'b11_1100, ss_addr[15:0]};
+  wire [7:0] ss_nes_q;
+
+  // Blocks the NES writes, for the dirty blocks of SaveState
+  wire prg_ram_write = memory_write && mem_go && !rom_cached && mem_addr[21:13] == 9'b1_1110_0000;
+  wire chr_ram_write = memory_write && mem_go && !rom_cached && mem_addr[21:13] == 9'b1_0000_0000;
+  wire [127:0] ss_mark_dirty = (ram_write && mem_go ? 128'd1 << ram_addr[10:8] : 128'd0) |
+                               (vram_write && mem_go ? 128'd1 << (8 + vram_addr[10:8]) : 128'd0) |
+                               (prg_ram_write ? 128'd1 << (16 + mem_addr[12:8]) : 128'd0) |
+                               (chr_ram_write ? 128'd1 << (48 + mem_addr[12:8]) : 128'd0);
+  assign ss_q = ss_nes ? ss_nes_q : ss_ram ? ram_q : ss_vram ? vram_q : mem_q_cpu;
+
+  // Shown to nes_dp and audio while frozen: the frame is done, and vblank goes on
+  wire [15:0] nes_sample;
+  reg [15:0] last_sample;
   always @(posedge clk)
-    nes_ce <= nes_ce + 1;
+    if (!ss_hold)
+      last_sample <= nes_sample;
+  assign scanline = ss_hold ? 9'd240 : nes_scanline;
+  assign cycle = ss_hold ? 9'd0 : nes_cycle;
+  assign sample = ss_hold ? last_sample : nes_sample;
+
+  // Frame interrupt, a pulse at every vblank, and frames since the game started
+  always @(posedge clk) begin
+    frame_irq <= vblank_start;
+    if (reset_nes)
+      frame_count <= 0;
+    else if (vblank_start)
+      frame_count <= frame_count + 1;
+  end
+
+  // Performance counters, registers 16-31 of s00_axi ($40-$7c). They run
+  // freely from reset on, PS takes the difference between two reads.
+  //  0: frames               1: CPU cycles           2: CPU cycles paused for sprite/DMC DMA
+  //  3: mapper IRQs          4: NMIs                 5: lines with sprite overflow
+  //  6: MemoryController CPU reads                   7: MemoryController PPU reads
+  //  8: MemoryController writes                      9: bytes accepted by GameLoader
+  // 10: clk cycles the NES is stopped (ROM cache, save states)
+  reg [8:0] overflow_line;
+  reg overflow_seen = 0;
+  wire overflow_new = nes_perf[4] && !(overflow_seen && overflow_line == nes_scanline);
+  wire [15:0] perf_event = {5'b0,
+        nes_stall && mem_slot && !reset_nes,
+        loader_clk,
+        memory_write && mem_go && !rom_cached,
+        memory_read_ppu && mem_go,
+        memory_read_cpu && mem_go,
+        overflow_new,
+        nes_perf[3:0],
+        vblank_start};
+  integer pi;
+  always @(posedge clk) begin
+    if (overflow_new) begin
+      overflow_seen <= 1;
+      overflow_line <= nes_scanline;
+    end
+    for (pi = 0; pi < 16; pi = pi + 1)
+      if (reset)
+        perf[pi*32 +: 32] <= 0;
+      else if (perf_event[pi])
+        perf[pi*32 +: 32] <= perf[pi*32 +: 32] + 1;
+  end
 
   // Main NES machine
   NES nes(clk, reset_nes, run_nes,
           mapper_flags,
-          sample, color,
+          nes_sample, color,
           joypad_strobe, joypad_clock, {joypad_bits2[0], joypad_bits[0]},
           SW[4:0],
           memory_addr,
           memory_read_cpu, memory_din_cpu,
           memory_read_ppu, memory_din_ppu,
           memory_write, memory_dout,
-          cycle, scanline,
+          ram_addr, ram_read, ram_din, ram_write, ram_dout,
+          vram_addr, vram_read, vram_din, vram_write, vram_dout,
+          nes_cycle, nes_scanline, vblank_start, nes_perf, emphasis,
           dbgadr,
-          dbgctr);
+          dbgctr,
+          ss_shift, ss_reload, ss_joypad, ss_chain_out,
+          ss_addr[10:0], ss_read && ss_nes, ss_write && ss_nes, ss_data, ss_nes_q,
+          rom_probe, rom_probe_addr, rom_probe_ok);
+
+  wire loader_ram = loader_write && loader_addr[21:16] == 6'b11_1000;    // internal RAM, in NesRam
+  wire loader_vram = loader_write && loader_addr[21:16] == 6'b11_0000;   // VRAM, in NesRam
+
+  // Cartridge ROM
+`ifdef DDR_ROM
+  RomCache rom_cache(clk, loader_reset,
+        rom_base, rom_base_valid, mapper_flags[15],
+        (memory_read_cpu || memory_read_ppu) && run_mem && !ss_hold, memory_addr,
+        rom_cached, mem_addr, rom_stall,
+        !mem_go && !(ss_uram && (ss_read || ss_write)), rom_fill, rom_fill_addr, rom_fill_data,
+        rom_hits, rom_misses, rom_stall_cycles, rom_max_stall,
+        rom_probe, rom_probe_addr, rom_probe_ok,
+        m00_axi_araddr, m00_axi_arlen, m00_axi_arsize, m00_axi_arburst, m00_axi_arcache, m00_axi_arprot,
+        m00_axi_arvalid, m00_axi_arready,
+        m00_axi_rdata, m00_axi_rresp, m00_axi_rlast, m00_axi_rvalid, m00_axi_rready);
+  // ROM bytes from the loader are not needed, PS puts the ROM in DDR itself
+  wire loader_mem_write = loader_write && loader_addr[21:20] == 2'b11 && !loader_ram && !loader_vram;
+`else
+  assign mem_addr = memory_addr;
+  assign {rom_cached, rom_stall, rom_fill, rom_fill_addr, rom_fill_data} = 0;
+  assign {rom_hits, rom_misses, rom_stall_cycles, rom_max_stall} = 0;
+  assign rom_probe = 0;
+  assign {m00_axi_araddr, m00_axi_arlen, m00_axi_arsize, m00_axi_arburst, m00_axi_arcache, m00_axi_arprot} = 0;
+  assign {m00_axi_arvalid, m00_axi_rready} = 0;
+  wire loader_mem_write = loader_write && !loader_ram && !loader_vram;
+`endif
+
+  // Internal RAM and VRAM, cleared by the loader before NES starts
+  // Save states use the same ports while the NES is frozen.
+  wire ss_ram_read = ss_read && ss_ram, ss_ram_write = ss_write && ss_ram;
+  wire ss_vram_read = ss_read && ss_vram, ss_vram_write = ss_write && ss_vram;
+  NesRam nes_ram(clk,
+        ram_read && mem_go || ss_ram_read, ram_write && mem_go || loader_ram || ss_ram_write,
+        loader_ram ? loader_addr[10:0] : ss_frozen ? ss_addr[10:0] : ram_addr,
+        loader_ram ? loader_write_data : ss_frozen ? ss_data : ram_dout, ram_q,
+        vram_read && mem_go || ss_vram_read, vram_write && mem_go || loader_vram || ss_vram_write,
+        loader_vram ? loader_addr[10:0] : ss_frozen ? ss_addr[10:0] : vram_addr,
+        loader_vram ? loader_write_data : ss_frozen ? ss_data : vram_dout, vram_q);
 
   // Combine RAM and ROM data to a single address space for NES to access
   wire ram_busy;
+  wire ss_uram_read = ss_read && ss_uram, ss_uram_write = ss_write && ss_uram;
   MemoryController memory(clk,
-        memory_read_cpu && run_mem, 
-        memory_read_ppu && run_mem,
-        memory_write && run_mem || loader_write,
-        loader_write ? loader_addr : memory_addr,
-        loader_write ? loader_write_data : memory_dout,
-        memory_din_cpu,
-        memory_din_ppu,
+        memory_read_cpu && mem_go || ss_uram_read,
+        memory_read_ppu && mem_go,
+        memory_write && mem_go && !rom_cached || loader_mem_write || ss_uram_write,
+        rom_fill ? rom_fill_addr : loader_write ? loader_addr : ss_frozen ? ss_uram_addr : mem_addr,
+        loader_write ? loader_write_data : ss_frozen ? ss_data : memory_dout,
+        rom_fill, rom_fill_data,
+        mem_q_cpu,
+        mem_q_ppu,
         ram_busy);
 
-  reg [31:0] loader_len = 0;
-  reg [31:0] loader_count = 0;
   always @(posedge s00_axi_aclk) begin
-    if (s00_axi_aresetn == 1'b1 && axi.slv_reg_wren && s00_axi_awaddr == 4'b0) begin
+    ss_freeze <= 0;
+    ss_resume <= 0;
+    ss_set_addr <= 0;
+    pal_write <= 0;
+    if (pal_write)
+      pal_addr <= pal_addr + 1;
+    // Buttons reach the NES as it enters vblank, before its NMI handler reads
+    // the joypads, whenever PS wrote them. Without a game they go right through.
+    if (vblank_start || reset_nes) begin
+      loader_btn <= btn_pending;
+      loader_btn_2 <= btn_pending_2;
+    end
+    // ROM data, from AXI-Lite (reg4) or AXI-Stream
+    if (lite_push || axis_push) begin
+      if (loader_count + push_count >= loader_len)  // transfer done
+        axi_state <= 0;
+      loader_count <= loader_count + push_count;
+    end
+    // Commands, also while ROM data is coming in
+    if (s00_axi_aresetn == 1'b1 && axi.slv_reg_wren && s00_axi_awaddr == 7'h0) begin
         case (axi_state)
-            2'd0: if (wdata == 1) begin
-                    // load ines
+            2'd0, 2'd2: if (wdata == 2) begin
+                    // loader reset, ends a transfer too
+                    loader_conf <= 1;   // start loader_reset
+                    rom_base_valid <= 0;
+                    axi_state <= 0;
+                end else if (axi_state == 0 && (wdata == 1 || wdata == 4)) begin
+                    // load ines, 4: with 4 bytes packed in every data write
                     axi_state <= 1;
+                    loader_packed <= wdata == 4;
                     loader_conf <= 0;   // clear loader_reset
-                end else if (wdata == 2) begin
-                    // loader reset
-                    loader_conf <= 1;   // start loader_reset
                 end else if (wbyte == 3) begin
-                    // controller update
+                    // controller update, for the next vblank
                     // The bits are: 0 - A, 1 - B, 2 - Select, 3 - Start, 
                     //               4 - Up, 5 - Down, 6 - Left,7 - Right
-                    loader_btn <= wdata[15:8];
-                    loader_btn_2 <= wdata[23:16];
+                    btn_pending <= wdata[15:8];
+                    btn_pending_2 <= wdata[23:16];
+                end else if (wbyte == 5) begin
+                    // video config, wdata[15:8]: bit 0 genlock, bits 2:1 scaling mode,
+                    // bit 3 scanlines, bit 4 smooth
+                    video_conf <= wdata[15:8];
+                end else if (wbyte == 6 && axi_state == 0) begin
+                    // DDR address of ROM image follows, for DDR_ROM
+                    axi_state <= 3;
+                end else if (wbyte == 7) begin
+                    // select counter for reg2
+                    counter_sel <= wdata[15:8];
+                end else if (wbyte == 8) begin
+                    // emulation speed
+                    speed <= wdata[15:8];
+                end else if (wbyte == 9) begin
+                    // save state, wdata[15:8]: 1 - freeze at the next frame end, 2 - resume
+                    ss_freeze <= wdata[15:8] == 1;
+                    ss_resume <= wdata[15:8] == 2;
+                end else if (wbyte == 10) begin
+                    // save state access address, wdata[25:8], then reg3 reads or writes
+                    ss_set_addr <= 1;
+                    ss_addr_in <= wdata[25:8];
+                end else if (wbyte == 11) begin
+                    // palette address, wdata[16:8]: {emphasis, color}
+                    pal_addr <= wdata[16:8];
+                end else if (wbyte == 12) begin
+                    // palette entry, wdata[31:8]: RGB, then the next address
+                    pal_write <= 1;
+                    pal_data <= wdata[31:8];
+                end else if (wbyte == 13) begin
+                    // output timing of nes_dp, wdata[9:8], see nes_dp.v
+                    video_timing <= wdata[9:8];
                 end
             2'd1: begin
                 loader_len <= wdata;
                 loader_count <= 0;
                 axi_state <= 2;
             end
-            2'd2: begin
-                // transfer one byte at a time
-                if (loader_count == loader_len - 1) begin    // transfer done
-                    axi_state <= 0;
-                end
-                loader_count <= loader_count + 1;
+            // 2'd2: ROM data in reg4, handled above
+            2'd3: begin
+                rom_base <= wdata;
+                rom_base_valid <= 1;
+                axi_state <= 0;
             end
-            default: begin end
-                // ignore data            
         endcase
     end
   end
@@ -52,7 +52,8 @@ module SquareChan(input clk, input ce, input reset, input sq2,
                   input Enabled,
                   input [7:0] LenCtr_In,
                   output reg [3:0] Sample,
-                  output IsNonZero);
+                  output IsNonZero,
+                  input ss_shift, input ss_in, output ss_out);
 reg [7:0] LenCtr;
 
 // Register 1
@@ -73,7 +74,12 @@ wire [10:0] PeriodRhs = (SweepNegate ? (~ShiftedPeriod + {10'b0, sq2}) : Shifted
 wire [11:0] NewSweepPeriod = Period + PeriodRhs;
 wire ValidFreq = Period[10:3] >= 8 && (SweepNegate || !NewSweepPeriod[11]);
 
-always @(posedge clk) if (reset) begin
+always @(posedge clk) if (ss_shift) begin
+    {LenCtr, Duty, EnvLoop, EnvDisable, EnvDoReset, Volume, Envelope, EnvDivider,
+     SweepEnable, SweepNegate, SweepReset, SweepPeriod, SweepDivider, SweepShift, Period, TimerCtr, SeqPos} <=
+    {LenCtr, Duty, EnvLoop, EnvDisable, EnvDoReset, Volume, Envelope, EnvDivider,
+     SweepEnable, SweepNegate, SweepReset, SweepPeriod, SweepDivider, SweepShift, Period, TimerCtr, SeqPos, ss_in};
+  end else if (reset) begin
     LenCtr <= 0;
     Duty <= 0;
     EnvDoReset <= 0;
@@ -191,6 +197,7 @@ always @* begin
   else
     Sample = EnvDisable ? Volume : Envelope;
 end
+assign ss_out = LenCtr[7];
 endmodule
 
 
@@ -204,7 +211,8 @@ module TriangleChan(input clk, input ce, input reset,
                     input Enabled,
                     input [7:0] LenCtr_In,
                     output [3:0] Sample,
-                    output IsNonZero);
+                    output IsNonZero,
+                    input ss_shift, input ss_in, output ss_out);
   //
   reg [10:0] Period, TimerCtr;
   reg [4:0] SeqPos;
@@ -220,7 +228,10 @@ module TriangleChan(input clk, input ce, input reset,
   wire LenCtrZero = (LenCtr == 0);
   assign IsNonZero = !LenCtrZero;
   //
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {Period, TimerCtr, SeqPos, LinCtrPeriod, LinCtr, LinCtrl, LinHalt, LenCtr} <=
+      {Period, TimerCtr, SeqPos, LinCtrPeriod, LinCtr, LinCtrl, LinHalt, LenCtr, ss_in};
+  end else if (reset) begin
     Period <= 0;
     TimerCtr <= 0;
     SeqPos <= 0;
@@ -280,6 +291,7 @@ module TriangleChan(input clk, input ce, input reset,
   end
   // Generate the output
   assign Sample = SeqPos[3:0] ^ {4{~SeqPos[4]}};
+  assign ss_out = Period[10];
   //
 endmodule
 
@@ -293,7 +305,8 @@ module NoiseChan(input clk, input ce, input reset,
                  input Enabled,
                  input [7:0] LenCtr_In,
                  output [3:0] Sample,
-                 output IsNonZero);
+                 output IsNonZero,
+                 input ss_shift, input ss_in, output ss_out);
   //
   // Envelope volume
   reg EnvLoop, EnvDisable, EnvDoReset;
@@ -331,7 +344,10 @@ module NoiseChan(input clk, input ce, input reset,
     endcase
   end
   //
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {EnvLoop, EnvDisable, EnvDoReset, Volume, Envelope, EnvDivider, LenCtr, ShortMode, Shift, Period, TimerCtr} <=
+      {EnvLoop, EnvDisable, EnvDoReset, Volume, Envelope, EnvDivider, LenCtr, ShortMode, Shift, Period, TimerCtr, ss_in};
+  end else if (reset) begin
     EnvLoop <= 0;
     EnvDisable <= 0;
     EnvDoReset <= 0;
@@ -400,6 +416,7 @@ module NoiseChan(input clk, input ce, input reset,
     (LenCtr == 0 || Shift[0]) ?
       0 : 
       (EnvDisable ? Volume : Envelope);
+  assign ss_out = EnvLoop;
 endmodule
 
 module DmcChan(input clk, input ce, input reset,
@@ -413,7 +430,8 @@ module DmcChan(input clk, input ce, input reset,
                output [15:0] DmaAddr,  // Address DMC wants to read
                input [7:0] DmaData,    // Input data to DMC from memory.
                output Irq,
-               output IsDmcActive);
+               output IsDmcActive,
+               input ss_shift, input ss_in, output ss_out);
   reg IrqEnable;
   reg IrqActive;
   reg Loop;                 // Looping enabled
@@ -459,7 +477,12 @@ module DmcChan(input clk, input ce, input reset,
   end
   // Shift register initially loaded with 07
   always @(posedge clk) begin
-    if (reset) begin
+    if (ss_shift) begin
+      {IrqEnable, IrqActive, Loop, Freq, Dac, SampleAddress, SampleLen, ShiftReg, Cycles, Address, BytesLeft,
+       BitsUsed, SampleBuffer, HasSampleBuffer, HasShiftReg, DmcEnabled, ActivationDelay} <=
+      {IrqEnable, IrqActive, Loop, Freq, Dac, SampleAddress, SampleLen, ShiftReg, Cycles, Address, BytesLeft,
+       BitsUsed, SampleBuffer, HasSampleBuffer, HasShiftReg, DmcEnabled, ActivationDelay, ss_in};
+    end else if (reset) begin
       IrqEnable <= 0;
       IrqActive <= 0;
       Loop <= 0;
@@ -547,6 +570,7 @@ module DmcChan(input clk, input ce, input reset,
       end      
     end
   end
+  assign ss_out = IrqEnable;
 endmodule
 
 module ApuLookupTable(input clk, input [7:0] in_a, input [7:0] in_b, output [15:0] out);
@@ -636,7 +660,8 @@ module APU(input clk, input ce, input reset,
            input [7:0] DmaData,    // Input data to DMC from memory.
 
            output odd_or_even,
-           output IRQ);       // IRQ asserted
+           output IRQ,        // IRQ asserted
+           input ss_shift, input ss_in, output ss_out);
 
 // Which channels are enabled?
 reg [3:0] Enabled;
@@ -675,11 +700,13 @@ assign odd_or_even = InternalClock;
 
 
 // Generate each channel
-SquareChan   Sq1(clk, ce, reset, 0, ADDR[1:0], DIN, ApuMW0, ClkL, ClkE, Enabled[0], LenCtr_In, Sq1Sample, Sq1NonZero);
-SquareChan   Sq2(clk, ce, reset, 1, ADDR[1:0], DIN, ApuMW1, ClkL, ClkE, Enabled[1], LenCtr_In, Sq2Sample, Sq2NonZero);
-TriangleChan Tri(clk, ce, reset, ADDR[1:0], DIN, ApuMW2, ClkL, ClkE, Enabled[2], LenCtr_In, TriSample, TriNonZero);
-NoiseChan    Noi(clk, ce, reset, ADDR[1:0], DIN, ApuMW3, ClkL, ClkE, Enabled[3], LenCtr_In, NoiSample, NoiNonZero);
-DmcChan      Dmc(clk, ce, reset, odd_or_even, ADDR[2:0], DIN, ApuMW4, DmcSample, DmaReq, DmaAck, DmaAddr, DmaData, DmcIrq, IsDmcActive);
+wire ss_sq1, ss_sq2, ss_tri, ss_noi, ss_dmc;
+SquareChan   Sq1(clk, ce, reset, 0, ADDR[1:0], DIN, ApuMW0, ClkL, ClkE, Enabled[0], LenCtr_In, Sq1Sample, Sq1NonZero, ss_shift, ss_in, ss_sq1);
+SquareChan   Sq2(clk, ce, reset, 1, ADDR[1:0], DIN, ApuMW1, ClkL, ClkE, Enabled[1], LenCtr_In, Sq2Sample, Sq2NonZero, ss_shift, ss_sq1, ss_sq2);
+TriangleChan Tri(clk, ce, reset, ADDR[1:0], DIN, ApuMW2, ClkL, ClkE, Enabled[2], LenCtr_In, TriSample, TriNonZero, ss_shift, ss_sq2, ss_tri);
+NoiseChan    Noi(clk, ce, reset, ADDR[1:0], DIN, ApuMW3, ClkL, ClkE, Enabled[3], LenCtr_In, NoiSample, NoiNonZero, ss_shift, ss_tri, ss_noi);
+DmcChan      Dmc(clk, ce, reset, odd_or_even, ADDR[2:0], DIN, ApuMW4, DmcSample, DmaReq, DmaAck, DmaAddr, DmaData, DmcIrq, IsDmcActive,
+                 ss_shift, ss_noi, ss_dmc);
 
 // Reading this register clears the frame interrupt flag (but not the DMC interrupt flag).
 // If an interrupt flag was set at the same moment of the read, it will read back as 1 but it will not be cleared.
@@ -700,7 +727,10 @@ reg FrameInterrupt, DisableFrameInterrupt;
 //    e e e e -   192 Hz
 
    
-always @(posedge clk) if (reset) begin
+always @(posedge clk) if (ss_shift) begin
+  {Enabled, FrameSeqMode, Cycles, ClkE, ClkL, Wrote4017, IrqCtr, InternalClock, FrameInterrupt, DisableFrameInterrupt} <=
+    {Enabled, FrameSeqMode, Cycles, ClkE, ClkL, Wrote4017, IrqCtr, InternalClock, FrameInterrupt, DisableFrameInterrupt, ss_dmc};
+end else if (reset) begin
   FrameSeqMode <= 0;
   DisableFrameInterrupt <= 0;
   FrameInterrupt <= 0;
@@ -802,5 +832,6 @@ assign DOUT = {DmcIrq, frame_irq, 1'b0,
                Sq1NonZero};
 
 assign IRQ = frame_irq || DmcIrq;
+assign ss_out = Enabled[3];
 
 endmodule
@@ -109,7 +109,8 @@ module AddressGenerator(input clk, input ce,
                         input [1:0] MuxCtrl,
                         input [7:0] DataBus, T, X, Y,
                         output [15:0] AX,
-                        output Carry);
+                        output Carry,
+                        input ss_shift, input ss_in, output ss_out);
   // Actual contents of registers
   reg [7:0] AL = 0, AH = 0;
   // Last operation generated a carry?
@@ -127,7 +128,9 @@ module AddressGenerator(input clk, input ce,
   wire TmpVal = (!AHCtrl[1] | SavedCarry);
   wire [7:0] TmpAdd = (AHCtrl[1] ? AH : AL) + {7'b0, TmpVal};
   
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {AL, AH, SavedCarry} <= {AL, AH, SavedCarry, ss_in};
+  end else if (ce) begin
     SavedCarry <= Carry;
     if (ALCtrl[2])
       case(ALCtrl[1:0])
@@ -144,6 +147,7 @@ module AddressGenerator(input clk, input ce,
     3: AH <= DataBus;
     endcase
   end
+  assign ss_out = AL[7];
 endmodule
 
 module ProgramCounter(input clk, input ce,
@@ -151,7 +155,8 @@ module ProgramCounter(input clk, input ce,
                       input GotInterrupt,
                       input [7:0] DIN,
                       input [7:0] T,
-                      output reg [15:0] PC, output JumpNoOverflow);
+                      output reg [15:0] PC, output JumpNoOverflow,
+                      input ss_shift, input ss_in, output ss_out);
   reg [15:0] NewPC;
   assign JumpNoOverflow = ((PC[8] ^ NewPC[8]) == 0) & LoadPC[0] & LoadPC[1];
 
@@ -165,8 +170,11 @@ module ProgramCounter(input clk, input ce,
   end
   
   always @(posedge clk)
-    if (ce)
+    if (ss_shift)
+      PC <= {PC, ss_in};
+    else if (ce)
       PC <= NewPC;    
+  assign ss_out = PC[15];
 endmodule
 
 
@@ -176,7 +184,10 @@ module CPU(input clk, input ce, input reset,
            input nmi,
            output reg [7:0] dout, output reg [15:0] aout,
            output reg mr,
-           output reg mw);
+           output reg mw,
+           input ss_shift,    // save state chain, see NES
+           input ss_reload,   // reload microcode outputs after the chain was loaded
+           input ss_in, output ss_out);
   reg [7:0] A = 0, X = 0, Y = 0;
   reg [7:0] SP = 0, T = 0, P = 0;
   reg [7:0] IR = 0;
@@ -218,10 +229,14 @@ module CPU(input clk, input ce, input reset,
 
   wire [15:0] AX;
   wire AXCarry;
-AddressGenerator addgen(clk, ce, AddrCtrl, {IrFlags[0], IrFlags[1]}, DIN, T, X, Y, AX, AXCarry);
+  wire ss_addgen, ss_pc;
+AddressGenerator addgen(clk, ce, AddrCtrl, {IrFlags[0], IrFlags[1]}, DIN, T, X, Y, AX, AXCarry,
+                        ss_shift, ss_in, ss_addgen);
 
 // Microcode table has a 1 clock latency (block ram).
-MicroCodeTable micro2(clk, ce, reset, NextIR, NextState, MicroCode);
+// It is not in the save state chain. Its output is always the entry for the
+// current IR and State, so ss_reload just reads that again.
+MicroCodeTable micro2(clk, ce || ss_reload, reset, ss_reload ? IR : NextIR, ss_reload ? State : NextState, MicroCode);
 
   wire [7:0] AluR;
   wire [7:0] AluIntR;
@@ -229,7 +244,9 @@ MicroCodeTable micro2(clk, ce, reset, NextIR, NextState, MicroCode);
 NewAlu new_alu(IrFlags[15:5], A,X,Y,SP,DIN,T, P[0], P[6], CO, VO, SO, ZO, AluR, AluIntR);
 
 // Registers
-always @(posedge clk) if (reset) begin
+always @(posedge clk) if (ss_shift) begin
+  {A, X, Y} <= {A, X, Y, ss_pc};
+end else if (reset) begin
   A <= 0;
   X <= 0;
   Y <= 0;
@@ -240,7 +257,8 @@ end else if (ce) begin
 end
 
 // Program counter
-ProgramCounter pc(clk, ce, LoadPC, GotInterrupt, DIN, T, PC, JumpNoOverflow);
+ProgramCounter pc(clk, ce, LoadPC, GotInterrupt, DIN, T, PC, JumpNoOverflow,
+                  ss_shift, ss_addgen, ss_pc);
 
 always @(posedge clk) if (!reset && ce && (PC == 'hc071 || PC == 'hc072)) begin
     $write("pc=c071/c072");
@@ -258,7 +276,9 @@ wire turn_nmi_off = (AddrBus == 3) && (State[0] == 0);
 // Controls whether IsNmiInterrupt will get set
 wire nmi_active = turn_nmi_on ? 1 : turn_nmi_off ? 0 : IsNMIInterrupt;
 always @(posedge clk) begin
-  if (reset) begin
+  if (ss_shift) begin
+    {IsNMIInterrupt, LastNMI} <= {IsNMIInterrupt, LastNMI, A[7]};
+  end else if (reset) begin
     IsNMIInterrupt <= 0;
     LastNMI <= 0;
   end else if (ce) begin
@@ -294,7 +314,10 @@ end
 
  
 always @(posedge clk) begin
-  if (reset) begin
+  if (ss_shift) begin
+    {State, IR, GotInterrupt, IsResetInterrupt, P, SP, T, JumpTaken} <=
+      {State, IR, GotInterrupt, IsResetInterrupt, P, SP, T, JumpTaken, IsNMIInterrupt};
+  end else if (reset) begin
     // Reset runs the BRK instruction as usual.
     State <= 0;
     IR <= 0;
@@ -358,4 +381,5 @@ always @(posedge clk) begin
     State <= NextState;
   end
 end
+assign ss_out = State[2];
 endmodule
@@ -0,0 +1,130 @@
+// Live audio for the DisplayPort of PS
+//
+// NES samples are band limited and decimated by 32 with FirFilter (dsp.v) to 55.93 Khz,
+// which pmod_audio gets too (fir_out, fir_now), then resampled to the rate PS plays live audio at (48 Khz) by linear interpolation,
+// and handed to the pixel clock domain through a small async FIFO. From there they
+// go to the AXI4-Stream live audio input of PS, both channels the same.
+//
+// PS plays at its own audio clock, which is not locked to ours. So the resampling
+// ratio is adjusted by how full the FIFO is, to keep it half full: a fuller FIFO
+// makes the output samples further apart, and fewer of them.
+
+module dp_audio(
+    input clk,                  // 21.477 Mhz
+    input [15:0] sample,        // NES audio, unsigned, 0 is silence, changes at any clk
+    output [15:0] fir_out,      // filtered, signed, at 55.93 Khz
+    output fir_now,             // fir_out is valid this clk
+
+    input clk_pixel,            // clock of the audio stream
+    input rst_pixel,            // reset in clk_pixel domain, held while the clock relocks
+    output [31:0] m_axis_audio_tdata,
+    output m_axis_audio_tid,    // channel: 0 left, 1 right
+    output m_axis_audio_tvalid,
+    input m_axis_audio_tready
+    );
+
+    // -- Decimation, 1.79 Mhz to 55.93 Khz. FirFilter takes sample_in every 12 clk.
+    // It is signed, so the sample is scaled down rather than offset by mid-scale,
+    // to keep silence at 0 instead of -32768. A quarter leaves room for the
+    // filter's overshoot, up to 1.17 times a full-scale step.
+    FirFilter fir(clk, {2'b00, sample[15:2]}, fir_out, fir_now);
+
+    // -- Resampling. pos is where the next output sample is, in input samples
+    // after y0, with 16 bits of fraction. step is at least 1.0, so every input
+    // sample gives at most one output.
+    parameter STEP = 76364;             // 55930 / 48000 * 65536
+    parameter GAIN = 64;                // step change per FIFO entry off half full
+    localparam DEPTH = 6;               // log2 of FIFO size
+
+    reg signed [15:0] y0 = 0, y1 = 0;
+    reg [17:0] pos = 18'h10000;
+    reg [DEPTH:0] wptr = 0;             // binary
+    wire [DEPTH:0] wnext = wptr + 1;
+    reg [DEPTH:0] wgray = 0, rgray = 0;
+    reg [DEPTH:0] rgray_s1 = 0, rgray_s2 = 0;
+    reg [DEPTH:0] rptr_w;               // rgray_s2 in binary
+    integer i;
+    always @* begin
+        rptr_w[DEPTH] = rgray_s2[DEPTH];
+        for (i = DEPTH-1; i >= 0; i = i - 1)
+            rptr_w[i] = rptr_w[i+1] ^ rgray_s2[i];
+    end
+    wire [DEPTH:0] fill = wptr - rptr_w;
+    wire [17:0] step = STEP + $signed({1'b0, fill} - (1 << (DEPTH-1))) * GAIN;
+
+    wire signed [16:0] diff = y1 - y0;
+    wire signed [33:0] slope = diff * $signed({1'b0, pos[15:0]});
+    wire [15:0] interp = y0 + (slope >>> 16);
+
+    reg [15:0] fifo[0:(1<<DEPTH)-1];
+    reg emit = 0;
+    always @(posedge clk) begin
+        rgray_s1 <= rgray;
+        rgray_s2 <= rgray_s1;
+        emit <= 0;
+        if (fir_now) begin              // fir_out is only valid now
+            y0 <= y1;
+            y1 <= fir_out;
+            pos <= pos - 18'h10000;
+            emit <= pos < 18'h20000;    // next sample is between the new y0 and y1
+        end
+        if (emit) begin
+            pos <= pos + step;
+            if (fill != (1 << DEPTH)) begin
+                fifo[wptr[DEPTH-1:0]] <= interp;
+                wptr <= wnext;
+                wgray <= wnext ^ (wnext >> 1);
+            end
+        end
+    end
+
+    // -- Stream, clk_pixel domain. Every sample is sent as 2 AES3 subframes:
+    // [3:0] preamble (1: channel 0 and start of a 192-frame block, 2: channel 0,
+    // 3: channel 1), [27:4] sample, [28] valid (0 is valid), [29] user data,
+    // [30] channel status, [31] parity.
+    // Reset empties the FIFO by moving the read pointer up to the write
+    // pointer, so the clk side, which is not reset, stays consistent.
+    reg [DEPTH:0] rptr = 0;
+    wire [DEPTH:0] rnext = rptr + 1;
+    reg [DEPTH:0] wgray_s1 = 0, wgray_s2 = 0;
+    reg [DEPTH:0] wptr_r;               // wgray_s2 in binary
+    integer j;
+    always @* begin
+        wptr_r[DEPTH] = wgray_s2[DEPTH];
+        for (j = DEPTH-1; j >= 0; j = j - 1)
+            wptr_r[j] = wptr_r[j+1] ^ wgray_s2[j];
+    end
+    reg [15:0] out = 0;
+    reg full = 0;                       // out holds a sample
+    reg chan = 0;
+    reg [7:0] frame = 0;                // 0-191
+    always @(posedge clk_pixel) begin
+        wgray_s1 <= wgray;
+        wgray_s2 <= wgray_s1;
+        if (rst_pixel) begin
+            rptr <= wptr_r;
+            rgray <= wgray_s2;
+            full <= 0;
+            chan <= 0;
+            frame <= 0;
+        end else if (m_axis_audio_tvalid && m_axis_audio_tready) begin
+            chan <= !chan;
+            if (chan) begin
+                full <= 0;
+                frame <= frame == 191 ? 0 : frame + 1;
+            end
+        end else if (!full && rgray != wgray_s2) begin
+            out <= fifo[rptr[DEPTH-1:0]];
+            full <= 1;
+            rptr <= rnext;
+            rgray <= rnext ^ (rnext >> 1);
+        end
+    end
+
+    wire [3:0] preamble = chan ? 4'd3 : frame == 0 ? 4'd1 : 4'd2;
+    wire [26:0] subframe = {3'b000, out, 8'b0};     // C, U, V, sample
+    assign m_axis_audio_tdata = {^subframe, subframe, preamble};
+    assign m_axis_audio_tid = chan;
+    assign m_axis_audio_tvalid = full;
+
+endmodule
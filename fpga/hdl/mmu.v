@@ -31,7 +31,10 @@ module MMC1(input clk, input ce, input reset,
             input [13:0] chr_ain, output [21:0] chr_aout,
             output chr_allow,                      // Allow write
             output vram_a10,                             // Value for A10 address line
-            output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+            output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+            input ss_shift, input ss_in, output ss_out,
+            input [15:0] prg_probe, output [21:0] prg_probe_aout,   // the same mapping for other addresses,
+            input [13:0] chr_probe, output [21:0] chr_probe_aout);  // for RomCache prefetch
   reg [4:0] shift;
   
 // CPPMM
@@ -61,7 +64,9 @@ module MMC1(input clk, input ce, input reset,
   reg [4:0] prg_bank;
   
   // Update shift register
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {shift, control, chr_bank_0, chr_bank_1, prg_bank} <= {shift, control, chr_bank_0, chr_bank_1, prg_bank, ss_in};
+  end else if (reset) begin
     shift <= 1;
     control <= 'hC;
   end else if (ce) begin
@@ -88,28 +93,28 @@ module MMC1(input clk, input ce, input reset,
   end
   
   // The PRG bank to load. Each increment here is 16kb. So valid values are 0..15.
-  reg [3:0] prgsel;
-  always @* begin
-    casez({control[3:2], prg_ain[14]})
-    3'b0?_?: prgsel = {prg_bank[3:1], prg_ain[14]};
+  function [3:0] prgsel(input a14);
+    casez({control[3:2], a14})
+    3'b0?_?: prgsel = {prg_bank[3:1], a14};
     3'b10_0: prgsel = 4'b0000;
     3'b10_1: prgsel = prg_bank[3:0];
     3'b11_0: prgsel = prg_bank[3:0];
     3'b11_1: prgsel = 4'b1111;
     endcase
-  end
-  wire [21:0] prg_aout_tmp = {4'b00_00,  prgsel, prg_ain[13:0]};
+  endfunction
+  wire [21:0] prg_aout_tmp = {4'b00_00,  prgsel(prg_ain[14]), prg_ain[13:0]};
+  assign prg_probe_aout = {4'b00_00,  prgsel(prg_probe[14]), prg_probe[13:0]};
 
   // The CHR bank to load. Each increment here is 4 kb. So valid values are 0..31.
-  reg [4:0] chrsel;
-  always @* begin
-    casez({control[4], chr_ain[12]})
-    2'b0_?: chrsel = {chr_bank_0[4:1], chr_ain[12]};
+  function [4:0] chrsel(input a12);
+    casez({control[4], a12})
+    2'b0_?: chrsel = {chr_bank_0[4:1], a12};
     2'b1_0: chrsel = chr_bank_0;
     2'b1_1: chrsel = chr_bank_1;
     endcase
-  end
-  assign chr_aout = {5'b100_00, chrsel, chr_ain[11:0]};
+  endfunction
+  assign chr_aout = {5'b100_00, chrsel(chr_ain[12]), chr_ain[11:0]};
+  assign chr_probe_aout = {5'b100_00, chrsel(chr_probe[12]), chr_probe[11:0]};
   
   // The a10 VRAM address line. (Used for mirroring)
   reg vram_a10_t;
@@ -130,6 +135,7 @@ module MMC1(input clk, input ce, input reset,
   
   assign prg_aout = prg_is_ram ? prg_ram : prg_aout_tmp;
   assign chr_allow = flags[15];
+  assign ss_out = shift[4];
 endmodule
 
 // MMC2 mapper chip. PRG ROM: 128kB. Bank Size: 8kB. CHR ROM: 128kB
@@ -142,7 +148,8 @@ module MMC2(input clk, input ce, input reset,
             input chr_read, input [13:0] chr_ain, output [21:0] chr_aout,
             output chr_allow,                      // Allow write
             output vram_a10,                             // Value for A10 address line
-            output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+            output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+            input ss_shift, input ss_in, output ss_out);
 
 // PRG ROM bank select ($A000-$AFFF)
 // 7  bit  0
@@ -199,7 +206,10 @@ module MMC2(input clk, input ce, input reset,
   reg latch_0, latch_1;
   
   // Update registers
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, chr_bank_0a, chr_bank_0b, chr_bank_1a, chr_bank_1b, mirroring} <=
+      {prg_bank, chr_bank_0a, chr_bank_0b, chr_bank_1a, chr_bank_1b, mirroring, ss_in};
+  end else if (ce) begin
     if (prg_write && prg_ain[15]) begin
       case(prg_ain[14:12])
       2: prg_bank <= prg_din[3:0];     // $A000
@@ -213,7 +223,9 @@ module MMC2(input clk, input ce, input reset,
   end
   
   // Update latches when 0x3D8 or 0x3E8 is accessed.
-  always @(posedge clk) if (ce && chr_read) begin
+  always @(posedge clk) if (ss_shift) begin
+    {latch_0, latch_1} <= {latch_0, latch_1, prg_bank[3]};
+  end else if (ce && chr_read) begin
     latch_0 <= (chr_ain & 14'h3ff8) == 14'h0fd8 ? 0 : (chr_ain & 14'h3ff8) == 14'h0fe8 ? 1 : latch_0;
     latch_1 <= (chr_ain & 14'h3ff8) == 14'h1fd8 ? 0 : (chr_ain & 14'h3ff8) == 14'h1fe8 ? 1 : latch_1;
   end
@@ -246,6 +258,7 @@ module MMC2(input clk, input ce, input reset,
   
   assign prg_allow = prg_ain[15] && !prg_write;
   assign chr_allow = flags[15];
+  assign ss_out = latch_0;
 endmodule
 
 
@@ -260,7 +273,10 @@ module MMC3(input clk, input ce, input reset,
             output chr_allow,                            // Allow write
             output vram_a10,                             // Value for A10 address line
             output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
-            output reg irq);
+            output reg irq,
+            input ss_shift, input ss_in, output ss_out,
+            input [15:0] prg_probe, output [21:0] prg_probe_aout,   // the same mapping for other addresses,
+            input [13:0] chr_probe, output [21:0] chr_probe_aout);  // for RomCache prefetch
   reg [2:0] bank_select;             // Register to write to next
   reg prg_rom_bank_mode;             // Mode for PRG banking
   reg chr_a12_invert;                // Mode for CHR banking
@@ -287,7 +303,14 @@ module MMC3(input clk, input ce, input reset,
   wire [7:0] new_counter = (counter == 0 || irq_reload) ? irq_latch : counter - 1;
   reg [3:0] a12_ctr; 
    
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {irq, bank_select, prg_rom_bank_mode, chr_a12_invert, mirroring, irq_enable, irq_reload,
+     irq_latch, counter, ram_enable, ram_protect, chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3,
+     chr_bank_4, chr_bank_5, prg_bank_0, prg_bank_1, mapper47_multicart, a12_ctr} <=
+      {irq, bank_select, prg_rom_bank_mode, chr_a12_invert, mirroring, irq_enable, irq_reload,
+       irq_latch, counter, ram_enable, ram_protect, chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3,
+       chr_bank_4, chr_bank_5, prg_bank_0, prg_bank_1, mapper47_multicart, a12_ctr, ss_in};
+  end else if (reset) begin
     irq <= 0;
     bank_select <= 0;
     prg_rom_bank_mode <= 0;
@@ -350,48 +373,63 @@ module MMC3(input clk, input ce, input reset,
   end
 
   // The PRG bank to load. Each increment here is 8kb. So valid values are 0..63.
-  reg [5:0] prgsel;
-  always @* begin
-    casez({prg_ain[14:13], prg_rom_bank_mode})
-    3'b00_0: prgsel = prg_bank_0;  // $8000 mode 0
-    3'b00_1: prgsel = 6'b111110;   // $8000 fixed to second last bank
-    3'b01_?: prgsel = prg_bank_1;  // $A000 mode 0,1
-    3'b10_0: prgsel = 6'b111110;   // $C000 fixed to second last bank
-    3'b10_1: prgsel = prg_bank_0;  // $C000 mode 1
-    3'b11_?: prgsel = 6'b111111;   // $E000 fixed to last bank
-    endcase
-    // mapper47 is limited to 128k PRG, the top bits are controlled by mapper47_multicart instead.
-    if (mapper47) prgsel[5:4] = {1'b0, mapper47_multicart};
-  end
+  function [5:0] prgsel(input [1:0] a14_13);
+    begin
+      casez({a14_13, prg_rom_bank_mode})
+      3'b00_0: prgsel = prg_bank_0;  // $8000 mode 0
+      3'b00_1: prgsel = 6'b111110;   // $8000 fixed to second last bank
+      3'b01_?: prgsel = prg_bank_1;  // $A000 mode 0,1
+      3'b10_0: prgsel = 6'b111110;   // $C000 fixed to second last bank
+      3'b10_1: prgsel = prg_bank_0;  // $C000 mode 1
+      3'b11_?: prgsel = 6'b111111;   // $E000 fixed to last bank
+      endcase
+      // mapper47 is limited to 128k PRG, the top bits are controlled by mapper47_multicart instead.
+      if (mapper47) prgsel[5:4] = {1'b0, mapper47_multicart};
+    end
+  endfunction
 
   // The CHR bank to load. Each increment here is 1kb. So valid values are 0..255.
-  reg [7:0] chrsel;
-  always @* begin
-    casez({chr_ain[12] ^ chr_a12_invert, chr_ain[11], chr_ain[10]})
-    3'b00?: chrsel = {chr_bank_0, chr_ain[10]};
-    3'b01?: chrsel = {chr_bank_1, chr_ain[10]};
-    3'b100: chrsel = chr_bank_2;
-    3'b101: chrsel = chr_bank_3;
-    3'b110: chrsel = chr_bank_4;
-    3'b111: chrsel = chr_bank_5;
-    endcase
-    // mapper47 is limited to 128k CHR, the top bit is controlled by mapper47_multicart instead.
-    if (mapper47) chrsel[7] = mapper47_multicart;
-  end
+  function [7:0] chrsel(input [2:0] a12_10);
+    begin
+      casez({a12_10[2] ^ chr_a12_invert, a12_10[1:0]})
+      3'b00?: chrsel = {chr_bank_0, a12_10[0]};
+      3'b01?: chrsel = {chr_bank_1, a12_10[0]};
+      3'b100: chrsel = chr_bank_2;
+      3'b101: chrsel = chr_bank_3;
+      3'b110: chrsel = chr_bank_4;
+      3'b111: chrsel = chr_bank_5;
+      endcase
+      // mapper47 is limited to 128k CHR, the top bit is controlled by mapper47_multicart instead.
+      if (mapper47) chrsel[7] = mapper47_multicart;
+    end
+  endfunction
+
+  // {chr_allow, chr_aout} of a CHR address
+  function [22:0] chrmap(input [13:0] a);
+    reg [7:0] sel;
+    begin
+      sel = chrsel(a[12:10]);
+      chrmap = (TQROM && sel[6]) ? {1'b1,      9'b11_1111_111, sel[2:0], a[9:0]} :    // TQROM 8kb CHR-RAM
+                                   {flags[15], 4'b10_00, sel, a[9:0]};                // Standard MMC3
+    end
+  endfunction
+  wire [7:0] chrsel_ain = chrsel(chr_ain[12:10]);     // for TxSROM mirroring
 
-  wire [21:0] prg_aout_tmp = {3'b00_0,  prgsel, prg_ain[12:0]};
+  wire [21:0] prg_aout_tmp = {3'b00_0,  prgsel(prg_ain[14:13]), prg_ain[12:0]};
+  assign prg_probe_aout = {3'b00_0,  prgsel(prg_probe[14:13]), prg_probe[12:0]};
 
-  assign {chr_allow, chr_aout} = 
-      (TQROM && chrsel[6]) ? {1'b1,      9'b11_1111_111, chrsel[2:0], chr_ain[9:0]} :   // TQROM 8kb CHR-RAM
-                             {flags[15], 4'b10_00, chrsel, chr_ain[9:0]};               // Standard MMC3
+  assign {chr_allow, chr_aout} = chrmap(chr_ain);
+  wire chr_probe_allow;
+  assign {chr_probe_allow, chr_probe_aout} = chrmap(chr_probe);
 
   assign prg_is_ram = prg_ain >= 'h6000 && prg_ain < 'h8000 && ram_enable && !(ram_protect && prg_write);
   assign prg_allow = prg_ain[15] && !prg_write || prg_is_ram && !mapper47;
   wire [21:0] prg_ram = {9'b11_1100_000, prg_ain[12:0]};
   assign prg_aout = prg_is_ram  && !mapper47 ? prg_ram : prg_aout_tmp;
   assign vram_a10 = (TxSROM == 0) ? (mirroring ? chr_ain[11] : chr_ain[10]) :
-                                    chrsel[7];
+                                    chrsel_ain[7];
   assign vram_ce = chr_ain[13];
+  assign ss_out = irq;
 endmodule
 
 module MMC5(input clk, input ce, input reset,
@@ -406,7 +444,11 @@ module MMC5(input clk, input ce, input reset,
             output chr_allow,                            // Allow write
             output vram_a10,                             // Value for A10 address line
             output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
-            output irq);
+            output irq,
+            input ss_shift, input ss_in, output ss_out,
+            input [9:0] ss_mem_addr,                     // Expansion RAM access for save states
+            input ss_mem_read, input ss_mem_write,
+            input [7:0] ss_mem_din, output [7:0] ss_mem_dout);
   reg [1:0] prg_mode, chr_mode;
   reg prg_protect_1, prg_protect_2;
   reg [1:0] extended_ram_mode;
@@ -444,7 +486,22 @@ module MMC5(input clk, input ce, input reset,
   wire [8:0] ppu_scanline = ppuflags[19:11];
   
   // Handle IO register writes  
-  always @(posedge clk) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_mode, chr_mode, prg_protect_1, prg_protect_2, extended_ram_mode, mirroring, fill_tile, fill_attr,
+     prg_ram_bank, prg_bank_0, prg_bank_1, prg_bank_2, prg_bank_3,
+     chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, chr_bank_4, chr_bank_5,
+     chr_bank_6, chr_bank_7, chr_bank_8, chr_bank_9, chr_bank_a, chr_bank_b,
+     upper_chr_bank_bits, chr_last, vsplit_startstop, vsplit_enable, vsplit_side, vsplit_scroll, vsplit_bank,
+     irq_scanline, irq_enable, multiplier_1, multiplier_2} <=
+      {prg_mode, chr_mode, prg_protect_1, prg_protect_2, extended_ram_mode, mirroring, fill_tile, fill_attr,
+       prg_ram_bank, prg_bank_0, prg_bank_1, prg_bank_2, prg_bank_3,
+       chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, chr_bank_4, chr_bank_5,
+       chr_bank_6, chr_bank_7, chr_bank_8, chr_bank_9, chr_bank_a, chr_bank_b,
+       upper_chr_bank_bits, chr_last, vsplit_startstop, vsplit_enable, vsplit_side, vsplit_scroll, vsplit_bank,
+       irq_scanline, irq_enable, multiplier_1, multiplier_2, ss_in};
+  end else if (ss_mem_write) begin
+    expansion_ram[ss_mem_addr] <= ss_mem_din;
+  end else begin
     if (ce) begin
       if (prg_write && prg_ain[15:10] == 6'b010100) begin // $5000-$53FF
         if (prg_ain <= 16'h5113)
@@ -476,7 +533,7 @@ module MMC5(input clk, input ce, input reset,
         10'h12a: chr_bank_a  <= {upper_chr_bank_bits, prg_din};
         10'h12b: chr_bank_b  <= {upper_chr_bank_bits, prg_din};
         10'h130: upper_chr_bank_bits <= prg_din[1:0];
-        10'h200: {vsplit_enable, vsplit_side, vsplit_startstop} = {prg_din[7:6], prg_din[4:0]};
+        10'h200: {vsplit_enable, vsplit_side, vsplit_startstop} <= {prg_din[7:6], prg_din[4:0]};
         10'h201: vsplit_scroll <= prg_din;
         10'h202: vsplit_bank <= prg_din;
         10'h203: irq_scanline <= prg_din;
@@ -521,7 +578,9 @@ module MMC5(input clk, input ce, input reset,
   
   // Determine IRQ handling
   reg last_scanline, irq_trig;
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {irq_pending, irq_trig, last_scanline} <= {irq_pending, irq_trig, last_scanline, prg_mode[1]};
+  end else if (ce) begin
     if (prg_read && prg_ain == 16'h5204)
       irq_pending <= 0;
     irq_trig <= (irq_scanline != 0 && irq_scanline < 240 && ppu_scanline == {1'b0, irq_scanline});
@@ -550,13 +609,17 @@ module MMC5(input clk, input ce, input reset,
         in_split_area = 0;
     end
   end
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {last_in_split_area, cur_tile} <= {last_in_split_area, cur_tile, irq_pending};
+  end else if (ce) begin
     last_in_split_area <= in_split_area;
     if (ppu_cycle[2:0] == 0 && ppu_cycle < 336)
       cur_tile <= new_cur_tile;
   end
   // Keep track of scroll
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    vscroll <= {vscroll, last_in_split_area};
+  end else if (ce) begin
     if (ppu_cycle == 319)
       vscroll <= ppu_scanline[8] ? vsplit_scroll : 
                  (vscroll == 239) ? 8'b0 : vscroll + 8'b1;
@@ -614,11 +677,14 @@ module MMC5(input clk, input ce, input reset,
   // 1 - Use as extended attribute data OR an extra nametable
   // 2 - Use as ordinary RAM
   // 3 - Use as ordinary RAM, write protected
-  wire [9:0] exram_read_addr = extended_ram_mode[1] ? prg_ain[9:0] : 
+  wire [9:0] exram_read_addr = ss_mem_read          ? ss_mem_addr :
+                               extended_ram_mode[1] ? prg_ain[9:0] : 
                                insplit              ? split_addr :
                                                       chr_ain[9:0];
   always @(posedge clk)
     last_read_ram <= expansion_ram[exram_read_addr];
+  assign ss_mem_dout = last_read_ram;
+  assign ss_out = vscroll[7];
 
   // Compute PRG address to read from.
   reg [7:0] prgsel;
@@ -721,7 +787,8 @@ module Rambo1(input clk, input ce, input reset,
               output chr_allow,                            // Allow write
               output vram_a10,                             // Value for A10 address line
               output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
-              output reg irq);
+              output reg irq,
+              input ss_shift, input ss_in, output ss_out);
   reg [3:0] bank_select;             // Register to write to next
   reg prg_rom_bank_mode;             // Mode for PRG banking
   reg chr_K;                         // Mode for CHR banking
@@ -746,12 +813,23 @@ module Rambo1(input clk, input ce, input reset,
   reg old_a12_edge;
   reg [1:0] a12_ctr;
   wire a12_edge = (chr_ain[12] && a12_ctr == 0) || old_a12_edge;
-  always @(posedge clk) begin
+  always @(posedge clk) if (ss_shift) begin
+    {old_a12_edge, a12_ctr} <= {old_a12_edge, a12_ctr, ss_in};
+  end else begin
     old_a12_edge <= a12_edge && !ce;
     a12_ctr <= chr_ain[12] ? 2'b11 : (a12_ctr != 0 && ce) ? a12_ctr - 2'b01 : a12_ctr;
   end
   
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {bank_select, prg_rom_bank_mode, chr_K, chr_a12_invert, mirroring, irq_enable, irq_reload,
+     irq_latch, counter, want_irq, chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, chr_bank_4,
+     chr_bank_5, chr_bank_8, chr_bank_9, prg_bank_0, prg_bank_1, prg_bank_2, irq_cycle_mode,
+     cycle_counter, irq} <=
+      {bank_select, prg_rom_bank_mode, chr_K, chr_a12_invert, mirroring, irq_enable, irq_reload,
+       irq_latch, counter, want_irq, chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, chr_bank_4,
+       chr_bank_5, chr_bank_8, chr_bank_9, prg_bank_0, prg_bank_1, prg_bank_2, irq_cycle_mode,
+       cycle_counter, irq, old_a12_edge};
+  end else if (reset) begin
     bank_select <= 0;
     prg_rom_bank_mode <= 0;
     chr_K <= 0;
@@ -851,6 +929,7 @@ module Rambo1(input clk, input ce, input reset,
   assign vram_a10 = mapper64 ? chrsel[7] :  // Mapper 64 controls mirroring by switching the top bits of the CHR address
                     mirroring ? chr_ain[11] : chr_ain[10];
   assign vram_ce = chr_ain[13];
+  assign ss_out = bank_select[3];
 endmodule
 
 
@@ -864,9 +943,12 @@ module Mapper13(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [1:0] chr_bank;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    chr_bank <= {chr_bank, ss_in};
+  end else if (reset) begin
     chr_bank <= 0;
   end else if (ce) begin
     if (prg_ain[15] && prg_write)
@@ -878,6 +960,7 @@ module Mapper13(input clk, input ce, input reset,
   assign chr_aout = {8'b01_0000_00, chr_ain[12] ? chr_bank : 2'b00, chr_ain[11:0]};
   assign vram_ce = chr_ain[13];
   assign vram_a10 = flags[14] ? chr_ain[10] : chr_ain[11];
+  assign ss_out = chr_bank[1];
 endmodule
 
 // #15 -  100-in-1 Contra Function 16
@@ -890,7 +973,8 @@ module Mapper15(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
 // 15 bit  8 7  bit  0  Address bus
 // ---- ---- ---- ----
 // 1xxx xxxx xxxx xxSS
@@ -910,7 +994,10 @@ module Mapper15(input clk, input ce, input reset,
   reg prg_rom_bank_lowbit;
   reg mirroring;
   reg [5:0] prg_rom_bank;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_rom_bank_mode, prg_rom_bank_lowbit, mirroring, prg_rom_bank} <=
+      {prg_rom_bank_mode, prg_rom_bank_lowbit, mirroring, prg_rom_bank, ss_in};
+  end else if (reset) begin
     prg_rom_bank_mode <= 0;
     prg_rom_bank_lowbit <= 0;
     mirroring <= 0;
@@ -940,6 +1027,7 @@ module Mapper15(input clk, input ce, input reset,
   assign chr_aout = {9'b10_0000_000, chr_ain[12:0]};
   assign vram_ce = chr_ain[13];
   assign vram_a10 = mirroring ? chr_ain[11] : chr_ain[10];
+  assign ss_out = prg_rom_bank_mode[1];
 endmodule
 
 // Tepples/Multi-discrete mapper
@@ -953,8 +1041,10 @@ module Mapper28(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output reg vram_a10,                         // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
-    reg [6:0] a53prg;    // output PRG ROM (A14-A20 on ROM)
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out,
+                input [15:0] prg_probe, output [21:0] prg_probe_aout,   // the same mapping for other addresses,
+                input [13:0] chr_probe, output [21:0] chr_probe_aout);  // for RomCache prefetch
     reg [1:0] a53chr;    // output CHR RAM (A13-A14 on RAM)
    
     reg [3:0] inner;    // "inner" bank at 01h
@@ -966,7 +1056,9 @@ module Mapper28(input clk, input ce, input reset,
     wire [7:0] mapper = flags[7:0];
     wire allow_select = (mapper == 8'd28);
         
-    always @(posedge clk) if (reset) begin
+    always @(posedge clk) if (ss_shift) begin
+      {mode, outer, inner, selreg, a53chr} <= {mode, outer, inner, selreg, a53chr, ss_in};
+    end else if (reset) begin
       mode[5:2] <= 0;         // NROM mode, 32K mode
       outer[5:0] <= 6'h3f;    // last bank
       inner <= 0;
@@ -1008,13 +1100,16 @@ module Mapper28(input clk, input ce, input reset,
       2'b10   :   vram_a10 = {chr_ain[10]};    // vertical
       2'b11   :   vram_a10 = {chr_ain[11]};    // horizontal
       endcase
+    end
 
+    // output PRG ROM (A14-A20 on ROM)
+    function [6:0] a53prg(input a14);
       // PRG ROM bank size select
-      casez({mode[5:2], prg_ain[14]})
-      5'b00_0?_?  :  a53prg = {outer[5:0],             prg_ain[14]};  // 32K banks, (B)NROM mode
-      5'b01_0?_?  :  a53prg = {outer[5:1], inner[0],   prg_ain[14]};  // 64K banks, (B)NROM mode
-      5'b10_0?_?  :  a53prg = {outer[5:2], inner[1:0], prg_ain[14]};  // 128K banks, (B)NROM mode
-      5'b11_0?_?  :  a53prg = {outer[5:3], inner[2:0], prg_ain[14]};  // 256K banks, (B)NROM mode
+      casez({mode[5:2], a14})
+      5'b00_0?_?  :  a53prg = {outer[5:0],             a14};  // 32K banks, (B)NROM mode
+      5'b01_0?_?  :  a53prg = {outer[5:1], inner[0],   a14};  // 64K banks, (B)NROM mode
+      5'b10_0?_?  :  a53prg = {outer[5:2], inner[1:0], a14};  // 128K banks, (B)NROM mode
+      5'b11_0?_?  :  a53prg = {outer[5:3], inner[2:0], a14};  // 256K banks, (B)NROM mode
       
       5'b00_10_1,
       5'b00_11_0  :  a53prg = {outer[5:0], inner[0]};             // 32K banks, UNROM mode
@@ -1025,15 +1120,18 @@ module Mapper28(input clk, input ce, input reset,
       5'b11_10_1,
       5'b11_11_0  :  a53prg = {outer[5:3], inner[3:0]};           // 256K banks, UNROM mode
       
-      default     :  a53prg = {outer[5:0],             prg_ain[14]};  // 16K fixed bank
+      default     :  a53prg = {outer[5:0],             a14};  // 16K fixed bank
       endcase
-    end
+    endfunction
 
   assign vram_ce = chr_ain[13];
-  assign prg_aout = {1'b0, (a53prg & 7'b0011111), prg_ain[13:0]};
+  assign prg_aout = {1'b0, (a53prg(prg_ain[14]) & 7'b0011111), prg_ain[13:0]};
+  assign prg_probe_aout = {1'b0, (a53prg(prg_probe[14]) & 7'b0011111), prg_probe[13:0]};
   assign prg_allow = prg_ain[15] && !prg_write;
   assign chr_allow = flags[15];
   assign chr_aout = {7'b10_0000_0, a53chr, chr_ain[12:0]};
+  assign chr_probe_aout = {7'b10_0000_0, a53chr, chr_probe[12:0]};
+    assign ss_out = mode[5];
 endmodule
 
 // 11 - Color Dreams
@@ -1047,11 +1145,14 @@ module Mapper66(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [1:0] prg_bank;
   reg [3:0] chr_bank;
   wire GXROM = (flags[7:0] == 66);
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, chr_bank} <= {prg_bank, chr_bank, ss_in};
+  end else if (reset) begin
     prg_bank <= 0;
     chr_bank <= 0;
   end else if (ce) begin
@@ -1068,6 +1169,7 @@ module Mapper66(input clk, input ce, input reset,
   assign chr_aout = {5'b10_000, chr_bank, chr_ain[12:0]};
   assign vram_ce = chr_ain[13];
   assign vram_a10 = flags[14] ? chr_ain[10] : chr_ain[11];
+  assign ss_out = prg_bank[1];
 endmodule
 
 // 34 - BxROM or NINA-001
@@ -1080,12 +1182,15 @@ module Mapper34(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [1:0] prg_bank;
   reg [3:0] chr_bank_0, chr_bank_1;
   
   wire NINA = (flags[13:11] != 0); // NINA is used when there is more than 8kb of CHR
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, chr_bank_0, chr_bank_1} <= {prg_bank, chr_bank_0, chr_bank_1, ss_in};
+  end else if (reset) begin
     prg_bank <= 0;
     chr_bank_0 <= 0;
     chr_bank_1 <= 1; // To be compatible with BxROM
@@ -1114,6 +1219,7 @@ module Mapper34(input clk, input ce, input reset,
                      prg_is_ram;
   wire [21:0] prg_ram = {9'b11_1100_000, prg_ain[12:0]};
   assign prg_aout = prg_is_ram ? prg_ram : prg_aout_tmp;
+  assign ss_out = prg_bank[1];
 endmodule
 
 // 41 - Caltron 6-in-1
@@ -1126,12 +1232,16 @@ module Mapper41(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [2:0] prg_bank;
   reg [1:0] chr_outer_bank, chr_inner_bank;
   reg mirroring;
   
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, chr_outer_bank, chr_inner_bank, mirroring} <=
+      {prg_bank, chr_outer_bank, chr_inner_bank, mirroring, ss_in};
+  end else if (reset) begin
     prg_bank <= 0;
     chr_outer_bank <= 0;
     chr_inner_bank <= 0;
@@ -1151,6 +1261,7 @@ module Mapper41(input clk, input ce, input reset,
   assign vram_ce = chr_ain[13];
   assign vram_a10 = mirroring ? chr_ain[11] : chr_ain[10];
   assign prg_allow = prg_ain[15] && !prg_write;
+  assign ss_out = prg_bank[2];
 endmodule
 
 // #68 - Sunsoft-4 - Game After Burner, and some japanese games. MAX: 128kB PRG, 256kB CHR
@@ -1163,13 +1274,19 @@ module Mapper68(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [6:0] chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3;
   reg [6:0] nametable_0, nametable_1;
   reg [2:0] prg_bank;
   reg use_chr_rom;
   reg mirroring;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, nametable_0, nametable_1, prg_bank, use_chr_rom,
+     mirroring} <=
+      {chr_bank_0, chr_bank_1, chr_bank_2, chr_bank_3, nametable_0, nametable_1, prg_bank,
+       use_chr_rom, mirroring, ss_in};
+  end else if (reset) begin
     chr_bank_0 <= 0;
     chr_bank_1 <= 0;
     chr_bank_2 <= 0;
@@ -1214,6 +1331,7 @@ module Mapper68(input clk, input ce, input reset,
   assign chr_aout = (chr_ain[13] == 0) ? {4'b10_00, chrout, chr_ain[10:0]} : {5'b10_001, nameout, chr_ain[9:0]};
   assign vram_ce = chr_ain[13] && !use_chr_rom;
 
+  assign ss_out = chr_bank_0[6];
 endmodule
 
 
@@ -1229,7 +1347,8 @@ module Mapper69(input clk, input ce, input reset,
                 output chr_allow,                             // Allow write
                 output reg vram_a10,                          // Value for A10 address line
                 output vram_ce,                               // True if the address should be routed to the internal 2kB VRAM.
-                output reg irq);
+                output reg irq,
+                input ss_shift, input ss_in, output ss_out);
   reg [7:0] chr_bank[0:7];
   reg [4:0] prg_bank[0:3];
   reg [1:0] mirroring;
@@ -1238,7 +1357,14 @@ module Mapper69(input clk, input ce, input reset,
   reg [3:0] addr;
   reg ram_enable, ram_select;
   wire [16:0] new_irq_counter = irq_counter - {15'b0, irq_countdown};
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {chr_bank[0], chr_bank[1], chr_bank[2], chr_bank[3], chr_bank[4], chr_bank[5], chr_bank[6],
+     chr_bank[7], prg_bank[0], prg_bank[1], prg_bank[2], prg_bank[3], mirroring, irq_countdown,
+     irq_trigger, irq_counter, addr, ram_enable, ram_select, irq} <=
+      {chr_bank[0], chr_bank[1], chr_bank[2], chr_bank[3], chr_bank[4], chr_bank[5], chr_bank[6],
+       chr_bank[7], prg_bank[0], prg_bank[1], prg_bank[2], prg_bank[3], mirroring, irq_countdown,
+       irq_trigger, irq_counter, addr, ram_enable, ram_select, irq, ss_in};
+  end else if (reset) begin
     chr_bank[0] <= 0;
     chr_bank[1] <= 0;
     chr_bank[2] <= 0;
@@ -1308,6 +1434,8 @@ module Mapper69(input clk, input ce, input reset,
   assign chr_allow = flags[15];
   assign chr_aout = {4'b10_00, chrout, chr_ain[9:0]};
   assign vram_ce = chr_ain[13];
+  wire [7:0] chr_bank0 = chr_bank[0];
+  assign ss_out = chr_bank0[7];
 endmodule
 
 // #71,#232 - Camerica
@@ -1320,11 +1448,14 @@ module Mapper71(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [3:0] prg_bank;
   reg ciram_select;
   wire mapper232 = (flags[7:0] == 232);
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, ciram_select} <= {prg_bank, ciram_select, ss_in};
+  end else if (reset) begin
     prg_bank <= 0;
     ciram_select <= 0;
   end else if (ce) begin
@@ -1354,6 +1485,7 @@ module Mapper71(input clk, input ce, input reset,
   // XXX(ludde): Fire hawk uses flags[14] == 0 while no other game seems to do that.
   // So when flags[14] == 0 we use ciram_select instead.
   assign vram_a10 = flags[14] ? chr_ain[10] : ciram_select;
+  assign ss_out = prg_bank[3];
 endmodule
 
 // #79,#113 - NINA-03 / NINA-06
@@ -1366,12 +1498,15 @@ module Mapper79(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                      // Allow write
                 output vram_a10,                             // Value for A10 address line
-                output vram_ce);                             // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                              // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [2:0] prg_bank;
   reg [3:0] chr_bank;
   reg mirroring;  // 0: Horizontal, 1: Vertical
   wire mapper113 = (flags[7:0] == 113); // NINA-06
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {prg_bank, chr_bank, mirroring} <= {prg_bank, chr_bank, mirroring, ss_in};
+  end else if (reset) begin
     prg_bank <= 0;
     chr_bank <= 0;
     mirroring <= 0;
@@ -1386,6 +1521,7 @@ module Mapper79(input clk, input ce, input reset,
   assign vram_ce = chr_ain[13];
   wire mirrconfig = mapper113 ? mirroring : flags[14]; // Mapper #13 has mapper controlled mirroring
   assign vram_a10 = mirrconfig ? chr_ain[10] : chr_ain[11]; // 0: horiz, 1: vert
+  assign ss_out = prg_bank[2];
 endmodule
 
 // #105 - NES-EVENT. Retrofits an MMC3 with lots of extra logic.
@@ -1394,7 +1530,8 @@ module NesEvent(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 input [3:0] mmc1_chr,                   // Upper 4 CHR output control bits from MMC chip
                 input [21:0] mmc1_aout,                 // PRG output address from MMC chip
-                output irq);
+                output irq,
+                input ss_shift, input ss_in, output ss_out);
   // $A000-BFFF:   [...I OAA.]
   //      I = IRQ control / initialization toggle
   //      O = PRG Mode/Chip select
@@ -1407,7 +1544,9 @@ module NesEvent(input clk, input ce, input reset,
   reg [29:0] counter;
   
   reg [3:0] oldbits;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {unlocked, old_val, counter, oldbits} <= {unlocked, old_val, counter, oldbits, ss_in};
+  end else if (reset) begin
     old_val <= 0;
     unlocked <= 0;
     counter <= 0;
@@ -1443,6 +1582,7 @@ module NesEvent(input clk, input ce, input reset,
   end
   // 8kB CHR RAM.
   assign chr_aout = {9'b10_0000_000, chr_ain[12:0]};
+  assign ss_out = unlocked;
 endmodule
 
 
@@ -1456,13 +1596,17 @@ module Mapper228(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                             // Allow write
                 output vram_a10,                              // Value for A10 address line
-                output vram_ce);                              // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                               // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg mirroring;
   reg [1:0] prg_chip;
   reg [4:0] prg_bank;
   reg prg_bank_mode;
   reg [5:0] chr_bank;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {mirroring, prg_chip, prg_bank, prg_bank_mode, chr_bank} <=
+      {mirroring, prg_chip, prg_bank, prg_bank_mode, chr_bank, ss_in};
+  end else if (reset) begin
     {mirroring, prg_chip, prg_bank, prg_bank_mode} <= 0;
     chr_bank <= 0;
   end else if (ce) begin
@@ -1479,6 +1623,7 @@ module Mapper228(input clk, input ce, input reset,
   assign chr_allow = flags[15];
   assign chr_aout = {3'b10_0, chr_bank, chr_ain[12:0]};
   assign vram_ce = chr_ain[13];
+  assign ss_out = mirroring;
 endmodule
 
 module Mapper234(input clk, input ce, input reset,
@@ -1490,10 +1635,13 @@ module Mapper234(input clk, input ce, input reset,
                 input [13:0] chr_ain, output [21:0] chr_aout,
                 output chr_allow,                             // Allow write
                 output vram_a10,                              // Value for A10 address line
-                output vram_ce);                              // True if the address should be routed to the internal 2kB VRAM.
+                output vram_ce,                               // True if the address should be routed to the internal 2kB VRAM.
+                input ss_shift, input ss_in, output ss_out);
   reg [2:0] block, inner_chr;
   reg mode, mirroring, inner_prg;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {block, inner_chr, mode, mirroring, inner_prg} <= {block, inner_chr, mode, mirroring, inner_prg, ss_in};
+  end else if (reset) begin
     block <= 0;
     {mode, mirroring} <= 0;
     inner_chr <= 0;
@@ -1519,6 +1667,7 @@ module Mapper234(input clk, input ce, input reset,
   assign prg_allow = prg_ain[15] && !prg_write;
   assign chr_allow = flags[15];
   assign vram_ce = chr_ain[13];
+  assign ss_out = block[2];
 endmodule
 
 
@@ -1568,7 +1717,21 @@ module MultiMapper(input clk, input ce, input ppu_ce, input reset,
                    output reg chr_allow,                            // CHR Allow write
                    output reg vram_a10,                             // CHR Value for A10 address line
                    output reg vram_ce,                              // CHR True if the address should be routed to the internal 2kB VRAM.
-                   output reg irq);
+                   output reg irq,
+                   input ss_shift, input ss_in, output ss_out,      // Save state chain through all mappers
+                   input [9:0] ss_mem_addr,                         // MMC5 expansion RAM access for save states
+                   input ss_mem_read, input ss_mem_write,
+                   input [7:0] ss_mem_din, output [7:0] ss_mem_dout,
+                   // Where a ROM window is banked to now, for RomCache prefetch. rom_probe
+                   // is a PRG 8KB window ($8000 + rom_probe[1:0] * $2000) if rom_probe[3]
+                   // is 0, else a CHR 1KB window (rom_probe[2:0] * $400). rom_probe_ok is
+                   // 0 for mappers that do not tell (only MMC1, MMC3 and the UxROM family do).
+                   input [3:0] rom_probe, output reg [21:0] rom_probe_addr, output reg rom_probe_ok);
+  wire ss_mmc1, ss_map28, ss_mmc2, ss_mmc3, ss_mmc5, ss_map13, ss_map15, ss_map34, ss_map41,
+       ss_map66, ss_map68, ss_map69, ss_map71, ss_map79, ss_map228, ss_map234, ss_rambo1;
+  wire [15:0] prg_probe = {1'b1, rom_probe[1:0], 13'b0};
+  wire [13:0] chr_probe = {1'b0, rom_probe[2:0], 10'b0};
+  wire [21:0] mmc1_prg_probe, mmc1_chr_probe, mmc3_prg_probe, mmc3_chr_probe, map28_prg_probe, map28_chr_probe;
   wire mmc0_prg_allow, mmc0_vram_a10, mmc0_vram_ce, mmc0_chr_allow;
   wire [21:0] mmc0_prg_addr, mmc0_chr_addr;
   MMC0 mmc0(clk, ce, flags, prg_ain, mmc0_prg_addr, prg_read, prg_write, prg_din, mmc0_prg_allow,
@@ -1577,22 +1740,29 @@ module MultiMapper(input clk, input ce, input ppu_ce, input reset,
   wire mmc1_prg_allow, mmc1_vram_a10, mmc1_vram_ce, mmc1_chr_allow;
   wire [21:0] mmc1_prg_addr, mmc1_chr_addr;
   MMC1 mmc1(clk, ce, reset, flags, prg_ain, mmc1_prg_addr, prg_read, prg_write, prg_din, mmc1_prg_allow,
-                                   chr_ain, mmc1_chr_addr, mmc1_chr_allow, mmc1_vram_a10, mmc1_vram_ce);
+                                   chr_ain, mmc1_chr_addr, mmc1_chr_allow, mmc1_vram_a10, mmc1_vram_ce,
+                                   ss_shift, ss_in, ss_mmc1,
+                                   prg_probe, mmc1_prg_probe, chr_probe, mmc1_chr_probe);
 
   wire map28_prg_allow, map28_vram_a10, map28_vram_ce, map28_chr_allow;
   wire [21:0] map28_prg_addr, map28_chr_addr;
   Mapper28 map28(clk, ce, reset, flags, prg_ain, map28_prg_addr, prg_read, prg_write, prg_din, map28_prg_allow,
-                                        chr_ain, map28_chr_addr, map28_chr_allow, map28_vram_a10, map28_vram_ce);
+                                        chr_ain, map28_chr_addr, map28_chr_allow, map28_vram_a10, map28_vram_ce,
+                                        ss_shift, ss_mmc1, ss_map28,
+                                        prg_probe, map28_prg_probe, chr_probe, map28_chr_probe);
 
   wire mmc2_prg_allow, mmc2_vram_a10, mmc2_vram_ce, mmc2_chr_allow;
   wire [21:0] mmc2_prg_addr, mmc2_chr_addr;
   MMC2 mmc2(clk, ppu_ce, reset, flags, prg_ain, mmc2_prg_addr, prg_read, prg_write, prg_din, mmc2_prg_allow,
-                                   chr_read, chr_ain, mmc2_chr_addr, mmc2_chr_allow, mmc2_vram_a10, mmc2_vram_ce);
+                                   chr_read, chr_ain, mmc2_chr_addr, mmc2_chr_allow, mmc2_vram_a10, mmc2_vram_ce,
+                                   ss_shift, ss_map28, ss_mmc2);
 
   wire mmc3_prg_allow, mmc3_vram_a10, mmc3_vram_ce, mmc3_chr_allow, mmc3_irq;
   wire [21:0] mmc3_prg_addr, mmc3_chr_addr;
   MMC3 mmc3(clk, ppu_ce, reset, flags, prg_ain, mmc3_prg_addr, prg_read, prg_write, prg_din, mmc3_prg_allow,
-                                   chr_ain, mmc3_chr_addr, mmc3_chr_allow, mmc3_vram_a10, mmc3_vram_ce, mmc3_irq);
+                                   chr_ain, mmc3_chr_addr, mmc3_chr_allow, mmc3_vram_a10, mmc3_vram_ce, mmc3_irq,
+                                   ss_shift, ss_mmc2, ss_mmc3,
+                                   prg_probe, mmc3_prg_probe, chr_probe, mmc3_chr_probe);
 
   wire mmc5_prg_allow, mmc5_vram_a10, mmc5_vram_ce, mmc5_chr_allow, mmc5_irq;
   wire [21:0] mmc5_prg_addr, mmc5_chr_addr;
@@ -1600,87 +1770,103 @@ module MultiMapper(input clk, input ce, input ppu_ce, input reset,
   wire mmc5_has_chr_dout;
   MMC5 mmc5(clk, ppu_ce, reset, flags, ppuflags, prg_ain, mmc5_prg_addr, prg_read, prg_write, prg_din, mmc5_prg_dout, mmc5_prg_allow,
                                    chr_ain, mmc5_chr_addr, mmc5_chr_dout, mmc5_has_chr_dout, 
-                                   mmc5_chr_allow, mmc5_vram_a10, mmc5_vram_ce, mmc5_irq);
+                                   mmc5_chr_allow, mmc5_vram_a10, mmc5_vram_ce, mmc5_irq,
+                                   ss_shift, ss_mmc3, ss_mmc5,
+                                   ss_mem_addr, ss_mem_read, ss_mem_write, ss_mem_din, ss_mem_dout);
 
   wire map13_prg_allow, map13_vram_a10, map13_vram_ce, map13_chr_allow;
   wire [21:0] map13_prg_addr, map13_chr_addr;
   Mapper13 map13(clk, ce, reset, flags, prg_ain, map13_prg_addr, prg_read, prg_write, prg_din, map13_prg_allow,
-                                        chr_ain, map13_chr_addr, map13_chr_allow, map13_vram_a10, map13_vram_ce);
+                                        chr_ain, map13_chr_addr, map13_chr_allow, map13_vram_a10, map13_vram_ce,
+                                        ss_shift, ss_mmc5, ss_map13);
 
   wire map15_prg_allow, map15_vram_a10, map15_vram_ce, map15_chr_allow;
   wire [21:0] map15_prg_addr, map15_chr_addr;
   Mapper15 map15(clk, ce, reset, flags, prg_ain, map15_prg_addr, prg_read, prg_write, prg_din, map15_prg_allow,
-                                        chr_ain, map15_chr_addr, map15_chr_allow, map15_vram_a10, map15_vram_ce);
+                                        chr_ain, map15_chr_addr, map15_chr_allow, map15_vram_a10, map15_vram_ce,
+                                        ss_shift, ss_map13, ss_map15);
 
   wire map34_prg_allow, map34_vram_a10, map34_vram_ce, map34_chr_allow;
   wire [21:0] map34_prg_addr, map34_chr_addr;
   Mapper34 map34(clk, ce, reset, flags, prg_ain, map34_prg_addr, prg_read, prg_write, prg_din, map34_prg_allow,
-                                        chr_ain, map34_chr_addr, map34_chr_allow, map34_vram_a10, map34_vram_ce);
+                                        chr_ain, map34_chr_addr, map34_chr_allow, map34_vram_a10, map34_vram_ce,
+                                        ss_shift, ss_map15, ss_map34);
 
   wire map41_prg_allow, map41_vram_a10, map41_vram_ce, map41_chr_allow;
   wire [21:0] map41_prg_addr, map41_chr_addr;
   Mapper41 map41(clk, ce, reset, flags, prg_ain, map41_prg_addr, prg_read, prg_write, prg_din, map41_prg_allow,
-                                        chr_ain, map41_chr_addr, map41_chr_allow, map41_vram_a10, map41_vram_ce);
+                                        chr_ain, map41_chr_addr, map41_chr_allow, map41_vram_a10, map41_vram_ce,
+                                        ss_shift, ss_map34, ss_map41);
 
   wire map66_prg_allow, map66_vram_a10, map66_vram_ce, map66_chr_allow;
   wire [21:0] map66_prg_addr, map66_chr_addr;
   Mapper66 map66(clk, ce, reset, flags, prg_ain, map66_prg_addr, prg_read, prg_write, prg_din, map66_prg_allow,
-                                        chr_ain, map66_chr_addr, map66_chr_allow, map66_vram_a10, map66_vram_ce);
+                                        chr_ain, map66_chr_addr, map66_chr_allow, map66_vram_a10, map66_vram_ce,
+                                        ss_shift, ss_map41, ss_map66);
 
   wire map68_prg_allow, map68_vram_a10, map68_vram_ce, map68_chr_allow;
   wire [21:0] map68_prg_addr, map68_chr_addr;
   Mapper68 map68(clk, ce, reset, flags, prg_ain, map68_prg_addr, prg_read, prg_write, prg_din, map68_prg_allow,
-                                        chr_ain, map68_chr_addr, map68_chr_allow, map68_vram_a10, map68_vram_ce);
+                                        chr_ain, map68_chr_addr, map68_chr_allow, map68_vram_a10, map68_vram_ce,
+                                        ss_shift, ss_map66, ss_map68);
 
   wire map69_prg_allow, map69_vram_a10, map69_vram_ce, map69_chr_allow, map69_irq;
   wire [21:0] map69_prg_addr, map69_chr_addr;
   Mapper69 map69(clk, ce, reset, flags, prg_ain, map69_prg_addr, prg_read, prg_write, prg_din, map69_prg_allow,
-                                        chr_ain, map69_chr_addr, map69_chr_allow, map69_vram_a10, map69_vram_ce, map69_irq);
+                                        chr_ain, map69_chr_addr, map69_chr_allow, map69_vram_a10, map69_vram_ce, map69_irq,
+                                        ss_shift, ss_map68, ss_map69);
 
   wire map71_prg_allow, map71_vram_a10, map71_vram_ce, map71_chr_allow;
   wire [21:0] map71_prg_addr, map71_chr_addr;
   Mapper71 map71(clk, ce, reset, flags, prg_ain, map71_prg_addr, prg_read, prg_write, prg_din, map71_prg_allow,
-                                        chr_ain, map71_chr_addr, map71_chr_allow, map71_vram_a10, map71_vram_ce);
+                                        chr_ain, map71_chr_addr, map71_chr_allow, map71_vram_a10, map71_vram_ce,
+                                        ss_shift, ss_map69, ss_map71);
 
   wire map79_prg_allow, map79_vram_a10, map79_vram_ce, map79_chr_allow;
   wire [21:0] map79_prg_addr, map79_chr_addr;
   Mapper79 map79(clk, ce, reset, flags, prg_ain, map79_prg_addr, prg_read, prg_write, prg_din, map79_prg_allow,
-                                        chr_ain, map79_chr_addr, map79_chr_allow, map79_vram_a10, map79_vram_ce);
+                                        chr_ain, map79_chr_addr, map79_chr_allow, map79_vram_a10, map79_vram_ce,
+                                        ss_shift, ss_map71, ss_map79);
 
 
   wire map228_prg_allow, map228_vram_a10, map228_vram_ce, map228_chr_allow;
   wire [21:0] map228_prg_addr, map228_chr_addr;
   Mapper228 map228(clk, ce, reset, flags, prg_ain, map228_prg_addr, prg_read, prg_write, prg_din, map228_prg_allow,
-                                          chr_ain, map228_chr_addr, map228_chr_allow, map228_vram_a10, map228_vram_ce);
+                                          chr_ain, map228_chr_addr, map228_chr_allow, map228_vram_a10, map228_vram_ce,
+                                          ss_shift, ss_map79, ss_map228);
 
 
   wire map234_prg_allow, map234_vram_a10, map234_vram_ce, map234_chr_allow;
   wire [21:0] map234_prg_addr, map234_chr_addr;
   Mapper234 map234(clk, ce, reset, flags, prg_ain, map234_prg_addr, prg_read, prg_write, prg_from_ram, map234_prg_allow,
-                                          chr_ain, map234_chr_addr, map234_chr_allow, map234_vram_a10, map234_vram_ce);
+                                          chr_ain, map234_chr_addr, map234_chr_allow, map234_vram_a10, map234_vram_ce,
+                                          ss_shift, ss_map228, ss_map234);
 
   wire rambo1_prg_allow, rambo1_vram_a10, rambo1_vram_ce, rambo1_chr_allow, rambo1_irq;
   wire [21:0] rambo1_prg_addr, rambo1_chr_addr;
   Rambo1 rambo1(clk, ce, reset, flags, prg_ain, rambo1_prg_addr, prg_read, prg_write, prg_din, rambo1_prg_allow,
-                                   chr_ain, rambo1_chr_addr, rambo1_chr_allow, rambo1_vram_a10, rambo1_vram_ce, rambo1_irq);
+                                   chr_ain, rambo1_chr_addr, rambo1_chr_allow, rambo1_vram_a10, rambo1_vram_ce, rambo1_irq,
+                                   ss_shift, ss_map234, ss_rambo1);
 
   wire [21:0] nesev_prg_addr, nesev_chr_addr;
   wire nesev_irq;
-  NesEvent nesev(clk, ce, reset, prg_ain, nesev_prg_addr, chr_ain, nesev_chr_addr, mmc1_chr_addr[16:13], mmc1_prg_addr, nesev_irq);
+  NesEvent nesev(clk, ce, reset, prg_ain, nesev_prg_addr, chr_ain, nesev_chr_addr, mmc1_chr_addr[16:13], mmc1_prg_addr, nesev_irq,
+                 ss_shift, ss_rambo1, ss_out);
   
   // Mask 
-  reg [5:0] prg_mask;
+  reg [6:0] prg_mask;
   reg [6:0] chr_mask;
 
   always @* begin
     case(flags[10:8])
-    0: prg_mask = 6'b000000;
-    1: prg_mask = 6'b000001;
-    2: prg_mask = 6'b000011;
-    3: prg_mask = 6'b000111;
-    4: prg_mask = 6'b001111;
-    5: prg_mask = 6'b011111;
-    default: prg_mask = 6'b111111;
+    0: prg_mask = 7'b0000000;
+    1: prg_mask = 7'b0000001;
+    2: prg_mask = 7'b0000011;
+    3: prg_mask = 7'b0000111;
+    4: prg_mask = 7'b0001111;
+    5: prg_mask = 7'b0011111;
+    6: prg_mask = 7'b0111111;
+    7: prg_mask = 7'b1111111;   // 2MB, only with DDR_ROM
     endcase
 
     case(flags[13:11])
@@ -1741,14 +1927,34 @@ module MultiMapper(input clk, input ce, input ppu_ce, input reset,
     234: {prg_aout, prg_allow, chr_aout, vram_a10, vram_ce, chr_allow}     = {map234_prg_addr, map234_prg_allow, map234_chr_addr, map234_vram_a10, map234_vram_ce, map234_chr_allow};
     default: {prg_aout, prg_allow, chr_aout, vram_a10, vram_ce, chr_allow} = {mmc0_prg_addr, mmc0_prg_allow, mmc0_chr_addr, mmc0_vram_a10, mmc0_vram_ce, mmc0_chr_allow};
     endcase
-    if (prg_aout[21:20] == 2'b00)
-      prg_aout[19:0] = {prg_aout[19:14] & prg_mask, prg_aout[13:0]};
+    if (prg_aout[21] == 1'b0)
+      prg_aout[20:0] = {prg_aout[20:14] & prg_mask, prg_aout[13:0]};
     if (chr_aout[21:20] == 2'b10)
       chr_aout[19:0] = {chr_aout[19:13] & chr_mask, chr_aout[12:0]};
     // Remap the CHR address into VRAM, if needed.
     chr_aout = vram_ce ? {11'b11_0000_0000_0, vram_a10, chr_ain[9:0]} : chr_aout;
     prg_aout = (prg_ain < 'h2000) ? {11'b11_1000_0000_0, prg_ain[10:0]} : prg_aout;
     prg_allow = prg_allow || (prg_ain < 'h2000);
+
+    // The same for rom_probe
+    rom_probe_ok = 1;
+    case(flags[7:0])
+    1:   rom_probe_addr = rom_probe[3] ? mmc1_chr_probe : mmc1_prg_probe;
+    118,
+    119,
+    47,
+    4:   rom_probe_addr = rom_probe[3] ? mmc3_chr_probe : mmc3_prg_probe;
+    0,
+    2,
+    3,
+    7,
+    28:  rom_probe_addr = rom_probe[3] ? map28_chr_probe : map28_prg_probe;
+    default: {rom_probe_ok, rom_probe_addr} = 0;
+    endcase
+    if (rom_probe_addr[21] == 1'b0)
+      rom_probe_addr[20:0] = {rom_probe_addr[20:14] & prg_mask, rom_probe_addr[13:0]};
+    if (rom_probe_addr[21:20] == 2'b10)
+      rom_probe_addr[19:0] = {rom_probe_addr[19:13] & chr_mask, rom_probe_addr[12:0]};
   end
 endmodule
 
@@ -56,13 +56,16 @@ module DmaController(input clk, input ce, input reset,
                      output read,                   // 1 = read, 0 = write
                      output [7:0] data_to_ram,      // Value to write to RAM
                      output dmc_ack,                // ACK the DMC DMA
-                     output pause_cpu);             // CPU is paused
+                     output pause_cpu,              // CPU is paused
+                     input ss_shift, input ss_in, output ss_out);
   reg dmc_state;
   reg [1:0] spr_state;
   reg [7:0] sprite_dma_lastval;
   reg [15:0] sprite_dma_addr;     // sprite dma source addr
   wire [8:0] new_sprite_dma_addr = sprite_dma_addr[7:0] + 8'h01;
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {dmc_state, spr_state, sprite_dma_lastval, sprite_dma_addr} <= {dmc_state, spr_state, sprite_dma_lastval, sprite_dma_addr, ss_in};
+  end else if (reset) begin
     dmc_state <= 0;
     spr_state <= 0;    
     sprite_dma_lastval <= 0;
@@ -84,6 +87,7 @@ module DmaController(input clk, input ce, input reset,
   assign read = !odd_cycle;
   assign data_to_ram = sprite_dma_lastval;
   assign aout = dmc_ack ? dmc_dma_addr : !odd_cycle ? sprite_dma_addr : 16'h2004;
+  assign ss_out = dmc_state;
 endmodule
 
 // Multiplexes accesses by the PPU and the PRG into a single memory, used for both
@@ -93,6 +97,10 @@ endmodule
 // Data read by PPU will be available on the next clock cycle.
 // Data read by CPU will be available within at most 2 clock cycles.
 
+// Internal RAM and VRAM are in their own dual-port block RAM (see NesRam in
+// NES_KV260.v), so CPU and PPU can access them in the same cycle as each
+// other. Everything else goes through the single main memory port, and a
+// CPU access there is delayed when the PPU uses it.
 module MemoryMultiplex(input clk, input ce,
                        input [21:0] prg_addr, input prg_read, input prg_write, input [7:0] prg_din,
                        input [21:0] chr_addr, input chr_read, input chr_write, input [7:0] chr_din,
@@ -101,22 +109,49 @@ module MemoryMultiplex(input clk, input ce,
                        output memory_read_cpu,      // read into CPU latch
                        output memory_read_ppu,      // read into PPU latch
                        output memory_write,         // is a write operation
-                       output [7:0] memory_dout);
+                       output [7:0] memory_dout,
+                       // Internal RAM, CPU side
+                       output [10:0] ram_addr,
+                       output ram_read,
+                       output ram_write,
+                       output [7:0] ram_dout,
+                       // VRAM, PPU side
+                       output [10:0] vram_addr,
+                       output vram_read,
+                       output vram_write,
+                       output [7:0] vram_dout,
+                       input ss_shift, input ss_in, output ss_out);
+  wire prg_is_ram = prg_addr[21:16] == 6'b11_1000;
+  wire chr_is_vram = chr_addr[21:16] == 6'b11_0000;
+  wire chr_main = (chr_read || chr_write) && !chr_is_vram;    // PPU uses main memory
   reg saved_prg_read, saved_prg_write;
-  assign memory_addr = (chr_read || chr_write) ? chr_addr : prg_addr;
-  assign memory_write = (chr_read || chr_write) ? chr_write : saved_prg_write;
-  assign memory_read_ppu = chr_read;
-  assign memory_read_cpu = !(chr_read || chr_write) && (prg_read || saved_prg_read);
-  assign memory_dout = chr_write ? chr_din : prg_din;
-  always @(posedge clk) if (ce) begin
-    if (chr_read || chr_write) begin
-      saved_prg_read <= prg_read || saved_prg_read;
-      saved_prg_write <= prg_write || saved_prg_write;
+  reg saved_ram_write;
+  assign memory_addr = chr_main ? chr_addr : prg_addr;
+  assign memory_write = chr_main ? chr_write : saved_prg_write;
+  assign memory_read_ppu = chr_read && !chr_is_vram;
+  assign memory_read_cpu = !chr_main && (prg_read && !prg_is_ram || saved_prg_read);
+  assign memory_dout = chr_main ? chr_din : prg_din;
+  always @(posedge clk) if (ss_shift) begin
+    {saved_prg_read, saved_prg_write, saved_ram_write} <= {saved_prg_read, saved_prg_write, saved_ram_write, ss_in};
+  end else if (ce) begin
+    if (chr_main) begin
+      saved_prg_read <= prg_read && !prg_is_ram || saved_prg_read;
+      saved_prg_write <= prg_write && !prg_is_ram || saved_prg_write;
     end else begin
       saved_prg_read <= 0;
-      saved_prg_write <= prg_write;
+      saved_prg_write <= prg_write && !prg_is_ram;
     end
+    saved_ram_write <= prg_write && prg_is_ram;     // writes happen a cycle later, as above
   end
+  assign ram_addr = prg_addr[10:0];
+  assign ram_read = prg_read && prg_is_ram;
+  assign ram_write = saved_ram_write;
+  assign ram_dout = prg_din;
+  assign vram_addr = chr_addr[10:0];
+  assign vram_read = chr_read && chr_is_vram;
+  assign vram_write = chr_write && chr_is_vram;
+  assign vram_dout = chr_din;
+  assign ss_out = saved_prg_read;
 endmodule
 
 
@@ -138,12 +173,52 @@ module NES(input clk, input reset, input ce,
            input [7:0] memory_din_ppu,  // next cycle, contents of latch B (PPU's data)
            output memory_write,         // is a write operation
            output [7:0] memory_dout,
+
+           // Internal RAM and VRAM, in block RAM.
+           output [10:0] ram_addr,      // CPU internal RAM
+           output ram_read,
+           input [7:0] ram_din,         // next cycle, result of ram_read
+           output ram_write,
+           output [7:0] ram_dout,
+           output [10:0] vram_addr,     // PPU VRAM
+           output vram_read,
+           input [7:0] vram_din,        // next cycle, result of vram_read
+           output vram_write,
+           output [7:0] vram_dout,
            
            output [8:0] cycle,
            output [8:0] scanline,
+           output vblank_start,         // one clk as vblank begins
+           output [4:0] perf,           // one clk per event, for the performance counters in NES_KV260:
+                                        // {sprite overflow, NMI, mapper IRQ, CPU paused by DMA, CPU cycle}
+           output [2:0] emphasis,       // PPU color emphasis, red, green, blue
            
            output reg [31:0] dbgadr,
-           output [1:0] dbgctr
+           output [1:0] dbgctr,
+
+           // Save states (SaveState in NES_KV260.v), while ce is 0.
+           // All registers are in one scan chain from ss_in to ss_out, which
+           // shifts by one bit every cycle ss_shift is set. In every module
+           // each always block shifts its registers as {r1, ..., rn} <= {r1, ..., rn, in},
+           // the top bit of r1 goes on to the next block. Memories are not in
+           // the chain, they are read and written a byte at a time through
+           // ss_mem_*, next cycle for reads:
+           // $000-$3ff: MMC5 expansion RAM, $400-$4ff: OAM,
+           // $500-$51f: sprite temp RAM, $520-$53f: palette
+           input ss_shift,
+           input ss_reload,             // after the chain is loaded, CPU reloads its microcode output
+           input ss_in,
+           output ss_out,
+           input [10:0] ss_mem_addr,
+           input ss_mem_read,
+           input ss_mem_write,
+           input [7:0] ss_mem_din,
+           output [7:0] ss_mem_dout,
+
+           // Where the mapper has banked a ROM window to, see MultiMapper
+           input [3:0] rom_probe,
+           output [21:0] rom_probe_addr,
+           output rom_probe_ok
            );
   reg [7:0] from_data_bus;
   wire [7:0] cpu_dout;
@@ -154,7 +229,9 @@ module NES(input clk, input reset, input ce,
   // CPU does its memory I/O on cycle #0. It will be available in time for cycle #2.
   reg [1:0] cpu_cycle_counter;
   always @(posedge clk) begin
-    if (reset)
+    if (ss_shift)
+      cpu_cycle_counter <= {cpu_cycle_counter, ss_in};
+    else if (reset)
       cpu_cycle_counter <= 0;
     else if (ce)
       cpu_cycle_counter <= (cpu_cycle_counter == 2) ? 0 : cpu_cycle_counter + 1;
@@ -165,7 +242,9 @@ module NES(input clk, input reset, input ce,
   wire nmi;
   reg nmi_active;
   always @(posedge clk) begin
-    if (reset)
+    if (ss_shift)
+      nmi_active <= cpu_cycle_counter[1];
+    else if (reset)
       nmi_active <= 0;
     else if (ce && cpu_cycle_counter == 0)
       nmi_active <= nmi;
@@ -179,7 +258,9 @@ module NES(input clk, input reset, input ce,
   wire pause_cpu;
   reg apu_irq_delayed;
   reg mapper_irq_delayed;
-  CPU cpu(clk, apu_ce && !pause_cpu, reset, from_data_bus, apu_irq_delayed | mapper_irq_delayed, nmi_active, cpu_dout, cpu_addr, cpu_mr, cpu_mw);
+  wire ss_cpu, ss_dma, ss_apu, ss_ppu, ss_mapper;
+  CPU cpu(clk, apu_ce && !pause_cpu, reset, from_data_bus, apu_irq_delayed | mapper_irq_delayed, nmi_active, cpu_dout, cpu_addr, cpu_mr, cpu_mw,
+          ss_shift, ss_reload, mapper_irq_delayed, ss_cpu);
 
   // -- DMA
   wire [15:0] dma_aout;
@@ -208,7 +289,8 @@ module NES(input clk, input reset, input ce,
                     dma_read,
                     dma_data_to_ram,
                     apu_dma_ack,
-                    pause_cpu);
+                    pause_cpu,
+                    ss_shift, ss_cpu, ss_dma);
 
   // -- Audio Processing Unit  
   wire apu_cs = addr >= 'h4000 && addr < 'h4018;
@@ -224,7 +306,8 @@ module NES(input clk, input reset, input ce,
           apu_dma_addr,
           from_data_bus,
           odd_or_even,
-          apu_irq);
+          apu_irq,
+          ss_shift, ss_dma, ss_apu);
 
   // Joypads are mapped into the APU's range.
   wire joypad1_cs = (addr == 'h4016);
@@ -245,11 +328,15 @@ module NES(input clk, input reset, input ce,
   wire [7:0] chr_from_ppu;       // Data from PPU to VRAM
   wire [7:0] chr_to_ppu;
   wire [19:0] mapper_ppu_flags;  // PPU flags for mapper cheating
+  wire overflow_hit;             // PPU finds an object past the 8th on a line
+  wire [7:0] ss_ppu_dout, ss_mapper_dout;
   PPU ppu(clk, ce, reset, color, dbus, ppu_dout, addr[2:0],
           ppu_cs && mr_ppu, ppu_cs && mw_ppu,
           nmi,
           chr_read, chr_write, chr_addr, chr_to_ppu, chr_from_ppu,
-          scanline, cycle, mapper_ppu_flags);
+          scanline, cycle, vblank_start, overflow_hit, emphasis, mapper_ppu_flags,
+          ss_shift, ss_apu, ss_ppu,
+          ss_mem_addr[8:0], ss_mem_write && ss_mem_addr[10], ss_mem_din, ss_ppu_dout);
 
   // -- Memory mapping logic
   wire [15:0] prg_addr = addr;
@@ -264,12 +351,35 @@ module NES(input clk, input reset, input ce,
   wire has_chr_from_ppu_mapper;
   MultiMapper multi_mapper(clk, cart_ce, ce, reset, mapper_ppu_flags, mapper_flags, 
                            prg_addr, prg_linaddr, prg_read, prg_write, prg_din, prg_dout_mapper, from_data_bus, prg_allow,
-                           chr_read, chr_addr, chr_linaddr, chr_from_ppu_mapper, has_chr_from_ppu_mapper, chr_allow, vram_a10, vram_ce, mapper_irq);
-  assign chr_to_ppu = has_chr_from_ppu_mapper ? chr_from_ppu_mapper : memory_din_ppu;
+                           chr_read, chr_addr, chr_linaddr, chr_from_ppu_mapper, has_chr_from_ppu_mapper, chr_allow, vram_a10, vram_ce, mapper_irq,
+                           ss_shift, ss_ppu, ss_mapper,
+                           ss_mem_addr[9:0], ss_mem_read && !ss_mem_addr[10], ss_mem_write && !ss_mem_addr[10], ss_mem_din, ss_mapper_dout,
+                           rom_probe, rom_probe_addr, rom_probe_ok);
+  assign ss_mem_dout = ss_mem_addr[10] ? ss_ppu_dout : ss_mapper_dout;
+
+  // Whether the last CPU / PPU read was from block RAM or main memory
+  reg cpu_read_ram, ppu_read_vram;
+  always @(posedge clk) if (ss_shift) begin
+    {cpu_read_ram, ppu_read_vram} <= {cpu_read_ram, ppu_read_vram, nmi_active};
+  end else if (ce) begin
+    if (ram_read)
+      cpu_read_ram <= 1;
+    else if (memory_read_cpu)
+      cpu_read_ram <= 0;
+    if (vram_read)
+      ppu_read_vram <= 1;
+    else if (memory_read_ppu)
+      ppu_read_vram <= 0;
+  end
+  wire [7:0] cpu_din = cpu_read_ram ? ram_din : memory_din_cpu;
+  wire [7:0] ppu_din = ppu_read_vram ? vram_din : memory_din_ppu;
+  assign chr_to_ppu = has_chr_from_ppu_mapper ? chr_from_ppu_mapper : ppu_din;
                              
   // Mapper IRQ seems to be delayed by one PPU clock.   
   // APU IRQ seems delayed by one APU clock.
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {mapper_irq_delayed, apu_irq_delayed} <= {mapper_irq_delayed, apu_irq_delayed, cpu_read_ram};
+  end else if (reset) begin
     mapper_irq_delayed <= 0;
     apu_irq_delayed <= 0;
   end else begin
@@ -279,10 +389,19 @@ module NES(input clk, input reset, input ce,
       apu_irq_delayed <= apu_irq;
   end
    
-  // -- Multiplexes CPU and PPU accesses into one single RAM
+  assign perf = {overflow_hit,
+                 ce && cpu_cycle_counter == 0 && nmi && !nmi_active,
+                 ce && mapper_irq && !mapper_irq_delayed,
+                 apu_ce && pause_cpu,
+                 apu_ce};
+
+  // -- Multiplexes CPU and PPU accesses into one single RAM, plus block RAM for internal RAM and VRAM
   MemoryMultiplex mem(clk, ce, prg_linaddr, prg_read && prg_allow, prg_write && prg_allow, prg_din, 
                                chr_linaddr, chr_read,              chr_write && (chr_allow || vram_ce), chr_from_ppu,
-                               memory_addr, memory_read_cpu, memory_read_ppu, memory_write, memory_dout);
+                               memory_addr, memory_read_cpu, memory_read_ppu, memory_write, memory_dout,
+                               ram_addr, ram_read, ram_write, ram_dout,
+                               vram_addr, vram_read, vram_write, vram_dout,
+                               ss_shift, ss_mapper, ss_out);
 
   always @* begin
     if (apu_cs) begin
@@ -295,7 +414,7 @@ module NES(input clk, input reset, input ce,
     end else if (ppu_cs) begin
       from_data_bus = ppu_dout;
     end else if (prg_allow) begin
-      from_data_bus = memory_din_cpu;
+      from_data_bus = cpu_din;
     end else begin
       from_data_bus = prg_dout_mapper;
     end
@@ -6,12 +6,17 @@
 		// Width of S_AXI data bus
 		parameter integer C_S_AXI_DATA_WIDTH	= 32,
 		// Width of S_AXI address bus
-		parameter integer C_S_AXI_ADDR_WIDTH	= 4
+		parameter integer C_S_AXI_ADDR_WIDTH	= 7
 	)
 	(
 		// Users to add ports here
 		output [31:0] value,	// this is value at register[0]
 		input [31:0] result,	// this is exposed at register[1]
+		input [31:0] result2,	// this is exposed at register[2]
+		input [31:0] result3,	// this is exposed at register[3]
+		input [511:0] counters,	// exposed at register[16..31], 32 bits each
+		input wr_hold,			// 1: do not accept new writes yet
+		input rd_hold,			// 1: do not accept new reads yet
 
 		// User ports ends
 
@@ -95,7 +100,7 @@
 	// ADDR_LSB = 2 for 32 bits (n downto 2)
 	// ADDR_LSB = 3 for 64 bits (n downto 3)
 	localparam integer ADDR_LSB = (C_S_AXI_DATA_WIDTH/32) + 1;
-	localparam integer OPT_MEM_ADDR_BITS = 1;
+	localparam integer OPT_MEM_ADDR_BITS = C_S_AXI_ADDR_WIDTH - ADDR_LSB - 1;
 	//----------------------------------------------
 	//-- Signals for user logic register space example
 	//------------------------------------------------
@@ -134,7 +139,7 @@
 	    end 
 	  else
 	    begin    
-	      if (~axi_awready && S_AXI_AWVALID && S_AXI_WVALID && aw_en)
+	      if (~axi_awready && S_AXI_AWVALID && S_AXI_WVALID && aw_en && ~wr_hold)
 	        begin
 	          // slave is ready to accept write address when 
 	          // there is a valid write address and write data
@@ -167,7 +172,7 @@
 	    end 
 	  else
 	    begin    
-	      if (~axi_awready && S_AXI_AWVALID && S_AXI_WVALID && aw_en)
+	      if (~axi_awready && S_AXI_AWVALID && S_AXI_WVALID && aw_en && ~wr_hold)
 	        begin
 	          // Write Address latching 
 	          axi_awaddr <= S_AXI_AWADDR;
@@ -188,7 +193,7 @@
 	    end 
 	  else
 	    begin    
-	      if (~axi_wready && S_AXI_WVALID && S_AXI_AWVALID && aw_en )
+	      if (~axi_wready && S_AXI_WVALID && S_AXI_AWVALID && aw_en && ~wr_hold )
 	        begin
 	          // slave is ready to accept write data when 
 	          // there is a valid write address and write data
@@ -290,7 +295,7 @@
 	    end 
 	  else
 	    begin    
-	      if (~axi_arready && S_AXI_ARVALID)
+	      if (~axi_arready && S_AXI_ARVALID && ~rd_hold)
 	        begin
 	          // indicates that the slave has acceped the valid read address
 	          axi_arready <= 1'b1;
@@ -345,9 +350,9 @@
 	      case ( axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB] )
 	        2'h0   : reg_data_out <= slv_reg0;
 	        2'h1   : reg_data_out <= result;
-	        // 2'h2   : reg_data_out <= slv_reg2;
-	        // 2'h3   : reg_data_out <= slv_reg3;
-	        default : reg_data_out <= 0;
+	        2'h2   : reg_data_out <= result2;
+	        2'h3   : reg_data_out <= result3;
+	        default : reg_data_out <= axi_araddr[ADDR_LSB+4] ? counters[axi_araddr[ADDR_LSB+3:ADDR_LSB]*32 +: 32] : 0;
 	      endcase
 	end
 
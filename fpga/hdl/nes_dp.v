@@ -15,9 +15,18 @@ module nes_dp(
     input clk_nes,      // 21.47 Mhz??signal input circuits work in this domain
     input ppu_clk,      // 5.369 Mhz, not a clock domain, only sampled
     input [5:0] ppu_video,
+    input [2:0] ppu_emphasis,   // color emphasis, red, green, blue
     input [8:0] ppu_scanline,
     input [8:0] ppu_cycle,
 
+    input [1:0] timing, // output timing, see timings() below, clk_nes domain
+    input genlock,      // 1: lock output frames to NES frames, clk_nes domain
+    input [3:0] scale,  // scaling mode and filters, see Scaler below, clk_nes domain
+    input pal_write,    // palette writes from PS, clk_nes domain
+    input [8:0] pal_addr,   // {emphasis, color}
+    input [23:0] pal_data,  // RGB
+    output reg locked = 0,  // genlock is on and holding, clk_pixel domain
+
     output reg de,      // data enable, registered to sync with video
     output reg vsync,   // positive polarity, registered to sync with video
     output reg hsync,   // positive polarity, registered to sync with video
@@ -44,36 +53,53 @@ module nes_dp(
 //        end
 //    end
 
-/*
-    // double buffering
-    reg cur = 0;        // current frame buffer, in ppu_clk domain
-    reg r_cur = 0;
-    reg r2_cur = 0;     // current frame buffer, in clk_pixel domain
-
-    always @(posedge clk_pixel) begin
-        r_cur <= cur;   // r_cur is meta-stable
-        r2_cur <= r_cur;    // r2_cur is stable
-    end
-
-    always @(posedge clk_nes) begin
-        if (ppu_clk_edge && ppu_scanline == 239 && ppu_cycle == 256) begin
-            // flip to the other buffer
-            cur = ~cur;
-        end
-    end
-    */
+    // number of frame buffers, 1-3, see below
+    parameter FB_COUNT = 3;
 
-    // horizontal timings
-    parameter HA_END = 1919;          // end of active pixels
-    parameter HS_STA = HA_END + 88;   // sync starts after front porch
-    parameter HS_END = HS_STA + 44;   // sync ends
-    parameter LINE   = 2199;          // last pixel on line (after back porch)
+    // Output timing. PS picks one at boot, sets the pixel clock (clk_wiz_0) to
+    // match and, once it has locked, gives it here (command 13 of NES_KV260).
+    // DisplayPort uses the same mode:
+    //   0: 1080p60, 148.5 Mhz
+    //   1: 720p60, 74.25 Mhz
+    //   2: 1440p60 (CVT reduced blanking), 241.5 Mhz
+    // It is taken during rst_pixel, which is held while the clock relocks, and
+    // otherwise at the start of the last line of a frame.
+    function [95:0] timings(input [1:0] t);
+        case (t)
+        //                  HA_END    HS_STA    HS_END    LINE      VA_END    VS_STA    VS_END    SCREEN
+        1:       timings = {12'd1279, 12'd1390, 12'd1430, 12'd1649, 12'd719,  12'd725,  12'd730,  12'd749};
+        2:       timings = {12'd2559, 12'd2608, 12'd2640, 12'd2719, 12'd1439, 12'd1443, 12'd1448, 12'd1480};
+        default: timings = {12'd1919, 12'd2008, 12'd2052, 12'd2199, 12'd1079, 12'd1084, 12'd1089, 12'd1124};
+        endcase
+    endfunction
+    reg [1:0] timing_s1 = 0, timing_s2 = 0, cur_timing = 0;
+    wire [11:0] HA_END;     // end of active pixels
+    wire [11:0] HS_STA;     // sync starts after front porch
+    wire [11:0] HS_END;     // sync ends
+    wire [11:0] LINE;       // last pixel on line (after back porch)
+    wire [11:0] VA_END;
+    wire [11:0] VS_STA;
+    wire [11:0] VS_END;
+    wire [11:0] SCREEN;     // last line on screen (after back porch)
+    assign {HA_END, HS_STA, HS_END, LINE, VA_END, VS_STA, VS_END, SCREEN} = timings(cur_timing);
 
-    // vertical timings
-    parameter VA_END = 1079;          // end of active pixels
-    parameter VS_STA = VA_END + 4;    // sync starts after front porch
-    parameter VS_END = VS_STA + 5;    // sync ends
-    parameter SCREEN = 1124;          // last line on screen (after back porch)
+    // Genlock. The NES makes a frame every 89341.5 PPU cycles (60.0988Hz),
+    // while the output here is exactly 60Hz, so free running the NES gains a whole
+    // frame every ~10 seconds and one frame gets dropped, which shows as a
+    // hitch in scrolling. With genlock on, every output frame is stretched or
+    // shortened by up to VADJ lines of back porch, to keep the end of each NES
+    // frame at output line LOCK_LINE. Then every NES frame is shown exactly once,
+    // starting the output frame right after it is done.
+    // A NES frame is 1123.15 output lines at 1080p, so the steady state is frames
+    // of 1123 and 1124 lines (748.8 at 720p, 1477.4 at 1440p). That is up to 3.6
+    // lines off the standard frame (1481 lines at 1440p), so VADJ leaves twice
+    // that for catching up. Shortening only ever removes as many lines as the
+    // NES frame ended early, so the frame cannot end before the current line.
+    // PS puts the average frame length in the DP MSA while genlock is on.
+    parameter VADJ = 8;                 // max lines added to or removed from a frame
+    wire [11:0] LOCK_LINE = VS_END + 12;    // where NES frames should end, in vertical blanking
+    wire [11:0] LOCK_HALF = SCREEN >> 1;    // half a frame, for deciding early vs. late
+    reg [11:0] screen_end = 1124;       // last line of the current frame
 
     always @(posedge clk_pixel) begin
          p_hsync <= (sx >= HS_STA && sx < HS_END);
@@ -82,7 +108,7 @@ module nes_dp(
          
         if (sx == LINE) begin  // last pixel on line?
             sx <= 0;
-            sy <= (sy == SCREEN) ? 0 : sy + 1;  // last line on screen?
+            sy <= (sy == screen_end) ? 0 : sy + 1;  // last line on screen?
         end else begin
             sx <= sx + 1;
         end
@@ -92,55 +118,344 @@ module nes_dp(
         end
     end
     
-    // 4x upscale, 256x240 becomes 1024*960
-    // 448 left black bar, 60 top black bar
-    // video active area is x: 448-1471, y:60-1019
-    // framebuffer x and y
-    wire video_active = sx >= 448 && sx <= 1471 && sy >= 60 && sy <= 1019;
-    wire [7:0] fx = (sx - 448) >> 2;
-    wire [7:0] fy = (sy - 60) >> 2;
-    wire [15:0] fb_raddr = {fy, fx};      // framebuffer read address
-
     // Put PPU data in framebuffer, all in ppu_clk domain
     wire ppu_active = ppu_scanline <= 239 && ppu_cycle != 0 && ppu_cycle <= 256;
     wire [15:0] fb_waddr = {ppu_scanline[7:0], ppu_cycle_minus_one[7:0]};         // framebuffer write address
     wire [8:0] ppu_cycle_minus_one = ppu_cycle - 1;
     
-    /* Double buffer
-    wire [5:0] pixel0, pixel1;
-    wire [5:0] pixel = r2_cur ? pixel0 : pixel1;                        // directly drives video
-    // wiring up the frame buffer
-    nes_fb fb0(clk_pixel, video_active, fb_raddr, pixel0, 
-               clk_nes, ppu_clk_edge & ppu_active & ~cur, fb_waddr, ppu_video);
-    nes_fb fb1(clk_pixel, video_active, fb_raddr, pixel1, 
-               clk_nes, ppu_clk_edge & ppu_active & cur, fb_waddr, ppu_video);
-    */
-    // No double buffer
     reg [8:0] r_ppu_cycle;
     wire ppu_signal = r_ppu_cycle != ppu_cycle;     // detect new pixel
     always @(posedge clk_nes) begin
         r_ppu_cycle <= ppu_cycle;    
     end
-    
-    wire [5:0] p_pixel;
-    (* ram_style = "registers" *) reg [5:0] pixel;
+
+    // Frame buffering. The PPU writes into buffer wbuf while buffer rbuf is
+    // scanned out. When the PPU finishes a frame (scanline 239, cycle 256),
+    // that buffer becomes the one to show from the start of the next output
+    // frame, so the picture only changes during vertical blanking. The choice
+    // is made at the start of the last line of the output frame, which is
+    // when the scaler loads the first lines of the next one.
+    //   FB_COUNT=1: one buffer, written while shown, tears.
+    //   FB_COUNT=2: PPU flips to the other buffer. Tears only if two NES
+    //               frames finish during the same output frame.
+    //   FB_COUNT=3: PPU moves to the buffer that is neither just finished
+    //               nor shown. Does not tear: PPU only picks it once the
+    //               pixel side has acknowledged the finished frame, so rbuf
+    //               can no longer move to an older one, and together with
+    //               that acknowledgement it sees the current rbuf. This
+    //               takes a few clk_nes cycles, well inside vertical blanking.
+    // See doc/design.md for BRAM usage.
+    wire frame_done = ppu_signal && ppu_scanline == 239 && ppu_cycle == 256;   // last pixel of a frame
+
+    // PPU side, clk_nes domain
+    reg [1:0] wbuf = 0;             // buffer being written
+    reg [1:0] rbuf = 0;             // buffer being shown, clk_pixel domain
+    reg [1:0] done_buf = 0;         // last finished frame
+    reg done_toggle = 0;            // flips when a frame is finished
+    reg picking = 0;                // frame finished, waiting for the acknowledgement
+    wire done_ack;                  // from the scan-out side
+    reg [2:0] ack_s1 = 0, ack_s2 = 0, ack_nes = 0;     // {done_ack, rbuf}, synced to clk_nes
+    wire [1:0] rbuf_nes = ack_nes[1:0];
+    wire [1:0] next_wbuf = FB_COUNT == 1 ? 2'd0 :
+                           FB_COUNT == 2 ? {1'b0, ~wbuf[0]} :
+                           wbuf != rbuf_nes ? 2'd3 - wbuf - rbuf_nes :     // the third one
+                           wbuf == 2 ? 2'd0 : wbuf + 1;
+    always @(posedge clk_nes) begin
+        ack_s1 <= {done_ack, rbuf};
+        ack_s2 <= ack_s1;
+        if (ack_s1 == ack_s2)       // 3 bits, only take settled values
+            ack_nes <= ack_s2;
+        if (frame_done) begin
+            done_buf <= wbuf;
+            done_toggle <= ~done_toggle;
+            if (FB_COUNT == 3)
+                picking <= 1;
+            else
+                wbuf <= next_wbuf;
+        end else if (picking && ack_nes[2] == done_toggle) begin
+            wbuf <= next_wbuf;
+            picking <= 0;
+        end
+    end
+
+    // Scan-out side, clk_pixel domain
+    reg [1:0] ready_buf = 0;        // finished frame waiting to be shown
+    reg ready = 0;
+    reg [2:0] done_sync = 0;        // done_toggle synced, [2] is the previous value
+    wire done_event = done_sync[2] != done_sync[1];
+    assign done_ack = done_sync[2]; // ready_buf has the frame, rbuf cannot go back to an older one
+    wire frame_next = sx == 0 && sy == screen_end;  // last line, next frame is set up
+    reg frame_next_d = 0;           // cur_timing is the next frame's now
+    always @(posedge clk_pixel) begin
+        done_sync <= {done_sync[1:0], done_toggle};
+        if (done_event)
+            ready_buf <= done_buf;  // done_buf settled before done_toggle got through
+        if (frame_next) begin
+            if (ready)
+                rbuf <= ready_buf;
+            ready <= done_event;
+        end else if (done_event)
+            ready <= 1;
+        if (rst_pixel) begin
+            rbuf <= 0;
+            ready <= 0;
+        end
+    end
+
+    always @(posedge clk_pixel) begin
+        timing_s1 <= timing;
+        timing_s2 <= timing_s1;
+        if ((frame_next || rst_pixel) && timing_s1 == timing_s2)    // 2 bits, only take settled values
+            cur_timing <= timing_s2;
+        frame_next_d <= frame_next;
+    end
+
+    // Genlock control, see top. Decided when a NES frame ends, applied to the
+    // current output frame. Early/late by more than VADJ is corrected over
+    // several frames, then locked is set.
+    reg [1:0] genlock_sync = 0;
+    reg got_done = 0;               // a NES frame ended during this output frame
+    wire done_late = sy > LOCK_LINE || sy + LOCK_HALF < LOCK_LINE;
+    wire [11:0] done_err = sy > LOCK_LINE ? sy - LOCK_LINE :
+                           done_late ? VADJ : LOCK_LINE - sy;      // lines early or late
+    wire [11:0] done_adj = done_err > VADJ ? VADJ : done_err;
+    always @(posedge clk_pixel) begin
+        genlock_sync <= {genlock_sync[0], genlock};
+        if (sx == LINE && sy == screen_end) begin
+            screen_end <= SCREEN;
+            got_done <= 0;
+            if (!got_done)          // no NES frame, e.g. while loading
+                locked <= 0;
+        end else if (done_event) begin
+            got_done <= 1;
+            if (genlock_sync[1])
+                screen_end <= done_late ? SCREEN + done_adj : SCREEN - done_adj;
+            locked <= genlock_sync[1] && done_err <= VADJ;
+        end
+        if (rst_pixel) begin
+            screen_end <= SCREEN;
+            locked <= 0;
+        end
+    end
+
+    // Scaler. scale[1:0] picks how the 256x240 picture fills the output:
+    //   0: the largest integer scale that fits, 4x (1024x960) at 1080p
+    //   1: all output lines, 4.5x (1152x1080) at 1080p
+    //   2: as 1, with the 8:7 wide pixels of a TV, 1316x1080 at 1080p
+    // and the rest is black bars. Each direction steps through the source with
+    // an exact DDA: acc grows by the source size every output pixel (or line),
+    // and moves on to the next source pixel when it reaches the output size.
+    // So 4.5x is 4, 5, 4, 5... output pixels per source pixel, without drift.
+    // scale[2] shows the last output line of every source line at half
+    // brightness (scanlines). scale[3] (smooth) makes an output pixel that is
+    // partly in two source pixels, or lines, the average of the two, instead
+    // of the first one. Nothing changes at integer scales then.
+    // Mode and filters are taken right after frame_next, so a frame is scaled
+    // one way. The sizes are of each timing:
+    //   0: 3x (768x720) at 720p, 6x (1536x1440) at 1440p
+    //   1: the same as 0 at those, as 720 and 1440 are multiples of 240
+    //   2: 877x720 at 720p, 1755x1440 at 1440p
+    function [47:0] sizes(input [1:0] t);   // {W_INT, H_INT, W_FILL, W_TV}
+        case (t)
+        1:       sizes = {12'd768, 12'd720, 12'd768, 12'd877};
+        2:       sizes = {12'd1536, 12'd1440, 12'd1536, 12'd1755};
+        default: sizes = {12'd1024, 12'd960, 12'd1152, 12'd1316};
+        endcase
+    endfunction
+    wire [11:0] HA = HA_END + 1;
+    wire [11:0] VA = VA_END + 1;
+    wire [11:0] W_INT, H_INT, W_FILL, W_TV;
+    assign {W_INT, H_INT, W_FILL, W_TV} = sizes(cur_timing);
+
+    reg [3:0] scale_s1 = 0, scale_s2 = 0;
+    reg scanlines = 0, smooth = 0;
+    reg [11:0] out_w = 0, out_h = 0;        // scaled picture size
+    reg [11:0] x0 = 0, x1 = 0;              // picture is x0 <= sx < x1
+    reg [11:0] y0 = 0, y1 = 0;
+    wire [11:0] next_w = scale_s2[1:0] == 1 ? W_FILL : scale_s2[1:0] == 2 ? W_TV : W_INT;
+    wire [11:0] next_h = scale_s2[1:0] == 1 || scale_s2[1:0] == 2 ? VA : H_INT;
+    wire y_active = sy >= y0 && sy < y1;
+    wire video_active = sx >= x0 && sx < x1 && y_active;
+
+    reg [7:0] cx = 0;               // source pixel at sx
+    reg [11:0] acc_x = 0;           // where sx starts in it, in 1/out_w
+    reg [7:0] cy = 0;               // source line at sy
+    reg [11:0] acc_y = 0;           // where sy starts in it, in 1/out_h
+    wire x_straddle = acc_x + 256 > out_w;      // sx ends in the next source pixel
+    wire y_straddle = acc_y + 240 > out_h;
+    wire y_last = acc_y + 240 >= out_h;         // last output line of source line cy
+    always @(posedge clk_pixel) begin
+        scale_s1 <= scale;
+        scale_s2 <= scale_s1;
+        if (frame_next_d || rst_pixel) begin
+            if (scale_s1 == scale_s2) begin     // 4 bits, only take settled values
+                scanlines <= scale_s2[2];
+                smooth <= scale_s2[3];
+                out_w <= next_w;
+                out_h <= next_h;
+                x0 <= (HA - next_w) >> 1;
+                x1 <= ((HA - next_w) >> 1) + next_w;
+                y0 <= (VA - next_h) >> 1;
+                y1 <= ((VA - next_h) >> 1) + next_h;
+            end
+            cy <= 0;
+            acc_y <= 0;
+        end else if (sx == LINE && y_active) begin
+            if (y_last) begin
+                cy <= cy + 1;
+                acc_y <= acc_y + 240 - out_h;
+            end else
+                acc_y <= acc_y + 240;
+        end
+        if (sx == LINE) begin
+            cx <= 0;
+            acc_x <= 0;
+        end else if (video_active) begin
+            if (acc_x + 256 >= out_w) begin
+                cx <= cx + 1;
+                acc_x <= acc_x + 256 - out_w;
+            end else
+                acc_x <= acc_x + 256;
+        end
+    end
+
+    // Line buffers. Every source line is read from the framebuffer once, into
+    // line buffer cy[0], while the line before it is being shown, which takes
+    // 256 pixel clocks of the 3 or more output lines it is shown for. So the
+    // line after cy is always there too, for smooth. Lines 0 and 1 are loaded
+    // during the last line of the frame before.
+    wire [17:0] fb_dout;            // 6 bits from each buffer
+    wire [5:0] fb_pixel = rbuf == 2 ? fb_dout[17:12] : rbuf == 1 ? fb_dout[11:6] : fb_dout[5:0];
+    (* ram_style = "distributed" *) reg [5:0] lb [0:511];  // {line[0], x}
+    reg [2:0] lb_emph [0:1];        // emphasis of each line buffer
+    reg [8:0] fill_next = 240;      // next source line to load
+    reg [8:0] fill_until = 0;       // last source line needed so far
+    reg [7:0] fill_line = 0;        // line being loaded
+    reg [7:0] fill_x = 0;
+    reg filling = 0;
+    reg lb_write = 0;               // fb_pixel is the read of the cycle before
+    reg [8:0] lb_waddr = 0;
+
+    // Color emphasis, kept per line rather than per pixel, as it would take
+    // 3 more bits in every framebuffer. Games change it during hblank, if at all.
+    // Taken at the first pixel of every line.
+    reg [2:0] emph [0:4*256-1];     // {buffer, line}
+    always @(posedge clk_nes)
+        if (ppu_signal && ppu_active && ppu_refresh && ppu_cycle == 1)
+            emph[{wbuf, ppu_scanline[7:0]}] <= ppu_emphasis;
+
+    always @(posedge clk_pixel) begin
+        lb_write <= filling;
+        lb_waddr <= {fill_line[0], fill_x};
+        if (lb_write)
+            lb[lb_waddr] <= fb_pixel;
+        if (filling) begin
+            fill_x <= fill_x + 1;
+            if (fill_x == 255)
+                filling <= 0;
+        end else if (fill_next <= fill_until && fill_next < 240) begin
+            filling <= 1;
+            fill_line <= fill_next[7:0];
+            fill_next <= fill_next + 1;
+            lb_emph[fill_next[0]] <= emph[{rbuf, fill_next[7:0]}];
+        end
+        if (frame_next || rst_pixel) begin
+            filling <= 0;
+            fill_next <= 0;
+            fill_until <= 1;
+        end else if (sx == LINE && y_active && y_last)
+            fill_until <= cy + 2;           // cy + 1 is shown next
+    end
+
+    genvar i;
+    generate
+        for (i = 0; i < FB_COUNT; i = i + 1) begin : fb
+            nes_fb fb(clk_pixel, filling && rbuf == i, {fill_line, fill_x}, fb_dout[i*6 +: 6],
+                      clk_nes, ppu_signal & ppu_active & ppu_refresh & wbuf == i, fb_waddr, ppu_video);
+        end
+    endgenerate
+
+    // Palette, 64 colors for each of the 8 emphasis settings, 24-bit RGB.
+    // PS can load another one at any time (commands 11 and 12 of NES_KV260).
+    // There are two copies, for the two lines smooth mixes.
+    (* ram_style = "block" *) reg [23:0] palette [0:511];
+    (* ram_style = "block" *) reg [23:0] palette_next [0:511];
+    integer k;
+    initial
+        for (k = 0; k < 512; k = k + 1) begin
+            palette[k] = emphasize(nes_palette(k[5:0]), k[8:6]);
+            palette_next[k] = emphasize(nes_palette(k[5:0]), k[8:6]);
+        end
+    always @(posedge clk_nes)
+        if (pal_write) begin
+            palette[pal_addr] <= pal_data;
+            palette_next[pal_addr] <= pal_data;
+        end
+
+    // Pixel pipeline, 5 cycles from sx to video:
+    //   1: line buffers of line cy and cy+1 at cx
+    //   2: palette
+    //   3: vertical smooth
+    //   4: wait for the next pixel, to mix with for horizontal smooth
+    //   5: scanlines and black bars, to 'pixel'
+    // f* are the flags that go along: {active, x mix, y mix, scanline}
     reg p_de, p_hsync, p_vsync;
-    nes_fb fb0(clk_pixel, video_active, fb_raddr, p_pixel,
-               clk_nes, ppu_signal & ppu_active & ppu_refresh, fb_waddr, ppu_video);
+    reg [2:0] de_d = 0, hsync_d = 0, vsync_d = 0;
+    reg [8:0] idx, idx_next;        // {emphasis, color}
+    reg [23:0] rgb, rgb_next;
+    reg [23:0] mix_y, mix_y_d;
+    reg [3:0] f1, f2, f3, f4;
+    reg [23:0] pixel;
+    wire [23:0] mix_x = f4[2] ? avg(mix_y_d, mix_y) : mix_y_d;
     always @(posedge clk_pixel) begin
-        // delay all output by one cycle 
-        pixel <= p_pixel;
-        de <= p_de;
-        hsync <= p_hsync;
-        vsync <= p_vsync;
+        idx <= {lb_emph[cy[0]], lb[{cy[0], cx}]};
+        idx_next <= {lb_emph[~cy[0]], lb[{~cy[0], cx}]};
+        f1 <= {video_active, smooth && x_straddle, smooth && y_straddle, scanlines && y_last};
+        rgb <= palette[idx];
+        rgb_next <= palette_next[idx_next];
+        f2 <= f1;
+        mix_y <= f2[1] ? avg(rgb, rgb_next) : rgb;
+        f3 <= f2;
+        mix_y_d <= mix_y;
+        f4 <= f3;
+        pixel <= !f4[3] ? 24'h0 : f4[0] ? half(mix_x) : mix_x;
+
+        de_d <= {de_d[1:0], p_de};
+        hsync_d <= {hsync_d[1:0], p_hsync};
+        vsync_d <= {vsync_d[1:0], p_vsync};
+        de <= de_d[2];
+        hsync <= hsync_d[2];
+        vsync <= vsync_d[2];
     end
 
-    // End no double buffer
+    assign video = {pixel[23:16], 4'b0, pixel[15:8], 4'b0, pixel[7:0], 4'b0};
 
-    wire [23:0] pixel_rgb = video_active ? nes_palette(pixel) : 8'h0f;          // 0x0f is black
-    assign video = {pixel_rgb[23:16], 4'b0, pixel_rgb[15:8], 4'b0, pixel_rgb[7:0], 4'b0};        // fetch video data, will be ready for next cycle
+    function [7:0] avg8(input [7:0] a, input [7:0] b);
+        reg [8:0] s;
+        begin
+            s = a + b;
+            avg8 = s[8:1];
+        end
+    endfunction
+    function [23:0] avg(input [23:0] a, input [23:0] b);
+        avg = {avg8(a[23:16], b[23:16]), avg8(a[15:8], b[15:8]), avg8(a[7:0], b[7:0])};
+    endfunction
+    function [23:0] half(input [23:0] c);
+        half = {1'b0, c[23:17], 1'b0, c[15:9], 1'b0, c[7:1]};
+    endfunction
+
+    // Emphasis darkens the other two components to ~82%, the usual approximation
+    // of what the 2C02 does to the signal: https://www.nesdev.org/wiki/NTSC_video
+    function [7:0] dim(input [7:0] c);
+        dim = (c * 16'd209) >> 8;
+    endfunction
+    function [23:0] emphasize(input [23:0] rgb, input [2:0] e);
+        emphasize = {e[2:1] != 0 ? dim(rgb[23:16]) : rgb[23:16],
+                     {e[2], e[0]} != 0 ? dim(rgb[15:8]) : rgb[15:8],
+                     e[1:0] != 0 ? dim(rgb[7:0]) : rgb[7:0]};
+    endfunction
 
-    // 2C02 palette: https://www.nesdev.org/wiki/PPU_palettes
+    // 2C02 palette (initial contents): https://www.nesdev.org/wiki/PPU_palettes
     function [23:0] nes_palette(input [5:0] p);
       case (p)
       0: nes_palette = 24'h545454;  1: nes_palette = 24'h001e74;  2: nes_palette = 24'h081090;  3: nes_palette = 24'h300088;  4: nes_palette = 24'h440064;  5: nes_palette = 24'h5c0030;  6: nes_palette = 24'h540400;  7: nes_palette = 24'h3c1800;
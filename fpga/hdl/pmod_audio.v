@@ -4,29 +4,68 @@
 // Module is IceSugar PMOD_audio 1.2 (IC: PAM8403)
 // Schematic: https://github.com/wuxx/icesugar/tree/master/schematic
 // Example: https://github.com/wuxx/icesugar/tree/master/src/basic/verilog/music
+//
+// With FILTER=1 (default), the sample is first low-pass filtered and decimated
+// with FirFilter (dsp.v, pass band up to ~13Khz, 55.93Khz out), the one in
+// dp_audio, then turned into a 1-bit stream at the full 21.477Mhz by a
+// 2nd-order sigma-delta modulator.
+// Latching the raw sample every 512 clk aliases the harmonics of the square and
+// noise channels down into the audible band, and the PWM only has 9 bits. The
+// modulator pushes its noise far above 20Khz, where the amplifier and speaker
+// drop it. fpga/sim/audio_test.cpp measures both.
+// FILTER=0 is the original 9-bit PWM at ~42Khz.
 
-module pmod_audio (
+module pmod_audio #(
+    parameter FILTER = 1
+)(
 	input clk,     // 21.477 Mhz
-	input [15:0] sample,       // sampling rate is 21477 / 512 = 42 Khz  
+	input [15:0] sample,       // unsigned, FILTER=0 samples it every 512 clk, 42 Khz
+	input [15:0] fir_out,      // FILTER=1: sample filtered by dp_audio, signed, 0 is silence
+	input fir_now,             // fir_out is valid this clk
 	output [7:0] output_pmod
 //    input wire clk,     // 14 Mhz
 );
 
-reg [8:0] counter = 0;
-reg [15:0] audio_latched = 0;
-reg aud_pwm;
+reg aud_pwm = 0;
 
 assign output_pmod[0] = aud_pwm;
 assign output_pmod[1] = aud_pwm;
 
-always @(posedge clk) begin
-    if (counter == 0)
-        audio_latched <= sample;
-    if (counter < 1 || ({counter,7'b0} < audio_latched && counter < 511) )
-        aud_pwm <= 1;
-    else
-        aud_pwm <= 0;
-    counter <= counter + 1;
-end
+generate if (FILTER) begin
+    // Two integrators with the output fed back into both, each saturating so
+    // the loop recovers from inputs near full scale. The output is +-32768.
+    // Silence is 0, in the middle. The loudest APU output, a full-scale pulse
+    // wave at any pitch, gives fir_out up to ~17K with overshoot, acc1 up to
+    // ~74K and acc2 up to ~142K, so the saturation is only a guard.
+    reg signed [15:0] x = 0;
+    reg signed [17:0] acc1 = 0;
+    reg signed [19:0] acc2 = 0;
+    wire signed [17:0] y = acc2[19] ? -18'sd32768 : 18'sd32768;
+    wire signed [18:0] s1 = acc1 + x - y;
+    wire signed [17:0] n1 = s1[18] != s1[17] ? {s1[18], {17{~s1[18]}}} : s1[17:0];
+    wire signed [20:0] s2 = acc2 + n1 - y;
+    wire signed [19:0] n2 = s2[20] != s2[19] ? {s2[20], {19{~s2[20]}}} : s2[19:0];
+
+    always @(posedge clk) begin
+        if (fir_now)                // fir_out is only valid now
+            x <= fir_out;
+        acc1 <= n1;
+        acc2 <= n2;
+        aud_pwm <= !acc2[19];
+    end
+end else begin
+    reg [8:0] counter = 0;
+    reg [15:0] audio_latched = 0;
+
+    always @(posedge clk) begin
+        if (counter == 0)
+            audio_latched <= sample;
+        if (counter < 1 || ({counter,7'b0} < audio_latched && counter < 511) )
+            aud_pwm <= 1;
+        else
+            aud_pwm <= 0;
+        counter <= counter + 1;
+    end
+end endgenerate
 
-endmodule
\ No newline at end of file
+endmodule
@@ -11,7 +11,8 @@ module LoopyGen(input clk, input ce,
                 input is_pre_render, // Is this the pre-render scanline
                 input [8:0] cycle,
                 output [14:0] loopy,
-                output [2:0] fine_x_scroll);  // Current loopy value
+                output [2:0] fine_x_scroll,  // Current loopy value
+                input ss_shift, input ss_in, output ss_out);
   // Controls how much to increment on each write
   reg ppu_incr; // 0 = 1, 1 = 32
   // Current VRAM address
@@ -30,7 +31,9 @@ module LoopyGen(input clk, input ce,
     ppu_address_latch = 0;  
   end
   // Handle updating loopy_t and loopy_v
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {ppu_incr, loopy_v, loopy_t, loopy_x, ppu_address_latch} <= {ppu_incr, loopy_v, loopy_t, loopy_x, ppu_address_latch, ss_in};
+  end else if (ce) begin
     if (is_rendering) begin
       // Increment course X scroll right after attribute table byte was fetched.
       if (cycle[2:0] == 3 && (cycle < 256 || cycle >= 320 && cycle < 336)) begin
@@ -92,6 +95,7 @@ module LoopyGen(input clk, input ce,
   end
   assign loopy = loopy_v;
   assign fine_x_scroll = loopy_x;
+  assign ss_out = ppu_incr;
 endmodule
   
   
@@ -105,7 +109,8 @@ module ClockGen(input clk, input ce, input reset,
                 output at_last_cycle_group,
                 output exiting_vblank,
                 output entering_vblank,
-                output reg is_pre_render);
+                output reg is_pre_render,
+                input ss_shift, input ss_in, output ss_out);
   reg second_frame;
   
   // Scanline 0..239 = picture scan lines
@@ -122,7 +127,9 @@ module ClockGen(input clk, input ce, input reset,
   // New value for is_in_vblank flag
   wire new_is_in_vblank = entering_vblank ? 1'b1 : exiting_vblank ? 1'b0 : is_in_vblank;
   // Set if the current line is line 0..239
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {cycle, is_in_vblank} <= {cycle, is_in_vblank, ss_in};
+  end else if (reset) begin
     cycle <= 0;
     is_in_vblank <= 1;
   end else if (ce) begin
@@ -133,7 +140,9 @@ module ClockGen(input clk, input ce, input reset,
 //    $write("%x %x %x %x %x\n", new_is_in_vblank, entering_vblank, exiting_vblank, is_in_vblank, entering_vblank ? 1'b1 : exiting_vblank ? 1'b0 : is_in_vblank);
     
 //  end
-  always @(posedge clk) if (reset) begin
+  always @(posedge clk) if (ss_shift) begin
+    {scanline, is_pre_render, second_frame} <= {scanline, is_pre_render, second_frame, cycle[8]};
+  end else if (reset) begin
     scanline <= 0;
     is_pre_render <= 0;
     second_frame <= 0;
@@ -146,6 +155,7 @@ module ClockGen(input clk, input ce, input reset,
     if (exiting_vblank)
       second_frame <= !second_frame;
   end
+  assign ss_out = scanline[8];
   
 endmodule // ClockGen
 
@@ -155,13 +165,16 @@ module Sprite(input clk, input ce,
               input [3:0] load, 
               input [26:0] load_in,
               output [26:0] load_out,
-              output [4:0] bits); // Low 4 bits = pixel, high bit = prio
+              output [4:0] bits, // Low 4 bits = pixel, high bit = prio
+              input ss_shift, input ss_in, output ss_out);
   reg [1:0] upper_color; // Upper 2 bits of color
   reg [7:0] x_coord;     // X coordinate where we want things
   reg [7:0] pix1, pix2;  // Shift registers, output when x_coord == 0
   reg aprio;             // Current prio
   wire active = (x_coord == 0);
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {upper_color, x_coord, pix1, pix2, aprio} <= {upper_color, x_coord, pix1, pix2, aprio, ss_in};
+  end else if (ce) begin
     if (enable) begin
       if (!active) begin
         // Decrease until x_coord is zero.
@@ -178,6 +191,7 @@ module Sprite(input clk, input ce,
   end
   assign bits = {aprio, upper_color, active && pix2[0], active && pix1[0]};
   assign load_out = {pix1, pix2, x_coord, upper_color, aprio};
+  assign ss_out = upper_color[1];
 endmodule  // SpriteGen
 					
 // This contains all 8 sprites. Will return the pixel value of the highest prioritized sprite.
@@ -189,18 +203,20 @@ module SpriteSet(input clk, input ce,   // Input clock
                  input [3:0] load,      // Which parts of the state to load/shift.
                  input [26:0] load_in,  // State to load with 
                  output [4:0] bits,     // Output bits
-                 output is_sprite0);    // Set to true if sprite #0 was output
+                 output is_sprite0,     // Set to true if sprite #0 was output
+                 input ss_shift, input ss_in, output ss_out);
 
   wire [26:0] load_out7, load_out6, load_out5, load_out4, load_out3, load_out2, load_out1, load_out0; 
   wire [4:0] bits7, bits6, bits5, bits4, bits3, bits2, bits1, bits0;
-  Sprite sprite7(clk, ce, enable, load, load_in,   load_out7, bits7);
-  Sprite sprite6(clk, ce, enable, load, load_out7, load_out6, bits6);
-  Sprite sprite5(clk, ce, enable, load, load_out6, load_out5, bits5);
-  Sprite sprite4(clk, ce, enable, load, load_out5, load_out4, bits4);
-  Sprite sprite3(clk, ce, enable, load, load_out4, load_out3, bits3);
-  Sprite sprite2(clk, ce, enable, load, load_out3, load_out2, bits2);
-  Sprite sprite1(clk, ce, enable, load, load_out2, load_out1, bits1);
-  Sprite sprite0(clk, ce, enable, load, load_out1, load_out0, bits0);          
+  wire ss7, ss6, ss5, ss4, ss3, ss2, ss1;
+  Sprite sprite7(clk, ce, enable, load, load_in,   load_out7, bits7, ss_shift, ss_in, ss7);
+  Sprite sprite6(clk, ce, enable, load, load_out7, load_out6, bits6, ss_shift, ss7, ss6);
+  Sprite sprite5(clk, ce, enable, load, load_out6, load_out5, bits5, ss_shift, ss6, ss5);
+  Sprite sprite4(clk, ce, enable, load, load_out5, load_out4, bits4, ss_shift, ss5, ss4);
+  Sprite sprite3(clk, ce, enable, load, load_out4, load_out3, bits3, ss_shift, ss4, ss3);
+  Sprite sprite2(clk, ce, enable, load, load_out3, load_out2, bits2, ss_shift, ss3, ss2);
+  Sprite sprite1(clk, ce, enable, load, load_out2, load_out1, bits1, ss_shift, ss2, ss1);
+  Sprite sprite0(clk, ce, enable, load, load_out1, load_out0, bits0, ss_shift, ss1, ss_out);          
   // Determine which sprite is visible on this pixel.
   assign bits = bits0[1:0] != 0 ? bits0 : 
                 bits1[1:0] != 0 ? bits1 : 
@@ -225,7 +241,11 @@ module SpriteRAM(input clk, input ce,
                  input oam_load,            // Load oam_ptr with specified value, when writing to NES $2004.
                  input [7:0] data_in,       // New value for oam or oam_ptr
                  output reg spr_overflow,   // Set to true if we had more than 8 objects on a scan line. Reset when exiting vblank.
-                 output reg sprite0);       // True if sprite#0 is included on the scan line currently being painted.
+                 output reg sprite0,        // True if sprite#0 is included on the scan line currently being painted.
+                 output overflow_hit,       // One clk for each object found after the 8th, for the performance counters.
+                 input ss_shift, input ss_in, output ss_out,
+                 input [8:0] ss_addr,       // oam at $000-$0ff, sprtemp at $100-$11f
+                 input ss_write, input [7:0] ss_din, output [7:0] ss_dout);
   reg [7:0] sprtemp[0:31];   // Sprite Temporary Memory. 32 bytes.
   reg [7:0] oam[0:255];      // Sprite OAM. 256 bytes.
   reg [7:0] oam_ptr;         // Pointer into oam_ptr.
@@ -237,6 +257,7 @@ module SpriteRAM(input clk, input ce,
   // Check if the current Y coordinate is inside.
   wire [8:0] spr_y_coord = scanline - {1'b0, oam_data};
   wire spr_is_inside = (spr_y_coord[8:4] == 0) && (obj_size || spr_y_coord[3] == 0);
+  assign overflow_hit = ce && sprites_enabled && state == 2'b11 && spr_is_inside;
   reg [7:0] new_oam_ptr;     // [wire] New value for oam ptr
   reg [1:0] oam_inc;         // [wire] How much to increment oam ptr
   reg sprite0_curr;          // If sprite0 is included on the line being processed.
@@ -281,7 +302,15 @@ module SpriteRAM(input clk, input ce,
     new_oam_ptr[1:0] = oam_ptr[1:0] + {1'b0, oam_inc[0]};
     {oam_wrapped, new_oam_ptr[7:2]} = {1'b0, oam_ptr[7:2]} + {6'b0, oam_inc[1]};
   end
-  always @(posedge clk) if (ce) begin
+  assign ss_dout = ss_addr[8] ? sprtemp[ss_addr[4:0]] : oam[ss_addr[7:0]];
+  always @(posedge clk) if (ss_shift) begin
+    {oam_ptr, p, state, sprite0_curr, sprite0, spr_overflow} <= {oam_ptr, p, state, sprite0_curr, sprite0, spr_overflow, ss_in};
+  end else if (ss_write) begin
+    if (ss_addr[8])
+      sprtemp[ss_addr[4:0]] <= ss_din;
+    else
+      oam[ss_addr[7:0]] <= ss_din;
+  end else if (ce) begin
      
     // Some bits of the OAM are hardwired to zero.
     if (oam_load)
@@ -290,7 +319,7 @@ module SpriteRAM(input clk, input ce,
       oam_ptr <= oam_ptr_load ? data_in : new_oam_ptr;
     end
     // Set overflow flag?
-    if (sprites_enabled && state == 2'b11 && spr_is_inside)
+    if (overflow_hit)
       spr_overflow <= 1;
     // Remember if sprite0 is included on the scanline, needed for hit test later.
     sprite0_curr <= (state == 2'b01 && oam_ptr[7:2] == 0 && spr_is_inside || sprite0_curr);
@@ -327,6 +356,7 @@ module SpriteRAM(input clk, input ce,
     if (exiting_vblank)
       spr_overflow <= 0;
   end
+  assign ss_out = oam_ptr[7];
 endmodule  // SpriteRAM
 
 
@@ -342,7 +372,8 @@ module SpriteAddressGen(input clk, input ce,
                         output [12:0] vram_addr,// Low bits of address in VRAM that we'd like to read.
                         input [7:0] vram_data,  // Byte of VRAM in the specified address
                         output [3:0] load,      // Which subset of load_in that is now valid, will be loaded into SpritesGen.
-                        output [26:0] load_in); // Bits to load into SpritesGen.
+                        output [26:0] load_in,  // Bits to load into SpritesGen.
+                        input ss_shift, input ss_in, output ss_out);
   reg [7:0] temp_tile;    // Holds the tile that we will get
   reg [3:0] temp_y;       // Holds the Y coord (will be swapped based on FlipY).
   reg flip_x, flip_y;     // If incoming bitmap data needs to be flipped in the X or Y direction.
@@ -368,7 +399,9 @@ module SpriteAddressGen(input clk, input ce,
   // selected pattern.
   assign vram_addr = {obj_size ? temp_tile[0] : obj_patt, 
                       temp_tile[7:1], obj_size ? y_f[3] : temp_tile[0], cycle[1], y_f[2:0] };
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {temp_tile, temp_y, flip_x, flip_y, dummy_sprite} <= {temp_tile, temp_y, flip_x, flip_y, dummy_sprite, ss_in};
+  end else if (ce) begin
     if (load_y) temp_y <= temp[3:0];
     if (load_tile) temp_tile <= temp;
     if (load_attr) {flip_y, flip_x, dummy_sprite} <= {temp[7:6], temp[4]};
@@ -381,6 +414,7 @@ module SpriteAddressGen(input clk, input ce,
 //    if (valid_sprite && enabled)
 //      $write("%d. Found %d. Flip:%d%d, Addr: %x, Vram: %x!\n", cycle, temp, flip_x, flip_y, vram_addr, vram_data);
 //  end
+  assign ss_out = temp_tile[7];
 
 endmodule  // SpriteAddressGen
 
@@ -391,7 +425,8 @@ module BgPainter(input clk, input ce,
                  input [14:0] loopy,
                  output [7:0] name_table,  // VRAM name table to read next.
                  input [7:0] vram_data,
-                 output [3:0] pixel);
+                 output [3:0] pixel,
+                 input ss_shift, input ss_in, output ss_out);
   reg [15:0] playfield_pipe_1; // Name table pixel pipeline #1
   reg [15:0] playfield_pipe_2; // Name table pixel pipeline #2
   reg [8:0]  playfield_pipe_3; // Attribute table pixel pipe #1
@@ -409,7 +444,10 @@ module BgPainter(input clk, input ce,
     current_attribute_table = 0;
     bg0 = 0;
   end
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {playfield_pipe_1, playfield_pipe_2, playfield_pipe_3, playfield_pipe_4, current_name_table, current_attribute_table, bg0} <=
+      {playfield_pipe_1, playfield_pipe_2, playfield_pipe_3, playfield_pipe_4, current_name_table, current_attribute_table, bg0, ss_in};
+  end else if (ce) begin
     case (cycle[2:0])
     1: current_name_table <= vram_data;
     3: current_attribute_table <= (!loopy[1] && !loopy[6]) ? vram_data[1:0] : 
@@ -437,6 +475,7 @@ module BgPainter(input clk, input ce,
   wire [3:0] i = {1'b0, fine_x_scroll};
   assign pixel = {playfield_pipe_4[i], playfield_pipe_3[i],
                   playfield_pipe_2[i], playfield_pipe_1[i]};
+  assign ss_out = playfield_pipe_1[15];
 endmodule  // BgPainter
  
 module PixelMuxer(input [3:0] bg, input [3:0] obj, input obj_prio, output [3:0] out, output is_obj);
@@ -447,7 +486,8 @@ module PixelMuxer(input [3:0] bg, input [3:0] obj, input obj_prio, output [3:0]
 endmodule
  
 
-module PaletteRam(input clk, input ce, input [4:0] addr, input [5:0] din, output [5:0] dout, input write);
+module PaletteRam(input clk, input ce, input [4:0] addr, input [5:0] din, output [5:0] dout, input write,
+                  input [4:0] ss_addr, input ss_write, input [5:0] ss_din, output [5:0] ss_dout);
   reg [5:0] palette [0:31];
   initial begin
      $readmemh("oam_palette.txt", palette);
@@ -455,7 +495,10 @@ module PaletteRam(input clk, input ce, input [4:0] addr, input [5:0] din, output
   // Force read from backdrop channel if reading from any addr 0.
   wire [4:0] addr2 = (addr[1:0] == 0) ? 0 : addr;
   assign dout = palette[addr2];
-  always @(posedge clk) if (ce && write) begin
+  assign ss_dout = palette[ss_addr];
+  always @(posedge clk) if (ss_write) begin
+    palette[ss_addr] <= ss_din;
+  end else if (ce && write) begin
     // Allow writing only to x0
     if (!(addr[3:2] != 0 && addr[1:0] == 0))
       palette[addr2] <= din;
@@ -477,7 +520,13 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
            output [7:0] vram_dout,
            output [8:0] scanline,
            output [8:0] cycle,
-           output [19:0] mapper_ppu_flags);
+           output vblank_start,   // one clk as vblank begins, end of scanline 240
+           output overflow_hit,   // one clk for each object past the 8th on a line
+           output [2:0] emphasis, // color emphasis, $2001 bits 5-7: red, green, blue
+           output [19:0] mapper_ppu_flags,
+           input ss_shift, input ss_in, output ss_out,  // save state chain, see NES
+           input [8:0] ss_mem_addr,       // oam at $000-$0ff, sprtemp at $100-$11f, palette at $120-$13f
+           input ss_mem_write, input [7:0] ss_mem_din, output [7:0] ss_mem_dout);
   // These are stored in control register 0
   reg obj_patt; // Object pattern table
   reg bg_patt;  // Background pattern table
@@ -514,17 +563,21 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
   wire at_last_cycle_group; // At the very last cycle group of the scan line.
   wire exiting_vblank;      // At the very last cycle of the vblank
   wire entering_vblank;     // 
+  assign vblank_start = entering_vblank && ce;
   wire is_pre_render_line;  // True while we're on the pre render scanline
   wire is_rendering = (enable_playfield || enable_objects) && !is_in_vblank && scanline != 240;
   
+  wire ss_clock, ss_loopy, ss_bg, ss_sprite_ram, ss_address_gen, ss_sprite_gen;
   ClockGen clock(clk, ce, reset, is_rendering, scanline, cycle, is_in_vblank, end_of_line, at_last_cycle_group,
-                 exiting_vblank, entering_vblank, is_pre_render_line);
+                 exiting_vblank, entering_vblank, is_pre_render_line,
+                 ss_shift, ss_in, ss_clock);
   
   
   // The loopy module handles updating of the loopy address
   wire [14:0] loopy;
   wire [2:0] fine_x_scroll;
-  LoopyGen loopy0(clk, ce, is_rendering, ain, din, read, write, is_pre_render_line, cycle, loopy, fine_x_scroll);
+  LoopyGen loopy0(clk, ce, is_rendering, ain, din, read, write, is_pre_render_line, cycle, loopy, fine_x_scroll,
+                  ss_shift, ss_clock, ss_loopy);
   // Set to true if the current ppu_addr pointer points into
   // palette ram.
   wire is_pal_address = (loopy[13:8] == 6'b111111);
@@ -532,7 +585,8 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
   // Paints background
   wire [7:0] bg_name_table;
   wire [3:0] bg_pixel_noblank;
-  BgPainter bg_painter(clk, ce, !at_last_cycle_group, cycle[2:0], fine_x_scroll, loopy, bg_name_table, vram_din, bg_pixel_noblank);
+  BgPainter bg_painter(clk, ce, !at_last_cycle_group, cycle[2:0], fine_x_scroll, loopy, bg_name_table, vram_din, bg_pixel_noblank,
+                       ss_shift, ss_loopy, ss_bg);
   
   // Blank out BG in the leftmost 8 pixels?
   wire show_bg_on_pixel = (playfield_clip || (cycle[7:3] != 0)) && enable_playfield;
@@ -543,6 +597,10 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
   wire [7:0] oam_bus;
   wire sprite_overflow;
   wire obj0_on_line;                        // True if sprite#0 is included on the current line
+  wire ss_pal = ss_mem_addr[8] && ss_mem_addr[5];
+  wire [7:0] ss_sprite_dout;
+  wire [5:0] ss_pal_dout;
+  assign ss_mem_dout = ss_pal ? {2'b00, ss_pal_dout} : ss_sprite_dout;
   SpriteRAM sprite_ram(clk, ce,
                        before_line,         // Condition for resetting the sprite line state.
                        is_rendering,        // Condition for enabling sprite ram logic. Check so we're not on 
@@ -554,7 +612,10 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
                        write && (ain == 4), // Write to oam[oam_ptr]
                        din,
                        sprite_overflow,
-                       obj0_on_line);
+                       obj0_on_line,
+                       overflow_hit,
+                       ss_shift, ss_bg, ss_sprite_ram,
+                       ss_mem_addr, ss_mem_write && !ss_pal, ss_mem_din, ss_sprite_dout);
   wire [4:0] obj_pixel_noblank;
   wire [12:0] sprite_vram_addr;
   wire is_obj0_pixel;               // True if obj_pixel originates from sprite0.
@@ -570,16 +631,20 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
                                sprite_vram_addr,          // [out] VRAM Address that we want data from
                                vram_din,                  // [in] Data at the specified address
                                spriteset_load,
-                               spriteset_load_in);        // Which parts of SpriteGen to load
+                               spriteset_load_in,         // Which parts of SpriteGen to load
+                               ss_shift, ss_sprite_ram, ss_address_gen);
   // Between 0..255 (256 cycles), draws pixels.
   // Between 256..319 (64 cycles), will be populated for next line
-  SpriteSet sprite_gen(clk, ce, !cycle[8], spriteset_load, spriteset_load_in, obj_pixel_noblank, is_obj0_pixel);
+  SpriteSet sprite_gen(clk, ce, !cycle[8], spriteset_load, spriteset_load_in, obj_pixel_noblank, is_obj0_pixel,
+                       ss_shift, ss_address_gen, ss_sprite_gen);
   // Blank out obj in the leftmost 8 pixels?    
   wire show_obj_on_pixel = (object_clip || (cycle[7:3] != 0)) && enable_objects;
   wire [4:0] obj_pixel = {obj_pixel_noblank[4:2], show_obj_on_pixel ? obj_pixel_noblank[1:0] : 2'b00};
   
   reg sprite0_hit_bg = 0;            // True if sprite#0 has collided with the BG in the last frame.
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    sprite0_hit_bg <= ss_sprite_gen;
+  end else if (ce) begin
     if (exiting_vblank)
       sprite0_hit_bg <= 0;
     else if (is_rendering &&         // Object rendering is enabled
@@ -623,15 +688,22 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
                          is_rendering ? {pixel_is_obj, pixel[3:0]} : (is_pal_address ? loopy[4:0] : 5'b0000), // Read addr
                          din[5:0], // Value to write
                          color2,    // Output color
-                         write && (ain == 7) && is_pal_address); // Condition for writing
+                         write && (ain == 7) && is_pal_address, // Condition for writing
+                         ss_mem_addr[4:0], ss_mem_write && ss_pal, ss_mem_din[5:0], ss_pal_dout);
   assign color = grayscale ? {color2[5:4], 4'b0} : color2;
+  assign emphasis = color_intensity;
 //  always @(posedge clk)  
 //  if (scanline == 194 && cycle < 8 && color == 15) begin
 //    $write("Pixel black %x %x %x %x %x\n", bg_pixel,obj_pixel,pixel,pixel_is_obj,color);
 //  end
 
  
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    {obj_patt, bg_patt, obj_size, vbl_enable, grayscale, playfield_clip, object_clip,
+     enable_playfield, enable_objects, color_intensity, nmi_occured} <=
+      {obj_patt, bg_patt, obj_size, vbl_enable, grayscale, playfield_clip, object_clip,
+       enable_playfield, enable_objects, color_intensity, nmi_occured, sprite0_hit_bg};
+  end else if (ce) begin
 //    if (!is_in_vblank && write)
 //      $write("%d/%d: $200%d <= %x\n", scanline, cycle, ain, din);
     if (write) begin
@@ -675,11 +747,15 @@ module PPU(input clk, input ce, input reset,   // input clock  21.48 MHz / 4. 1
   // One cycle after vram_r was asserted, the value
   // is available on the bus.
   reg vram_read_delayed = 0;
-  always @(posedge clk) if (ce) begin
+  always @(posedge clk) if (ss_shift) begin
+    vram_latch <= {vram_latch, vram_read_delayed};
+    vram_read_delayed = obj_patt;
+  end else if (ce) begin
     if (vram_read_delayed)
       vram_latch <= vram_din;
     vram_read_delayed = vram_r;
   end
+  assign ss_out = vram_latch[7];
   
   // Value currently being written to video ram
   assign vram_dout = din;
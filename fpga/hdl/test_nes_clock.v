@@ -0,0 +1,162 @@
+`timescale 1ns / 100ps
+
+// Cycle-count regression for NesClock and MemoryController.
+// Checks that at 1x the NES still steps exactly once every 4 clk cycles with
+// memory at cycle #0 and NES at cycle #3, that turbo steps every 2 cycles,
+// that clk_ppu rises once per step in both, and that memory read data is
+// ready by the NES step in both modes. "make clock" in fpga/sim runs it, and
+// stops with an error if anything fails.
+module test_nes_clock;
+
+reg clk = 0;
+always #23 clk = ~clk;      // ~21.47 MHz
+
+reg turbo = 0;
+reg stall = 0;
+wire run_mem, run_nes, clk_ppu;
+NesClock nes_clock(clk, turbo, stall, run_mem, run_nes, clk_ppu);
+
+reg read_a = 0, read_b = 0, write = 0;
+reg [21:0] addr = 0;
+reg [7:0] din = 0;
+wire [7:0] dout_a, dout_b;
+wire busy;
+MemoryController memory(clk, read_a, read_b, write, addr, din, 1'b0, 64'b0, dout_a, dout_b, busy);
+
+integer errors = 0;
+integer cycles, mems, steps, since_mem, ppu_edges;
+reg last_clk_ppu;
+
+task fail(input [8*64-1:0] msg);
+begin
+    $display($time, " FAIL: %0s", msg);
+    errors = errors + 1;
+end
+endtask
+
+// Run n cycles, counting memory slots and NES steps, and check the gap from
+// memory slot to NES step.
+task count(input integer n, input integer gap);
+begin
+    mems = 0;
+    steps = 0;
+    ppu_edges = 0;
+    since_mem = -1;
+    last_clk_ppu = clk_ppu;
+    for (cycles = 0; cycles < n; cycles = cycles + 1) begin
+        @(negedge clk);
+        if (clk_ppu && !last_clk_ppu) begin
+            ppu_edges = ppu_edges + 1;
+            if (!run_nes)
+                fail("clk_ppu rises away from the NES step");
+        end
+        last_clk_ppu = clk_ppu;
+        if (run_mem) begin
+            mems = mems + 1;
+            since_mem = 0;
+        end else if (since_mem >= 0)
+            since_mem = since_mem + 1;
+        if (run_nes) begin
+            steps = steps + 1;
+            if (since_mem >= 0 && since_mem != gap)
+                fail("NES step not at expected distance from memory slot");
+        end
+        if (run_mem && run_nes)
+            fail("memory slot and NES step in same cycle");
+    end
+end
+endtask
+
+// Write one byte through port a
+task mem_write(input [21:0] a, input [7:0] d);
+begin
+    @(negedge clk);
+    addr = a;
+    din = d;
+    write = 1;
+    @(negedge clk);
+    write = 0;
+end
+endtask
+
+// Read through port a in the memory slot, check data at the next NES step,
+// and that it is kept after a read on port b
+task mem_check(input [21:0] a, input [7:0] d);
+begin
+    while (!run_mem) @(negedge clk);
+    addr = a;
+    read_a = 1;
+    @(negedge clk);
+    read_a = 0;
+    while (!run_nes) @(negedge clk);
+    if (dout_a !== d) begin
+        $display($time, " addr %h: expect %h, got %h", a, d, dout_a);
+        fail("memory data not ready at NES step");
+    end
+    addr = 22'h3c_0000;
+    read_b = 1;
+    @(negedge clk);
+    read_b = 0;
+    @(negedge clk);
+    if (dout_a !== d || dout_b !== 8'h11)
+        fail("memory data not kept");
+end
+endtask
+
+initial begin
+    $display($time, " << Starting the Simulation >>");
+    repeat (8) @(negedge clk);
+
+    // 1x: one step every 4 cycles, NES 3 cycles after memory
+    count(4000, 3);
+    if (mems != 1000 || steps != 1000 || ppu_edges != 1000)
+        fail("1x: wrong number of memory slots, steps or clk_ppu edges");
+    $display("1x: %0d cycles, %0d memory slots, %0d NES steps", cycles, mems, steps);
+
+    // 2x: one step every 2 cycles
+    turbo = 1;
+    @(negedge clk);
+    @(negedge clk);
+    count(4000, 1);
+    if (mems != 2000 || steps != 2000 || ppu_edges != 2000)
+        fail("2x: wrong number of memory slots, steps or clk_ppu edges");
+    $display("2x: %0d cycles, %0d memory slots, %0d NES steps", cycles, mems, steps);
+
+    // Back to 1x, exactly as before
+    turbo = 0;
+    repeat (4) @(negedge clk);
+    count(4000, 3);
+    if (mems != 1000 || steps != 1000 || ppu_edges != 1000)
+        fail("back to 1x: wrong number of memory slots, steps or clk_ppu edges");
+
+    // Stall holds the memory slot and no NES step happens
+    while (!run_mem) @(negedge clk);
+    stall = 1;
+    repeat (50) begin
+        @(negedge clk);
+        if (!run_mem || run_nes)
+            fail("stall does not hold at memory slot");
+    end
+    stall = 0;
+
+    // Memory data ready in time, 1x then 2x
+    mem_write(22'h00_1234, 8'h5a);
+    mem_write(22'h00_1235, 8'ha5);
+    mem_write(22'h3c_0000, 8'h11);
+    mem_check(22'h00_1234, 8'h5a);
+    mem_check(22'h00_1235, 8'ha5);
+    turbo = 1;
+    mem_check(22'h00_1234, 8'h5a);
+    mem_check(22'h00_1235, 8'ha5);
+    turbo = 0;
+
+    if (errors == 0)
+        $display("All tests passed.");
+    else begin
+        $display("%0d errors.", errors);
+        $stop;              // exit status for make
+    end
+    $finish;
+end
+
+endmodule
@@ -0,0 +1,318 @@
+// Audio quality test of pmod_audio, built by Verilator from the same RTL as
+// the FPGA (see Makefile), with the filter of dp_audio in front of it as in
+// design_1.tcl (audio_top.v). Plays pulse waves the way an APU pulse channel makes
+// them (50% duty, period 16 * (timer + 1) CPU cycles) at a sweep of pitches
+// through pmod_audio, and decimates its 1-bit output back down to 55.93KHz with
+// a 3rd-order CIC filter, roughly what the speaker and ear do. The spectrum
+// from 100Hz to 12KHz is then split into harmonics of the tone (signal) and
+// everything else (noise and aliasing), and their ratio is the SINAD.
+// The same is done for the 9-bit PWM of a sample every 512 clk that
+// pmod_audio used to be (FILTER=0), modelled here, for comparison.
+// Each pitch is played at the level of one pulse channel, and at the loudest
+// the APU mixer can output, where the modulator must not go unstable.
+//
+// Then the DisplayPort side of dp_audio: a tone goes in, and the test takes
+// the AXI4-Stream at a 74.25MHz pixel clock the way PS live audio does, a
+// frame of 2 subframes at 48KHz of a clock of its own, also 0.5% off either
+// way. After the FIFO level has settled it checks that
+//   - PS never finds the FIFO empty (underrun)
+//   - the tone has no dropped or repeated samples (overrun, or a jump in
+//     the resampling)
+//   - the resampler's output rate, from the pitch of the tone, is PS's rate
+//   - every subframe is right: channel, preamble (with a 192-frame block),
+//     24-bit sample, V/U/C bits, even parity, the same sample in both channels
+// and that nothing comes out while rst_pixel is held, at the start and for a
+// relock of the pixel clock in the middle of the warmup.
+//
+// Exits with 2 if pmod_audio is below MIN_SINAD at any pitch and level, or a
+// DisplayPort check fails.
+//
+// usage: audio_test [-v]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+
+#include "verilated.h"
+#include "Vaudio_top.h"
+
+#define CLK_HZ		21477272
+#define DECIM		384			// CIC decimation, CLK_HZ / 384 = 55.93KHz, FirFilter's rate
+#define POINTS		16384		// samples analysed per tone, 293ms, 3.4Hz bins
+#define WARMUP		64			// samples skipped before, to fill FirFilter
+#define BAND_LO		100.0		// well clear of DC, whose main lobe is 4 bins
+#define BAND_HI		12000.0		// FirFilter is -1dB here
+#define LEVEL		9752		// pulse channel at volume 15, ApuLookupTable
+#define FULL		65534		// all channels at their maximum
+#define MIN_SINAD	70.0		// dB
+
+static const int timers[] = {1015, 507, 253, 169, 126, 84, 63, 41, 31, 20, 15, 10};
+static const int levels[] = {LEVEL, FULL};
+
+#define PIXEL_HZ	74250000.0	// 720p, the slowest pixel clock
+#define PS_HZ		48000.0		// PS live audio rate
+#define TONE_HZ		1000.0
+#define TONE_AMP	8000.0		// of the unsigned sample, FirFilter gets a quarter
+#define DP_RESET	0.001		// seconds rst_pixel is held, at the start and for a relock
+#define DP_WARMUP	0.2			// seconds for the FIFO level to settle, its time constant is ~25ms
+#define DP_RELOCK	(DP_RESET + DP_WARMUP / 2)
+#define DP_SECONDS	0.25		// checked after the warmup
+#define MAX_RATE_ERR	0.001	// resampler output rate against PS's, relative
+#define MAX_STEP	100			// 2nd difference of the tone, ~35 at most, a dropped or repeated sample is ~260
+
+static const double ps_offsets[] = {-0.005, 0, 0.005};	// PS audio clock against ours
+
+// 3rd-order CIC decimator on a stream of +1/-1
+struct Cic {
+	int64_t i1 = 0, i2 = 0, i3 = 0, c1 = 0, c2 = 0, c3 = 0;
+	int n = 0;
+	// Returns true every DECIM bits, with the output in *out, in -1..1
+	bool push(int bit, double *out) {
+		i1 += bit ? 1 : -1;
+		i2 += i1;
+		i3 += i2;
+		if (++n < DECIM)
+			return false;
+		n = 0;
+		int64_t d1 = i3 - c1; c1 = i3;
+		int64_t d2 = d1 - c2; c2 = d1;
+		int64_t d3 = d2 - c3; c3 = d2;
+		*out = (double)d3 / ((double)DECIM * DECIM * DECIM);
+		return true;
+	}
+};
+
+// The old pmod_audio, FILTER=0
+struct Pwm {
+	int counter = 0;
+	int latched = 0;
+	int clock(int sample) {
+		int out = counter < 1 || ((counter << 7) < latched && counter < 511);
+		if (counter == 0)
+			latched = sample;
+		counter = (counter + 1) & 511;
+		return out;
+	}
+};
+
+// SINAD in dB of x (POINTS samples at fs) for a tone at f0, over BAND_LO-BAND_HI,
+// and the frequency and level (dB below signal) of the largest spur.
+// Blackman-Harris window, whose main lobe is 4 bins each side.
+static double sinad(const std::vector<double> &x, double f0, double fs, double *spur_f, double *spur_db) {
+	int n = x.size();
+	std::vector<double> w(n), xw(n);
+	double mean = 0, wsum = 0;
+	for (int i = 0; i < n; i++) {
+		double a = 2 * M_PI * i / (n - 1);
+		w[i] = 0.35875 - 0.48829 * cos(a) + 0.14128 * cos(2 * a) - 0.01168 * cos(3 * a);
+		mean += x[i] * w[i];
+		wsum += w[i];
+	}
+	mean /= wsum;
+	for (int i = 0; i < n; i++)
+		xw[i] = (x[i] - mean) * w[i];
+	double df = fs / n, signal = 0, other = 0, worst = 0, worst_f = 0;
+	for (int k = (int)ceil(BAND_LO / df); k * df <= BAND_HI; k++) {
+		// Goertzel
+		double cf = 2 * cos(2 * M_PI * k / n), s1 = 0, s2 = 0;
+		for (int i = 0; i < n; i++) {
+			double s0 = xw[i] + cf * s1 - s2;
+			s2 = s1;
+			s1 = s0;
+		}
+		double p = s1 * s1 + s2 * s2 - cf * s1 * s2;
+		double f = k * df, h = round(f / f0);
+		if (h >= 1 && fabs(f - h * f0) <= 6 * df) {
+			signal += p;
+		} else {
+			other += p;
+			if (p > worst) {
+				worst = p;
+				worst_f = f;
+			}
+		}
+	}
+	*spur_f = worst_f;
+	*spur_db = other > 0 ? 10 * log10(worst / signal) : -200;
+	return other > 0 ? 10 * log10(signal / other) : 200;
+}
+
+// Take the DisplayPort audio stream with PS's clock off by offset (relative).
+// Returns the number of failed checks.
+static int dp_stream(double offset, int verbose) {
+	Vaudio_top *top = new Vaudio_top;
+	double clk_half = 0.5 / CLK_HZ, pixel_half = 0.5 / PIXEL_HZ;
+	double next_clk = clk_half, next_pixel = pixel_half, now = 0;
+	double ps_rate = PS_HZ * (1 + offset), ps_next = DP_RESET;
+	double end = DP_RESET + DP_WARMUP + DP_SECONDS;
+	int want = 0, chan = 0, block = 0, ch0 = 0, held = 0;
+	long frames = 0, underruns = 0, format = 0, in_reset = 0;
+	std::vector<int> y;
+
+	top->clk = 0;
+	top->clk_pixel = 0;
+	top->rst_pixel = 1;
+	top->m_axis_audio_tready = 0;
+	top->sample = 0;
+	top->eval();
+	while (now < end) {
+		if (next_clk < next_pixel) {
+			now = next_clk;
+			next_clk += clk_half;
+			if (!top->clk)
+				top->sample = (int)(TONE_AMP * (2 + sin(2 * M_PI * TONE_HZ * now)));
+			top->clk = !top->clk;
+			top->eval();
+			continue;
+		}
+		now = next_pixel;
+		next_pixel += pixel_half;
+		top->clk_pixel = !top->clk_pixel;
+		if (!top->clk_pixel) {
+			top->eval();
+			continue;
+		}
+		// Rising edge of clk_pixel: what was there before it is taken. Reset
+		// takes nothing, and starts again at channel 0 of a new block.
+		int checked = now > DP_RESET + DP_WARMUP;
+		if (top->rst_pixel) {
+			if (held && top->m_axis_audio_tvalid)
+				in_reset++;
+			chan = 0;
+			block = 0;
+		} else if (top->m_axis_audio_tvalid && top->m_axis_audio_tready) {
+			uint32_t d = top->m_axis_audio_tdata;
+			int pre = d & 15, s = (int16_t)(d >> 12);
+			int ok = top->m_axis_audio_tid == chan &&
+			         pre == (chan ? 3 : block == 0 ? 1 : 2) &&
+			         (d & 0x00000ff0) == 0 &&				// 24-bit sample, 16 bits used
+			         (d & 0x70000000) == 0 &&				// V, U, C
+			         !__builtin_parity(d >> 4) &&			// even parity over 4-31
+			         (!chan || s == ch0);
+			if (!ok) {
+				if (verbose && format < 4)
+					printf("      frame %ld subframe %d: %08x\n", frames, chan, d);
+				format++;
+			}
+			if (chan) {
+				frames++;
+				block = block == 191 ? 0 : block + 1;
+				if (checked)
+					y.push_back(ch0);
+			}
+			ch0 = s;
+			chan = !chan;
+			want--;
+		}
+		held = top->rst_pixel;
+		top->eval();
+		top->rst_pixel = now < DP_RESET || (now >= DP_RELOCK && now < DP_RELOCK + DP_RESET);
+		// PS asks for a frame at its rate, and the last one should be there by then
+		if (now >= ps_next) {
+			if (want > 0 && checked)
+				underruns++;
+			want = 2;
+			ps_next += 1 / ps_rate;
+		}
+		top->m_axis_audio_tready = want > 0;
+	}
+	top->final();
+	delete top;
+
+	// Pitch of the tone: rising zero crossings, interpolated between samples
+	double mean = 0, first = -1, last = -1;
+	int crossings = 0, step = 0;
+	for (int v : y)
+		mean += v;
+	mean /= y.size() ? y.size() : 1;
+	for (size_t k = 1; k < y.size(); k++) {
+		if (y[k-1] < mean && y[k] >= mean) {
+			double at = k - 1 + (mean - y[k-1]) / (y[k] - y[k-1]);
+			if (first < 0)
+				first = at;
+			last = at;
+			crossings++;
+		}
+		if (k + 1 < y.size() && abs(y[k+1] - 2 * y[k] + y[k-1]) > step)
+			step = abs(y[k+1] - 2 * y[k] + y[k-1]);
+	}
+	double rate = crossings > 1 ? TONE_HZ * (last - first) / (crossings - 1) : 0;
+	double err = rate / ps_rate - 1;
+	int fails = (in_reset > 0) + (underruns > 0) + (format > 0) + (step > MAX_STEP) + (fabs(err) > MAX_RATE_ERR);
+	printf("  PS %+.1f%%: %ld frames, resampler at %.1fHz (%+.3f%%), %ld underruns, largest step %d, "
+	       "%ld bad subframes%s%s\n", offset * 100, frames, rate, err * 100, underruns, step, format,
+	       in_reset ? ", output in reset" : "", fails ? "  FAIL" : "");
+	return fails;
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0, opt;
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: audio_test [-v]\n");
+			return 1;
+		}
+	}
+	Verilated::commandArgs(argc, argv);
+	Vaudio_top *top = new Vaudio_top;
+	top->clk = 0;
+	top->sample = 0;
+	top->clk_pixel = 0;				// the DisplayPort side is idle here
+	top->rst_pixel = 1;
+	top->m_axis_audio_tready = 0;
+	top->eval();
+
+	double fs = (double)CLK_HZ / DECIM;
+	int fails = 0, total = 0;
+	for (int level : levels) {
+		printf("  pitch    old PWM  pmod_audio  (SINAD, %.0f-%.0fHz, level %d)\n", BAND_LO, BAND_HI, level);
+		for (int t : timers) {
+			int period = 192 * (t + 1);		// clk
+			double f0 = (double)CLK_HZ / period;
+			Cic cic_pwm, cic_dut;
+			Pwm pwm;
+			std::vector<double> pwm_out, dut_out;
+			for (uint64_t clk = 0; dut_out.size() < POINTS || pwm_out.size() < POINTS; clk++) {
+				int sample = clk % period < (uint64_t)period / 2 ? level : 0;
+				top->sample = sample;
+				top->clk = 1;
+				top->eval();
+				top->clk = 0;
+				top->eval();
+				double v;
+				if (cic_dut.push(top->output_pmod & 1, &v) && clk >= (uint64_t)WARMUP * DECIM && dut_out.size() < POINTS)
+					dut_out.push_back(v);
+				if (cic_pwm.push(pwm.clock(sample), &v) && clk >= (uint64_t)WARMUP * DECIM && pwm_out.size() < POINTS)
+					pwm_out.push_back(v);
+			}
+			double old_f, old_db, now_f, now_db;
+			double old = sinad(pwm_out, f0, fs, &old_f, &old_db);
+			double now = sinad(dut_out, f0, fs, &now_f, &now_db);
+			printf("%7.0fHz %7.1fdB %9.1fdB%s\n", f0, old, now, now < MIN_SINAD ? "  FAIL" : "");
+			if (verbose)
+				printf("      largest spur: old %.0fHz %.1fdB, pmod_audio %.0fHz %.1fdB\n",
+					old_f, old_db, now_f, now_db);
+			if (now < MIN_SINAD)
+				fails++;
+			total++;
+		}
+	}
+	top->final();
+	delete top;
+	if (fails)
+		printf("%d of %d pitches below %.0fdB\n", fails, total, MIN_SINAD);
+	else
+		printf("All above %.0fdB\n", MIN_SINAD);
+
+	printf("DisplayPort stream, %.0fHz tone, pixel clock %.2fMHz\n", TONE_HZ, PIXEL_HZ / 1e6);
+	int dp_fails = 0;
+	for (double offset : ps_offsets)
+		dp_fails += dp_stream(offset, verbose) > 0;
+	if (dp_fails)
+		printf("%d of %d DisplayPort runs failed\n", dp_fails, (int)(sizeof(ps_offsets) / sizeof(ps_offsets[0])));
+	return fails || dp_fails ? 2 : 0;
+}
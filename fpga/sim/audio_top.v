@@ -0,0 +1,30 @@
+`timescale 1ns / 100ps
+
+// Top module for the audio test (audio_test.cpp). dp_audio and pmod_audio
+// wired as in design_1.tcl: the filter in dp_audio feeds pmod_audio, and the
+// DisplayPort side of dp_audio is driven by the test, in place of PS.
+module audio_top(
+    input clk,
+    input [15:0] sample,        // NES audio, unsigned
+    output [7:0] output_pmod,
+
+    input clk_pixel,
+    input rst_pixel,
+    output [31:0] m_axis_audio_tdata,
+    output m_axis_audio_tid,
+    output m_axis_audio_tvalid,
+    input m_axis_audio_tready
+);
+
+  wire [15:0] fir_out;
+  wire fir_now;
+
+  dp_audio dp_audio(.clk(clk), .sample(sample), .fir_out(fir_out), .fir_now(fir_now),
+                    .clk_pixel(clk_pixel), .rst_pixel(rst_pixel),
+                    .m_axis_audio_tdata(m_axis_audio_tdata), .m_axis_audio_tid(m_axis_audio_tid),
+                    .m_axis_audio_tvalid(m_axis_audio_tvalid), .m_axis_audio_tready(m_axis_audio_tready));
+
+  pmod_audio pmod_audio(.clk(clk), .sample(sample), .fir_out(fir_out), .fir_now(fir_now),
+                        .output_pmod(output_pmod));
+
+endmodule
@@ -0,0 +1,480 @@
+// Headless NES simulator, built by Verilator from the same RTL as the FPGA
+// (see sim_top.v and Makefile). Runs a .nes file for a number of frames,
+// optionally writes the frames as .ppm and the audio as .wav, and reports how
+// many NES frames were emulated per wall-clock second.
+// For regression tests, joypad input can come from a script (-i), and every
+// frame's video and audio are hashed, to be saved (-h) or checked against a
+// golden file (-g), see regress.sh.
+// The whole simulation can be saved to a snapshot at the end of a run (-s) and
+// restored instead of loading a .nes file (-r), so a test can start at frame N
+// without running the frames before it.
+//
+// usage: nes_sim [-n frames] [-p prefix] [-e every] [-a audio.wav] [-t]
+//                [-i input] [-h hashes] [-g golden] [-s snapshot] game.nes
+//        nes_sim [options] -r snapshot
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include "verilated.h"
+#include "verilated_save.h"
+#include "Vsim_top.h"
+
+#define CLK_HZ		21477272	// NES main clock, pl_clk1
+#define NES_FPS		60.0988		// NTSC NES frame rate
+#define CLK_PER_FRAME	(341 * 262 * 4)	// one PPU dot per NES step, every 4 clk
+#define AUDIO_DIV	512			// -a takes a sample every 512 clk, ~42KHz, unfiltered
+#define WIDTH		256
+#define HEIGHT		240
+
+// 2C02 palette, same as nes_dp
+static const uint32_t nes_palette[64] = {
+	0x545454, 0x001e74, 0x081090, 0x300088, 0x440064, 0x5c0030, 0x540400, 0x3c1800,
+	0x202a00, 0x083a00, 0x004000, 0x003c00, 0x00323c, 0x000000, 0x000000, 0x000000,
+	0x989698, 0x084cc4, 0x3032ec, 0x5c1ee4, 0x8814b0, 0xa01464, 0x982220, 0x783c00,
+	0x545a00, 0x287200, 0x087c00, 0x007628, 0x006678, 0x000000, 0x000000, 0x000000,
+	0xeceeec, 0x4c9aec, 0x787cec, 0xb062ec, 0xe454ec, 0xec58b4, 0xec6a64, 0xd48820,
+	0xa0aa00, 0x74c400, 0x4cd020, 0x38cc6c, 0x38b4cc, 0x3c3c3c, 0x000000, 0x000000,
+	0xeceeec, 0xa8ccec, 0xbcbcec, 0xd4b2ec, 0xecaeec, 0xecaed4, 0xecb4b0, 0xe4c490,
+	0xccd278, 0xb4de78, 0xa8e290, 0x98e2b4, 0xa0d6e4, 0xa0a2a0, 0x000000, 0x000000,
+};
+
+// FNV-1a, 64-bit
+#define HASH_INIT	0xcbf29ce484222325ULL
+static uint64_t hash(uint64_t h, const uint8_t *p, size_t len) {
+	while (len--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+	return h;
+}
+
+static Vsim_top *top;
+static uint64_t clks;			// clk cycles since start
+
+static void tick() {
+	top->clk = 1;
+	top->eval();
+	top->clk = 0;
+	top->eval();
+	clks++;
+}
+
+// Write 8 bytes of ROM in one clk, addr is 8-byte aligned
+static void mem_fill(uint32_t addr, const uint8_t *p, size_t len) {
+	uint64_t v = 0;
+	for (size_t i = 0; i < 8 && i < len; i++)
+		v |= (uint64_t)p[i] << (i * 8);
+	top->load_fill = 1;
+	top->load_addr = addr;
+	top->load_fill_data = v;
+	tick();
+	top->load_fill = 0;
+}
+
+static void mem_write(uint32_t addr, uint8_t v) {
+	top->load_write = 1;
+	top->load_addr = addr;
+	top->load_data = v;
+	tick();
+	top->load_write = 0;
+}
+
+// iNES size in 16KB/8KB units -> GameLoader's 3-bit size code
+static int size_code(int n) {
+	int c = 0;
+	while (c < 7 && n > (1 << c))
+		c++;
+	return c;
+}
+
+// Parse a .nes file the same way as GameLoader, and write PRG ROM, CHR ROM
+// and cleared internal RAM/VRAM into memory.
+// Return mapper flags, or -1 if the file is not usable.
+static int64_t load_ines(const char *fname) {
+	FILE *f = fopen(fname, "rb");
+	if (!f) {
+		perror(fname);
+		return -1;
+	}
+	std::vector<uint8_t> ines;
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		ines.insert(ines.end(), buf, buf + n);
+	fclose(f);
+
+	if (ines.size() < 16 || memcmp(&ines[0], "NES\x1a", 4) != 0) {
+		fprintf(stderr, "%s: not an iNES file\n", fname);
+		return -1;
+	}
+	if (ines[6] & 0xc) {
+		fprintf(stderr, "%s: trainer and four-screen VRAM are not supported\n", fname);
+		return -1;
+	}
+	int prgrom = ines[4], chrrom = ines[5];
+	size_t prg_len = prgrom * 16384, chr_len = chrrom * 8192;
+	if (ines.size() < 16 + prg_len + chr_len) {
+		fprintf(stderr, "%s: file too short\n", fname);
+		return -1;
+	}
+	if (prg_len > 0x200000 || chr_len > 0x100000) {
+		fprintf(stderr, "%s: ROM too large\n", fname);
+		return -1;
+	}
+
+	const uint8_t *p = &ines[16];
+	for (size_t i = 0; i < prg_len; i += 8)
+		mem_fill(i, p + i, prg_len - i);
+	p += prg_len;
+	for (size_t i = 0; i < chr_len; i += 8)
+		mem_fill(0x200000 + i, p + i, chr_len - i);
+	for (int i = 0; i < 2048; i++) {
+		mem_write(0x380000 + i, 0);	// internal RAM
+		mem_write(0x300000 + i, 0);	// VRAM
+	}
+
+	int mapper = (ines[7] & 0xf0) | ines[6] >> 4;
+	return (chrrom == 0) << 15 | (ines[6] & 1) << 14 |
+		size_code(chrrom) << 11 | size_code(prgrom) << 8 | mapper;
+}
+
+static int write_ppm(const char *fname, const uint8_t *fb) {
+	FILE *f = fopen(fname, "wb");
+	if (!f) {
+		perror(fname);
+		return 1;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", WIDTH, HEIGHT);
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		uint32_t c = nes_palette[fb[i] & 0x3f];
+		uint8_t rgb[3] = {(uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c};
+		fwrite(rgb, 1, 3, f);
+	}
+	fclose(f);
+	return 0;
+}
+
+static void put32(FILE *f, uint32_t v) {
+	uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+	fwrite(b, 1, 4, f);
+}
+
+static void put16(FILE *f, uint16_t v) {
+	uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+	fwrite(b, 1, 2, f);
+}
+
+// 16-bit mono .wav. NES samples are unsigned, shift them to signed.
+static int write_wav(const char *fname, const std::vector<uint16_t> &audio) {
+	FILE *f = fopen(fname, "wb");
+	if (!f) {
+		perror(fname);
+		return 1;
+	}
+	uint32_t rate = CLK_HZ / AUDIO_DIV;
+	uint32_t len = audio.size() * 2;
+	fwrite("RIFF", 1, 4, f);
+	put32(f, 36 + len);
+	fwrite("WAVEfmt ", 1, 8, f);
+	put32(f, 16);
+	put16(f, 1);			// PCM
+	put16(f, 1);			// mono
+	put32(f, rate);
+	put32(f, rate * 2);
+	put16(f, 2);
+	put16(f, 16);
+	fwrite("data", 1, 4, f);
+	put32(f, len);
+	for (uint16_t s : audio)
+		put16(f, s ^ 0x8000);
+	fclose(f);
+	return 0;
+}
+
+// Joypad input script, one line for every change:
+//   frame btn [btn_2]
+// Buttons are hex, same bits as the controller command (0 - A, 1 - B,
+// 2 - Select, 3 - Start, 4 - Up, 5 - Down, 6 - Left, 7 - Right), and take
+// effect from the start of that frame. '#' starts a comment.
+struct Input {
+	int frame;
+	uint8_t btn, btn_2;
+};
+
+static int read_input(const char *fname, std::vector<Input> &input) {
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		perror(fname);
+		return 1;
+	}
+	char line[256];
+	int n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		char *c = strchr(line, '#');
+		if (c)
+			*c = 0;
+		Input in = {0, 0, 0};
+		unsigned btn = 0, btn_2 = 0;
+		int k = sscanf(line, "%d %x %x", &in.frame, &btn, &btn_2);
+		if (k <= 0)
+			continue;
+		if (k < 2 || (!input.empty() && in.frame < input.back().frame)) {
+			fprintf(stderr, "%s:%d: bad input line\n", fname, n);
+			fclose(f);
+			return 1;
+		}
+		in.btn = btn;
+		in.btn_2 = btn_2;
+		input.push_back(in);
+	}
+	fclose(f);
+	return 0;
+}
+
+// Frame hashes, one line per frame:
+//   frame video_hash audio_hash
+struct Hash {
+	uint64_t video, audio;
+};
+
+static int read_hashes(const char *fname, std::vector<Hash> &hashes) {
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		perror(fname);
+		return 1;
+	}
+	int frame;
+	unsigned long long video, audio;
+	while (fscanf(f, "%d %llx %llx", &frame, &video, &audio) == 3) {
+		if (frame != (int)hashes.size()) {
+			fprintf(stderr, "%s: frame %d out of order\n", fname, frame);
+			fclose(f);
+			return 1;
+		}
+		hashes.push_back({video, audio});
+	}
+	fclose(f);
+	return 0;
+}
+
+// Snapshot: nes_sim's own state, then the Verilator model (built with
+// --savable), which includes all of UltraRAM and NesRam.
+#define SNAPSHOT_MAGIC	0x4e455331	// "NES1"
+struct Snapshot {
+	uint32_t magic;
+	uint32_t mapper_flags;
+	int32_t frame;			// frames done, the snapshot is taken at the end of a frame
+	int32_t last_cycle;
+	uint64_t clks;
+};
+
+static int save_snapshot(const char *fname, const Snapshot &snap) {
+	VerilatedSave os;
+	os.open(fname);
+	if (!os.isOpen()) {
+		perror(fname);
+		return 1;
+	}
+	os.write(&snap, sizeof(snap));
+	os << *top;
+	os.close();
+	return 0;
+}
+
+static int restore_snapshot(const char *fname, Snapshot &snap) {
+	VerilatedRestore is;
+	is.open(fname);
+	if (!is.isOpen()) {
+		perror(fname);
+		return 1;
+	}
+	is.read(&snap, sizeof(snap));
+	if (snap.magic != SNAPSHOT_MAGIC) {
+		fprintf(stderr, "%s: not a snapshot\n", fname);
+		return 1;
+	}
+	is >> *top;
+	is.close();
+	return 0;
+}
+
+static void usage() {
+	fprintf(stderr,
+		"usage: nes_sim [options] game.nes\n"
+		"  -n N       run N frames (default 60)\n"
+		"  -p PREFIX  write frames to PREFIX0000.ppm, PREFIX0001.ppm, ...\n"
+		"  -e K       with -p, only write every K-th frame (default 1)\n"
+		"  -a FILE    write audio to FILE (.wav, 16-bit mono, %dHz)\n"
+		"  -t         turbo, NES steps every 2 clk cycles instead of 4\n"
+		"  -i FILE    joypad input script\n"
+		"  -h FILE    write video/audio hash of every frame to FILE\n"
+		"  -g FILE    check frame hashes against FILE, exit with 2 if different\n"
+		"  -s FILE    save a snapshot to FILE after the last frame\n"
+		"  -r FILE    start from snapshot FILE instead of a .nes file\n",
+		CLK_HZ / AUDIO_DIV);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	int frames = 60, every = 1, turbo = 0;
+	const char *prefix = NULL, *wav = NULL, *hash_file = NULL;
+	const char *save = NULL, *restore = NULL;
+	std::vector<Input> input;
+	std::vector<Hash> golden;
+	int check = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:p:e:a:ti:h:g:s:r:")) != -1) {
+		switch (opt) {
+		case 'n': frames = atoi(optarg); break;
+		case 'p': prefix = optarg; break;
+		case 'e': every = atoi(optarg); break;
+		case 'a': wav = optarg; break;
+		case 't': turbo = 1; break;
+		case 'i':
+			if (read_input(optarg, input))
+				return 1;
+			break;
+		case 'h': hash_file = optarg; break;
+		case 'g':
+			if (read_hashes(optarg, golden))
+				return 1;
+			check = 1;
+			break;
+		case 's': save = optarg; break;
+		case 'r': restore = optarg; break;
+		default: usage();
+		}
+	}
+	if (optind != argc - (restore ? 0 : 1) || frames <= 0 || every <= 0)
+		usage();
+	FILE *hf = NULL;
+	if (hash_file && !(hf = fopen(hash_file, "w"))) {
+		perror(hash_file);
+		return 1;
+	}
+
+	Verilated::commandArgs(argc, argv);
+	top = new Vsim_top;
+	top->reset = 1;
+	top->turbo = turbo;
+	top->btn = 0;
+	top->btn_2 = 0;
+	top->load_write = 0;
+	top->load_fill = 0;
+	top->clk = 0;
+	top->eval();
+
+	Snapshot snap = {SNAPSHOT_MAGIC, 0, 0, -1, 0};
+	if (restore) {
+		if (restore_snapshot(restore, snap))
+			return 1;
+		top->turbo = turbo;
+		clks = snap.clks;
+		printf("Restored %s at frame %d\n", restore, snap.frame);
+	} else {
+		int64_t mapper_flags = load_ines(argv[optind]);
+		if (mapper_flags < 0)
+			return 1;
+		snap.mapper_flags = mapper_flags;
+		top->mapper_flags = mapper_flags;
+		printf("Loaded %s, mapper flags %05x\n", argv[optind], (unsigned)mapper_flags);
+		for (int i = 0; i < 8; i++)
+			tick();
+		top->reset = 0;
+	}
+	// Frame numbers count from the start of the game, also after a restore
+	int end_frame = snap.frame + frames;
+	if (check && (int)golden.size() < end_frame) {
+		fprintf(stderr, "Golden file has only %d frames\n", (int)golden.size());
+		return 1;
+	}
+
+	// Capture pixels the way nes_dp does: a new PPU cycle in the visible area
+	// is a pixel, and scanline 239 cycle 256 ends the frame.
+	// The audio hash covers the sample at every clk cycle, not just the ones
+	// that are played, so golden files are for 1x only.
+	static uint8_t fb[WIDTH * HEIGHT];
+	std::vector<uint16_t> audio;
+	int first = snap.frame;			// snap.frame is overwritten by -s below
+	int frame = first, last_cycle = snap.last_cycle, mismatches = 0;
+	size_t next_input = 0;
+	uint64_t audio_hash = HASH_INIT;
+	uint64_t start_clks = clks, frame_clks = clks;
+	auto start = std::chrono::steady_clock::now();
+	while (frame < end_frame) {
+		if (next_input < input.size() && input[next_input].frame <= frame) {
+			top->btn = input[next_input].btn;
+			top->btn_2 = input[next_input].btn_2;
+			next_input++;
+			continue;
+		}
+		tick();
+		uint16_t sample = top->sample;
+		uint8_t s[2] = {(uint8_t)sample, (uint8_t)(sample >> 8)};
+		audio_hash = hash(audio_hash, s, 2);
+		if (wav && clks % AUDIO_DIV == 0)
+			audio.push_back(sample);
+		int cycle = top->cycle, scanline = top->scanline;
+		if (cycle != last_cycle) {
+			last_cycle = cycle;
+			if (scanline <= 239 && cycle >= 1 && cycle <= 256)
+				fb[scanline * WIDTH + cycle - 1] = top->color;
+			if (scanline == 239 && cycle == 256) {
+				if (prefix && frame % every == 0) {
+					char fname[1024];
+					snprintf(fname, sizeof(fname), "%s%04d.ppm", prefix, frame);
+					if (write_ppm(fname, fb))
+						return 1;
+				}
+				uint64_t video_hash = hash(HASH_INIT, fb, sizeof(fb));
+				if (hf)
+					fprintf(hf, "%d %016llx %016llx\n", frame,
+						(unsigned long long)video_hash, (unsigned long long)audio_hash);
+				if (check && (video_hash != golden[frame].video || audio_hash != golden[frame].audio)) {
+					if (mismatches++ == 0)
+						printf("Frame %d differs from golden:%s%s\n", frame,
+							video_hash != golden[frame].video ? " video" : "",
+							audio_hash != golden[frame].audio ? " audio" : "");
+				}
+				audio_hash = HASH_INIT;
+				frame++;
+				frame_clks = clks;
+			}
+		}
+		if (clks - frame_clks > 4 * CLK_PER_FRAME) {
+			fprintf(stderr, "No frame from PPU after %llu cycles, stopping\n",
+				(unsigned long long)(clks - frame_clks));
+			return 1;
+		}
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double fps = (frame - first) / secs;
+
+	if (wav && write_wav(wav, audio))
+		return 1;
+	if (hf)
+		fclose(hf);
+	if (save) {
+		snap.frame = frame;
+		snap.last_cycle = last_cycle;
+		snap.clks = clks;
+		if (save_snapshot(save, snap))
+			return 1;
+	}
+
+	printf("%d frames, %llu clk cycles in %.2fs\n", frame - first, (unsigned long long)(clks - start_clks), secs);
+	printf("%.2f frames/s (%.1f%% of real time), %.2fM clk/s\n",
+		fps, 100 * fps / NES_FPS, (clks - start_clks) / secs / 1e6);
+
+	if (check)
+		printf("%s: %d of %d frames differ from golden\n",
+			mismatches ? "FAIL" : "PASS", mismatches, frame - first);
+
+	top->final();
+	delete top;
+	return mismatches ? 2 : 0;
+}
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Run every ROM in tests.txt through nes_sim and check each frame's video and
+# audio hashes against golden/<name>.hash. Prints emulated frames/s per ROM.
+# With -u, (re)write the golden files instead. Fails if any ROM fails or has no
+# golden file. Without any of the ROMs in roms/, there is nothing to check and
+# it is skipped.
+cd "$(dirname "$0")" || exit 1
+update=0
+[ "$1" = "-u" ] && update=1
+make -s all || exit 1
+
+pass=0
+fail=0
+skip=0
+while read -r rom frames input; do
+    case "$rom" in
+        ''|'#'*) continue ;;
+    esac
+    name=$(echo "${rom%.nes}" | tr / _)
+    golden="golden/$name.hash"
+    args="-n $frames"
+    [ -n "$input" ] && args="$args -i input/$input"
+    if [ ! -f "roms/$rom" ]; then
+        echo "SKIP $rom: not in roms/"
+        skip=$((skip + 1))
+        continue
+    fi
+    if [ $update = 1 ]; then
+        mkdir -p golden
+        out=$(./nes_sim $args -h "$golden" "roms/$rom")
+        result=$?
+    elif [ ! -f "$golden" ]; then
+        echo "FAIL $rom: no $golden, run regress.sh -u"
+        fail=$((fail + 1))
+        continue
+    else
+        out=$(./nes_sim $args -g "$golden" "roms/$rom")
+        result=$?
+    fi
+    fps=$(echo "$out" | grep "frames/s" | cut -d' ' -f1)
+    if [ $result = 0 ]; then
+        echo "PASS $rom ($frames frames, $fps frames/s)"
+        pass=$((pass + 1))
+    else
+        echo "FAIL $rom"
+        echo "$out" | grep -v "^Loaded"
+        fail=$((fail + 1))
+    fi
+done < tests.txt
+
+echo "$pass passed, $fail failed, $skip skipped"
+if [ $((pass + fail)) = 0 ]; then
+    echo "SKIP regression: no ROM ran, put the ROMs of tests.txt in roms/"
+    exit 0
+fi
+[ $fail = 0 ]
@@ -0,0 +1,104 @@
+`timescale 1ns / 100ps
+
+// Top module for the Verilator simulator (nes_sim.cpp).
+// The same NES machine as NES_KV260 (NES, NesClock, NesRam, MemoryController),
+// without AXI, GameLoader or video/audio output. The harness parses the .nes
+// file itself and writes it straight into memory through load_*, while holding
+// reset: ROM 8 bytes per clk with load_fill, RAM one byte per clk with
+// load_write.
+module sim_top(
+    input clk,
+    input reset,                // NES is held in reset while 1
+    input [31:0] mapper_flags,  // same as GameLoader's
+    input load_write,           // write load_data at load_addr, in NES_KV260's loader address space
+    input [21:0] load_addr,
+    input [7:0] load_data,
+    input load_fill,            // write 8 bytes of load_fill_data to ROM at load_addr, 8-byte aligned
+    input [63:0] load_fill_data,
+    input turbo,
+    input [7:0] btn,            // controller 1, bit 0 - A, ... 7 - Right
+    input [7:0] btn_2,          // controller 2
+    output [5:0] color,         // pixel color from PPU
+    output [8:0] scanline,      // current scanline from PPU
+    output [8:0] cycle,         // current cycle from PPU
+    output [15:0] sample        // audio sample
+);
+
+  wire joypad_strobe;
+  wire [1:0] joypad_clock;
+  wire [21:0] memory_addr;
+  wire memory_read_cpu, memory_read_ppu;
+  wire memory_write;
+  wire [7:0] memory_din_cpu, memory_din_ppu;
+  wire [7:0] memory_dout;
+  wire [10:0] ram_addr, vram_addr;
+  wire ram_read, ram_write, vram_read, vram_write;
+  wire [7:0] ram_din, ram_dout, vram_din, vram_dout;
+  reg [7:0] joypad_bits, joypad_bits2;
+  reg [1:0] last_joypad_clock;
+  wire [31:0] dbgadr;
+  wire [1:0] dbgctr;
+  wire ss_out;                  // save states are not used, the harness has snapshots
+  wire [7:0] ss_mem_dout;
+  wire vblank_start;            // frames are counted by the harness
+  wire [4:0] perf;
+  wire [2:0] emphasis;
+
+  always @(posedge clk) begin
+    if (joypad_strobe) begin
+      joypad_bits <= btn;
+      joypad_bits2 <= btn_2;
+    end
+    if (!joypad_clock[0] && last_joypad_clock[0])
+      joypad_bits <= {1'b0, joypad_bits[7:1]};
+    if (!joypad_clock[1] && last_joypad_clock[1])
+      joypad_bits2 <= {1'b0, joypad_bits2[7:1]};
+    last_joypad_clock <= joypad_clock;
+  end
+
+  wire mem_slot, nes_slot, clk_ppu;
+  wire run_mem = mem_slot && !reset;
+  wire run_nes = nes_slot && !reset;
+  NesClock nes_clock(clk, turbo, 1'b0, mem_slot, nes_slot, clk_ppu);
+
+  NES nes(clk, reset, run_nes,
+          mapper_flags,
+          sample, color,
+          joypad_strobe, joypad_clock, {joypad_bits2[0], joypad_bits[0]},
+          5'b11111,
+          memory_addr,
+          memory_read_cpu, memory_din_cpu,
+          memory_read_ppu, memory_din_ppu,
+          memory_write, memory_dout,
+          ram_addr, ram_read, ram_din, ram_write, ram_dout,
+          vram_addr, vram_read, vram_din, vram_write, vram_dout,
+          cycle, scanline, vblank_start, perf, emphasis,
+          dbgadr,
+          dbgctr,
+          1'b0, 1'b0, 1'b0, ss_out,
+          11'd0, 1'b0, 1'b0, 8'd0, ss_mem_dout,
+          4'd0, , );                    // no RomCache here
+
+  wire load_ram = load_write && load_addr[21:16] == 6'b11_1000;   // internal RAM, in NesRam
+  wire load_vram = load_write && load_addr[21:16] == 6'b11_0000;  // VRAM, in NesRam
+  wire load_mem = load_write && !load_ram && !load_vram;
+
+  NesRam nes_ram(clk,
+        ram_read && run_mem, ram_write && run_mem || load_ram,
+        load_ram ? load_addr[10:0] : ram_addr, load_ram ? load_data : ram_dout, ram_din,
+        vram_read && run_mem, vram_write && run_mem || load_vram,
+        load_vram ? load_addr[10:0] : vram_addr, load_vram ? load_data : vram_dout, vram_din);
+
+  wire ram_busy;
+  MemoryController memory(clk,
+        memory_read_cpu && run_mem,
+        memory_read_ppu && run_mem,
+        memory_write && run_mem || load_mem,
+        load_write || load_fill ? load_addr : memory_addr,
+        load_write ? load_data : memory_dout,
+        load_fill, load_fill_data,
+        memory_din_cpu,
+        memory_din_ppu,
+        ram_busy);
+
+endmodule
@@ -0,0 +1,263 @@
+// Output timing test of nes_dp, built by Verilator from the same RTL as the
+// FPGA (see Makefile). For each output timing, runs nes_dp with the pixel clock
+// and clk_nes at their real rates, fed by a PPU model that draws a black frame
+// with a white 1-pixel border. Then records one output frame, from vsync to
+// vsync, in each scaling mode and checks:
+//   - line length, active pixels, front porch, sync and back porch
+//   - frame length, active lines, front porch, sync and back porch
+//   - that every line is the same
+//   - the size and position of the scaled picture (where the border is), that
+//     its top line is all border and the inside is black
+// against the standard timings (CEA-861 for 720p and 1080p, CVT reduced
+// blanking for 1440p) and the picture sizes given in nes_dp.v.
+// Exits with 2 if anything is off.
+//
+// usage: video_test [-v]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+
+#include "verilated.h"
+#include "Vnes_dp.h"
+
+#define NES_HZ		21477272.0
+#define WARMUP		3			// output frames before the first NES frame is shown
+
+struct Timing {
+	const char *name;
+	double pixel_hz;
+	int h[4];					// active, front porch, sync, back porch, in pixels
+	int v[4];					// the same in lines
+};
+
+// In the order of nes_dp's timing input
+static const Timing timings[] = {
+	{"1080p60", 148500000.0, {1920, 88, 44, 148}, {1080, 4, 5, 36}},
+	{"720p60", 74250000.0, {1280, 110, 40, 220}, {720, 5, 5, 20}},
+	{"1440p60", 241500000.0, {2560, 48, 32, 80}, {1440, 3, 5, 33}},
+};
+
+// scale input of nes_dp: mode in bits 1:0, 4 is scanlines, 8 is smooth
+static const int scales[] = {0, 1, 2, 1 | 4 | 8};
+static const char *scale_names[] = {"integer", "fill", "8:7", "fill+filters"};
+
+// Size of the scaled picture, see the Scaler in nes_dp.v
+static void picture_size(const Timing &t, int scale, int *w, int *h) {
+	int va = t.v[0];
+	if ((scale & 3) == 0) {
+		*w = 256 * (va / 240);
+		*h = 240 * (va / 240);
+	} else {
+		*w = 256 * va / 240;
+		if ((scale & 3) == 2)
+			*w = *w * 8 / 7;
+		*h = va;
+	}
+}
+
+static Vnes_dp *top;
+static double next_pixel, next_nes;		// time of the next edge, seconds
+static double pixel_half, nes_half;
+static int ppu_div, ppu_x, ppu_y;
+
+// PPU: a dot every 4 clk_nes, 341 dots a line, 262 lines a frame
+static void ppu_step() {
+	ppu_div = (ppu_div + 1) & 3;
+	top->ppu_clk = ppu_div < 2;
+	if (ppu_div)
+		return;
+	if (++ppu_x == 341) {
+		ppu_x = 0;
+		ppu_y = ppu_y == 261 ? 0 : ppu_y + 1;
+	}
+	top->ppu_cycle = ppu_x;
+	top->ppu_scanline = ppu_y;
+	int x = ppu_x - 1, y = ppu_y;		// dot x outputs pixel x - 1
+	top->ppu_video = x == 0 || x == 255 || y == 0 || y == 239 ? 0x30 : 0x0f;	// white, black
+}
+
+// Run to the next rising edge of clk_pixel, with clk_nes going too
+static void pixel_clock() {
+	for (;;) {
+		if (next_nes < next_pixel) {
+			next_nes += nes_half;
+			top->clk_nes = !top->clk_nes;
+			top->eval();
+			if (top->clk_nes)
+				ppu_step();
+		} else {
+			next_pixel += pixel_half;
+			top->clk_pixel = !top->clk_pixel;
+			top->eval();
+			if (top->clk_pixel)
+				return;
+		}
+	}
+}
+
+static void wait_vsync() {
+	int prev;
+	do {
+		prev = top->vsync;
+		pixel_clock();
+	} while (!top->vsync || prev);
+}
+
+enum { DE = 1, HS = 2, VS = 4, LIT = 8 };
+
+// Outputs at every pixel clock, from a rising edge of vsync to the next
+static std::vector<uint8_t> record() {
+	std::vector<uint8_t> f;
+	do {
+		f.push_back((top->de ? DE : 0) | (top->hsync ? HS : 0) | (top->vsync ? VS : 0) |
+		            (top->video ? LIT : 0));
+		pixel_clock();
+	} while (!top->vsync || (f.back() & VS));
+	return f;
+}
+
+static int errors;
+
+static void check(const char *what, int got, int exp) {
+	if (got != exp) {
+		printf("    %s is %d, should be %d\n", what, got, exp);
+		errors++;
+	}
+}
+
+// Check a frame. Lines start where vsync rises, which is at the first active
+// pixel position, as nes_dp changes vsync there.
+static void analyse(const std::vector<uint8_t> &f, const Timing &t, int scale, int verbose) {
+	int n = f.size();
+	int hs0 = -1, hs1 = -1;
+	for (int i = 1; i < n && hs1 < 0; i++)
+		if ((f[i] & HS) && !(f[i-1] & HS)) {
+			if (hs0 < 0) hs0 = i; else hs1 = i;
+		}
+	int htotal = hs1 - hs0;
+	int htot_exp = t.h[0] + t.h[1] + t.h[2] + t.h[3], vtot_exp = t.v[0] + t.v[1] + t.v[2] + t.v[3];
+	check("line length", htotal, htot_exp);
+	if (htotal != htot_exp)
+		return;
+	check("frame length", n % htotal == 0 ? n / htotal : -n, vtot_exp);
+	int lines = n / htotal;
+
+	// per line: de run, hsync run, all lines the same
+	int ha = -1, hfp = -1, hsync = -1, odd = 0, first = -1, last = -1, vs = 0;
+	for (int l = 0; l < lines; l++) {
+		const uint8_t *p = &f[l * htotal];
+		int de = 0, de_end = 0, hs_sta = -1, hs_end = -1;
+		for (int x = 0; x < htotal; x++) {
+			if (p[x] & DE) {
+				de++;
+				de_end = x + 1;
+			}
+			if ((p[x] & HS) && hs_sta < 0) hs_sta = x;
+			if ((p[x] & HS)) hs_end = x + 1;
+			if ((p[x] & VS) && x == 0) vs++;
+		}
+		if (de) {
+			if (first < 0) first = l;
+			last = l;
+			if (ha < 0) ha = de;
+			if (de != ha || de_end != de) odd++;
+		}
+		if (hs_sta < 0 || (hfp >= 0 && (hs_sta - t.h[0] != hfp || hs_end - hs_sta != hsync))) {
+			odd++;
+			continue;
+		}
+		hfp = hs_sta - t.h[0];
+		hsync = hs_end - hs_sta;
+	}
+	check("lines different from the rest", odd, 0);
+	check("active pixels", ha, t.h[0]);
+	check("horizontal front porch", hfp, t.h[1]);
+	check("horizontal sync", hsync, t.h[2]);
+	check("horizontal back porch", htotal - t.h[0] - hfp - hsync, t.h[3]);
+	check("active lines", last - first + 1, t.v[0]);
+	check("vertical front porch", lines - 1 - last, t.v[1]);
+	check("vertical sync", vs, t.v[2]);
+	check("vertical back porch", first - vs, t.v[3]);
+
+	// the picture
+	int w, h;
+	picture_size(t, scale, &w, &h);
+	int left = 1 << 30, right = -1, up = 1 << 30, down = -1;
+	for (int i = 0; i < n; i++)
+		if ((f[i] & (DE | LIT)) == (DE | LIT)) {
+			int x = i % htotal, y = i / htotal - first;
+			if (x < left) left = x;
+			if (x > right) right = x;
+			if (y < up) up = y;
+			if (y > down) down = y;
+		}
+	check("picture width", right - left + 1, w);
+	check("picture height", down - up + 1, h);
+	check("picture left", left, (t.h[0] - w) / 2);
+	check("picture top", up, (t.v[0] - h) / 2);
+	int margin = w / 256 + 2, top_row = 0, inside = 0;
+	for (int i = 0; i < n; i++)
+		if ((f[i] & (DE | LIT)) == (DE | LIT)) {
+			int x = i % htotal, y = i / htotal - first;
+			if (y == up)
+				top_row++;
+			if (x > left + margin && x < right - margin && y > up + margin && y < down - margin)
+				inside++;
+		}
+	check("lit pixels on the top line", top_row, w);
+	check("lit pixels inside the border", inside, 0);
+	if (verbose)
+		printf("    %dx%d, picture %dx%d at %d,%d\n", ha, last - first + 1,
+		       right - left + 1, down - up + 1, left, up);
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0, opt;
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: video_test [-v]\n");
+			return 1;
+		}
+	}
+	Verilated::commandArgs(argc, argv);
+
+	int failed = 0, total = 0;
+	for (int ti = 0; ti < (int)(sizeof(timings) / sizeof(timings[0])); ti++) {
+		const Timing &t = timings[ti];
+		top = new Vnes_dp;
+		pixel_half = 0.5 / t.pixel_hz;
+		nes_half = 0.5 / NES_HZ;
+		next_pixel = pixel_half;
+		next_nes = nes_half;
+		ppu_div = ppu_x = ppu_y = 0;
+		top->timing = ti;
+		top->scale = 0;
+		top->rst_pixel = 1;
+		for (int i = 0; i < 16; i++)
+			pixel_clock();
+		top->rst_pixel = 0;
+		for (int i = 0; i < WARMUP; i++)
+			wait_vsync();
+		for (int si = 0; si < (int)(sizeof(scales) / sizeof(scales[0])); si++) {
+			top->scale = scales[si];		// taken at the end of this frame
+			int before = errors;
+			printf("%-8s %-13s\n", t.name, scale_names[si]);
+			analyse(record(), t, scales[si], verbose);
+			total++;
+			if (errors != before)
+				failed++;
+		}
+		top->final();
+		delete top;
+	}
+	if (failed) {
+		printf("%d of %d failed\n", failed, total);
+		return 2;
+	}
+	printf("All %d passed\n", total);
+	return 0;
+}
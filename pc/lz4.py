@@ -0,0 +1,152 @@
+#!/usr/bin/python3
+# LZ4 block format compressor/decompressor, in pure Python.
+#
+# Used to shrink .nes files before sending them over the (slow) serial line.
+# PS side decoder is sw/lz4.c. Only the raw block format is used, without the
+# LZ4 frame header/checksums, since our own packet header carries the lengths.
+#
+# Run this file directly for a round-trip self test.
+
+MIN_MATCH = 4
+MAX_OFFSET = 65535
+LAST_LITERALS = 5       # block format rule: last 5 bytes are always literals
+MFLIMIT = 12            # and the last match must start at least 12 bytes before end
+
+UART_CMD_INES_LZ4 = 3   # [3][u32 raw_len][u32 comp_len][comp_len bytes of LZ4 block]
+
+def _put_len(out, n):
+    # length continuation bytes after a token nibble of 15
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+def _put_sequence(out, data, lit_start, lit_end, offset, match_len):
+    lit_len = lit_end - lit_start
+    token = min(lit_len, 15) << 4
+    if offset:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit_len >= 15:
+        _put_len(out, lit_len - 15)
+    out += data[lit_start:lit_end]
+    if offset:
+        out.append(offset & 0xff)
+        out.append(offset >> 8)
+        if match_len - MIN_MATCH >= 15:
+            _put_len(out, match_len - MIN_MATCH - 15)
+
+def compress(data):
+    """Compress bytes into a single LZ4 block. Greedy, with a 4-byte hash table."""
+    data = bytes(data)
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0              # start of pending literals
+    i = 0
+    limit = n - MFLIMIT
+    while i < limit:
+        key = data[i:i+4]
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or i - ref > MAX_OFFSET:
+            i += 1
+            continue
+        # extend match forward, keeping the last literals out of it
+        m = MIN_MATCH
+        end = n - LAST_LITERALS
+        while i + m < end and data[ref + m] == data[i + m]:
+            m += 1
+        # and backwards into pending literals
+        while i > anchor and ref > 0 and data[i-1] == data[ref-1]:
+            i -= 1
+            ref -= 1
+            m += 1
+        _put_sequence(out, data, anchor, i, i - ref, m)
+        i += m
+        anchor = i
+        if i < limit:
+            table[data[i-2:i+2]] = i - 2
+    _put_sequence(out, data, anchor, n, 0, 0)     # trailing literals
+    return bytes(out)
+
+def decompress(block, raw_len):
+    """Decompress one LZ4 block that decodes to exactly raw_len bytes."""
+    out = bytearray()
+    i = 0
+    n = len(block)
+    while i < n:
+        token = block[i]
+        i += 1
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                b = block[i]
+                i += 1
+                lit_len += b
+                if b != 255:
+                    break
+        out += block[i:i+lit_len]
+        i += lit_len
+        if len(out) >= raw_len:     # last sequence has no match
+            break
+        offset = block[i] | block[i+1] << 8
+        i += 2
+        if offset == 0 or offset > len(out):
+            raise ValueError("bad offset {} at output {}".format(offset, len(out)))
+        match_len = token & 15
+        if match_len == 15:
+            while True:
+                b = block[i]
+                i += 1
+                match_len += b
+                if b != 255:
+                    break
+        match_len += MIN_MATCH
+        start = len(out) - offset
+        for k in range(match_len):      # byte by byte, matches may overlap themselves
+            out.append(out[start + k])
+    if len(out) != raw_len:
+        raise ValueError("decoded {} bytes, expected {}".format(len(out), raw_len))
+    return bytes(out)
+
+def ines_packet(data):
+    """Build the UART packet for a compressed .nes upload"""
+    comp = compress(data)
+    return bytes([UART_CMD_INES_LZ4]) + len(data).to_bytes(4, 'little') + \
+           len(comp).to_bytes(4, 'little') + comp
+
+def parse_ines_packet(pkt):
+    """Inverse of ines_packet(), returns original data"""
+    if pkt[0] != UART_CMD_INES_LZ4:
+        raise ValueError("not a compressed ines packet")
+    raw_len = int.from_bytes(pkt[1:5], 'little')
+    comp_len = int.from_bytes(pkt[5:9], 'little')
+    if len(pkt) != 9 + comp_len:
+        raise ValueError("packet length mismatch")
+    return decompress(pkt[9:], raw_len)
+
+if __name__ == '__main__':
+    import os, random, sys
+
+    random.seed(260)
+    samples = [
+        b'',
+        b'a',
+        b'abcdefghijkl',
+        b'\x00' * 100000,
+        bytes(random.getrandbits(8) for _ in range(70000)),        # incompressible
+        b'NES\x1a' + bytes(range(256)) * 300,
+        bytes(random.choice(b'\x00\x00\x00\xffAB') for _ in range(200000)),
+        (b'0123456789' * 9000)[:70000] + b'x' * 70000,            # match across a 64KB distance
+    ]
+    for fname in sys.argv[1:]:              # optionally also test real .nes files
+        with open(fname, 'rb') as f:
+            samples.append(f.read())
+
+    for s in samples:
+        comp = compress(s)
+        assert decompress(comp, len(s)) == s
+        assert parse_ines_packet(ines_packet(s)) == s
+        print("{:8d} -> {:8d} bytes: OK".format(len(s), len(comp)))
+    print("All tests passed.")
@@ -4,10 +4,11 @@ from tkinter import messagebox
 from tkinter import font
 from tkinter.filedialog import askopenfilename
 
-import sys, os, threading, queue, time, webbrowser
+import sys, os, threading, queue, time, webbrowser, zlib
 import itertools
 
 from ines import Ines
+import lz4
 
 # pyserial
 import serial
@@ -34,6 +35,14 @@ top = Tk()
 device=StringVar(top)
 device.set(devices[0])
 ser=None
+compress=BooleanVar(top, value=True)     # LZ4 compress ROM before upload
+genlock=BooleanVar(top, value=False)     # lock video output to NES frames
+scale=IntVar(top, value=0)               # 0: 4x, 1: 4.5x, 2: 4.5x with 8:7 pixels
+scanlines=BooleanVar(top, value=False)
+smooth=BooleanVar(top, value=False)
+speed=IntVar(top, value=1)               # emulation speed, 1x or 2x
+rewind=IntVar(top, value=0)              # frames between rewind snapshots, 0: off
+perf=IntVar(top, value=0)                # seconds between performance reports, 0: off
 
 def about():
     messagebox.showinfo("About",
@@ -62,10 +71,48 @@ def initUi():
     top.config(menu=menu)
     fileMenu = Menu(menu)
     fileMenu.add_command(label="Refresh controllers", command=refreshController)
+    fileMenu.add_checkbutton(label="Compress upload", variable=compress)
+    fileMenu.add_checkbutton(label="Genlock video", variable=genlock, command=videoConfig)
+    scaleMenu = Menu(fileMenu)
+    scaleMenu.add_radiobutton(label="4x (1024x960)", variable=scale, value=0, command=videoConfig)
+    scaleMenu.add_radiobutton(label="4.5x, fill screen height", variable=scale, value=1, command=videoConfig)
+    scaleMenu.add_radiobutton(label="4.5x, 8:7 pixel aspect", variable=scale, value=2, command=videoConfig)
+    scaleMenu.add_separator()
+    scaleMenu.add_checkbutton(label="Scanlines", variable=scanlines, command=videoConfig)
+    scaleMenu.add_checkbutton(label="Smooth", variable=smooth, command=videoConfig)
+    fileMenu.add_cascade(label="Scaling", menu=scaleMenu)
+    speedMenu = Menu(fileMenu)
+    speedMenu.add_radiobutton(label="1x", variable=speed, value=1, command=setSpeed)
+    speedMenu.add_radiobutton(label="2x (fast forward)", variable=speed, value=2, command=setSpeed)
+    fileMenu.add_cascade(label="Speed", menu=speedMenu)
+    fileMenu.add_command(label="Input stats", command=inputStats)
+    perfMenu = Menu(fileMenu)
+    perfMenu.add_radiobutton(label="Off", variable=perf, value=0, command=setPerf)
+    for n in PERF_SECONDS:
+        perfMenu.add_radiobutton(label="Every %d s" % n, variable=perf, value=n, command=setPerf)
+    fileMenu.add_cascade(label="Performance counters", menu=perfMenu)
+    paletteMenu = Menu(fileMenu)
+    paletteMenu.add_command(label="Load .pal file...", command=choosePalette)
+    paletteMenu.add_command(label="Default", command=lambda: sendPalette(DEFAULT_PALETTE))
+    fileMenu.add_cascade(label="Palette", menu=paletteMenu)
+    stateMenu = Menu(menu)
+    for i in range(STATE_SLOTS):
+        stateMenu.add_command(label="Save slot %d" % (i+1), command=lambda i=i: saveState(i))
+    stateMenu.add_separator()
+    for i in range(STATE_SLOTS):
+        stateMenu.add_command(label="Load slot %d" % (i+1), command=lambda i=i: loadState(i))
+    stateMenu.add_separator()
+    rewindMenu = Menu(stateMenu)
+    rewindMenu.add_radiobutton(label="Off", variable=rewind, value=0, command=setRewind)
+    for n in REWIND_FRAMES:
+        rewindMenu.add_radiobutton(label="Snapshot every %d frames" % n, variable=rewind, value=n,
+                                   command=setRewind)
+    stateMenu.add_cascade(label="Rewind (hold Select+Left)", menu=rewindMenu)
     helpMenu = Menu(menu)
     helpMenu.add_command(label="Project site", command=site)
     helpMenu.add_command(label="About", command=about)
     menu.add_cascade(label="File", menu=fileMenu)
+    menu.add_cascade(label="State", menu=stateMenu)
     menu.add_cascade(label="Help", menu=helpMenu)
 
     btnLoad = Button(top, text = "Load .nes", command=chooseInes)
@@ -106,10 +153,74 @@ def initUi():
     labelCtr2Status=Label(top, text="Disconnected", fg="#888")
     labelCtr2Status.place(x=270, y=195)
 
+# Serial link. It starts at DEFAULT_BAUD, then we ask PS to go faster.
+DEFAULT_BAUD=230400
+BAUDS=[3000000, 921600, 460800]     # tried in this order
+UART_CMD_BAUD=4
+ACK=0x06
+NAK=0x15
+PROBE=b'NES!'
+CHUNK=4096                          # ines data is sent in chunks of this size, each with a CRC32
+UART_CMD_CHUNK=7
+RETRIES=8
+ack_q=queue.Queue()                 # ACK/NAK from PS, picked out of the text by dumpSerial()
+ser_lock=threading.RLock()          # so button updates do not land in the middle of a chunk
+
+def waitAck(timeout):
+    try:
+        return ack_q.get(timeout=timeout)
+    except queue.Empty:
+        return None
+
+def clearAcks():
+    while not ack_q.empty():
+        ack_q.get_nowait()
+
+# A break sets PS back to DEFAULT_BAUD
+def resetLink():
+    ser.baudrate=DEFAULT_BAUD
+    ser.send_break(0.05)
+    time.sleep(0.1)
+
+def negotiateBaud():
+    for baud in BAUDS:
+        clearAcks()
+        ser.write(bytes([UART_CMD_BAUD]) + baud.to_bytes(4, 'little'))
+        if waitAck(0.5) != ACK:     # PS cannot do this rate
+            continue
+        try:
+            ser.baudrate=baud
+            time.sleep(0.05)
+            ser.write(PROBE)
+            if waitAck(0.5) == ACK:
+                print("Serial link at {} baud".format(baud))
+                return
+        except Exception:           # USB bridge cannot do this rate
+            pass
+        resetLink()
+    print("Serial link at {} baud".format(DEFAULT_BAUD))
+
 def connectSerial():
     global ser
-    if ser==None:
-        ser=serial.Serial(device.get(), 230400, write_timeout=0)
+    with ser_lock:
+        if ser==None:
+            ser=serial.Serial(device.get(), DEFAULT_BAUD, write_timeout=0)
+            resetLink()
+            negotiateBaud()
+
+# Send one chunk of ines data, followed by its CRC32. Resend until PS ACKs it.
+# Controller input can go out between chunks.
+def sendChunk(chunk):
+    frame=bytes([UART_CMD_CHUNK]) + chunk + zlib.crc32(chunk).to_bytes(4, 'little')
+    for retry in range(RETRIES):
+        with ser_lock:
+            ser.write(frame)
+        r=waitAck(2)
+        if r == ACK:
+            return True
+        if r != NAK:                # no answer, link is broken
+            break
+    return False
 
 def serialSelected(choice):
     print("Serial: {}".format(choice))
@@ -155,13 +266,25 @@ def sendInes(fname):
     # 115200,8,N,1
     header=bytearray([1])       # command: ines
     header += size.to_bytes(4, 'little')    # we send little-endian
+    if compress.get():
+        packet=lz4.ines_packet(data)
+        if len(packet) < len(header) + len(data):     # only if it actually helps
+            print("Compressed {} bytes to {} bytes.".format(len(data), len(packet)-9))
+            header=packet[:9]
+            data=packet[9:]
     connectSerial()
-    ser.write(header)
-    CHUNK=1024
+    with ser_lock:
+        clearAcks()
+        ser.write(header)
     for i in range(0,len(data),CHUNK):
         labelSerialStatus.config(text=PROGRESS[(i//CHUNK)%4], fg='#000')  # show an animation for progress
         top.update()
-        ser.write(data[i:min(i+CHUNK,len(data))])
+        if not sendChunk(data[i:min(i+CHUNK,len(data))]):
+            print("Sending failed, going back to {} baud.".format(DEFAULT_BAUD))
+            labelSerialStatus.config(text='Failed', fg='#c00')
+            with ser_lock:
+                resetLink()
+            return
 
     print("Sent {} bytes over serial line.".format(len(data)))
 
@@ -172,6 +295,12 @@ def dumpSerial():
         try:
             if ser != None and ser.inWaiting():
                 din = ser.read(1)
+                if din[0] == ACK or din[0] == NAK:
+                    ack_q.put(din[0])
+                    continue
+                if din[0] == UART_ECHO:
+                    inputEcho(int.from_bytes(ser.read(4), 'little'))
+                    continue
                 s = din.decode("iso-8859-1")
                 print(s, end='')
                 if s == '\n':
@@ -188,8 +317,6 @@ def dumpSerial():
 thread = threading.Thread(target=dumpSerial, daemon=True)
 thread.start()
 
-initUi()
-
 
 # Names of first 2 gamepads we see so they do not get mixed up
 pad_name=['','']
@@ -206,6 +333,137 @@ def showControllerInfo():
     else:
         labelCtr2Status.config(text='Disconnected', fg='#888')
 
+# Controller input frame, PS applies it without echoing anything back:
+#   [UART_CMD_INPUT][flags][pad 1][pad 2][u32 timestamp in us, if flags bit 0]
+# flags bits 7:4 is the number of button changes coalesced into this frame.
+# With flags bit 1 PS sends [UART_ECHO][the timestamp] back once the buttons
+# reach the NES, and we time the round trip.
+UART_CMD_INPUT=5
+UART_CMD_STATS=6
+UART_ECHO=0x02
+SEND_TIMESTAMPS=True
+ECHO_EVERY=8                        # ask for an echo on every 8th input frame, 0: never
+input_frames=0
+echo_stats=[0, 0, 0]                # echoes, sum and max of round trips in us
+
+def timestamp():
+    return time.perf_counter_ns()//1000 & 0xffffffff
+
+def inputFrame(btns, changes):
+    global input_frames
+    flags=min(changes, 15) << 4
+    if SEND_TIMESTAMPS:
+        flags |= 1
+        if ECHO_EVERY and input_frames % ECHO_EVERY == 0:
+            flags |= 2
+    input_frames += 1
+    b=bytearray([UART_CMD_INPUT, flags, btns[0], btns[1]])
+    if SEND_TIMESTAMPS:
+        b += timestamp().to_bytes(4, 'little')
+    return b
+
+def inputEcho(ts):
+    rtt=(timestamp() - ts) & 0xffffffff
+    echo_stats[0] += 1
+    echo_stats[1] += rtt
+    echo_stats[2] = max(echo_stats[2], rtt)
+
+# Ask PS to print input counters and latency
+def inputStats():
+    n, total, worst = echo_stats
+    print("Input round trip: {} echoes, avg {} us, max {} us".format(n, total//n if n else 0, worst))
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_STATS]))
+
+# Periodic report of the FPGA performance counters, printed by PS,
+# [UART_CMD_PERF][seconds between reports, 0: off]
+UART_CMD_PERF=12
+PERF_SECONDS=[1, 5, 30]
+
+def setPerf():
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_PERF, perf.get()]))
+
+# Video palette, [UART_CMD_PALETTE][sets][sets * 64 colors * RGB]
+# A .pal file has 64 colors (1 set), or 512 with a set for each of the 8
+# combinations of the emphasis bits (8 sets). For 1 set PS makes the
+# emphasized colors.
+UART_CMD_PALETTE=13
+DEFAULT_PALETTE=bytes.fromhex(     # 2C02, the one the FPGA starts with
+    '545454001e740810903000884400645c00305404003c1800'
+    '202a00083a00004000003c0000323c000000000000000000'
+    '989698084cc43032ec5c1ee48814b0a01464982220783c00'
+    '545a00287200087c00007628006678000000000000000000'
+    'eceeec4c9aec787cecb062ece454ecec58b4ec6a64d48820'
+    'a0aa0074c4004cd02038cc6c38b4cc3c3c3c000000000000'
+    'eceeeca8ccecbcbcecd4b2ececaeececaed4ecb4b0e4c490'
+    'ccd278b4de78a8e29098e2b4a0d6e4a0a2a0000000000000')
+
+def sendPalette(data):
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_PALETTE, len(data) // 192]) + data)
+
+def choosePalette():
+    filename=askopenfilename(title='Choose a .pal file', filetypes=(("palette files", "*.pal"),("all files","*.*")))
+    if not filename:
+        return
+    with open(filename, 'rb') as f:
+        data=f.read()
+    if len(data) != 192 and len(data) != 1536:
+        messagebox.showerror("Error", "{} is {} bytes, a palette is 192 or 1536".format(filename, len(data)))
+        return
+    sendPalette(data)
+
+# Video options, [UART_CMD_VIDEO][flags]
+#   flags bit 0: genlock, lock output frames to NES frames (60.1Hz)
+#   flags bits 2:1: scale, 0: 4x, 1: 4.5x to fill the 1080 lines, 2: 4.5x with 8:7 pixels
+#                   (at 1080p, see doc/design.md for other output timings)
+#   flags bit 3: scanlines, bit 4: smooth (mix pixels at 4.5x instead of 4,5,4,5 wide)
+UART_CMD_VIDEO=8
+
+def videoConfig():
+    flags = (1 if genlock.get() else 0) | scale.get() << 1
+    flags |= (8 if scanlines.get() else 0) | (16 if smooth.get() else 0)
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_VIDEO, flags]))
+
+# Emulation speed, [UART_CMD_SPEED][1 or 2]
+UART_CMD_SPEED=9
+
+def setSpeed():
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_SPEED, speed.get()]))
+
+# Save states, kept by PS until the next game is loaded, [UART_CMD_STATE][op][slot]
+#   op 1: save, 2: load
+UART_CMD_STATE=10
+STATE_SLOTS=4
+
+def saveState(slot):
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_STATE, 1, slot]))
+
+def loadState(slot):
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_STATE, 2, slot]))
+
+# Rewind, [UART_CMD_REWIND][frames between snapshots, 0: off]
+# Holding Select+Left on controller 1 then goes back in time.
+UART_CMD_REWIND=11
+REWIND_FRAMES=[1, 2, 4, 8]
+
+def setRewind():
+    connectSerial()
+    with ser_lock:
+        ser.write(bytes([UART_CMD_REWIND, rewind.get()]))
+
 def controllerThread():
     global pad_name, pad_connected
     # The bits are: 0 - A, 1 - B, 2 - Select, 3 - Start, 
@@ -256,9 +514,14 @@ def controllerThread():
     btns = [0,0]
     while True:
         # events = xi.get_events()
-        u, events = item_q.get()
+        batch = [item_q.get()]
+        while not item_q.empty():       # coalesce whatever else is already waiting
+            batch.append(item_q.get_nowait())
+        events = [(u, e) for u, es in batch for e in es]
         btns_old = btns.copy()
-        for e in events:
+        changes = 0
+        for u, e in events:
+            prev = btns[u]
             print(u, e.ev_type, e.code, e.state)
             if (e.ev_type == 'Key' or e.ev_type == 'Absolute') and e.state!=0:      # button pressed
                 # print('key pressed')
@@ -292,15 +555,18 @@ def controllerThread():
                      btns[u] &= ~(3 << 4)
                 elif e.code == "ABS_HAT0X":             # LEFT and RIGTH unpressed
                     btns[u] &= ~(3 << 6)
+            if btns[u] != prev:
+                changes += 1
         if btns[0] != btns_old[0] or btns[1] != btns_old[1]:
             print("Buttons: {0:02x}, {1:02x}".format(btns[0], btns[1]))
-            b=bytearray(b'\x02')
-            b.append(btns[0])
-            b.append(btns[1])
-            # print(b)
+            b=inputFrame(btns, changes)
             connectSerial()
-            ser.write(b)
-            ser.flush()
+            with ser_lock:
+                ser.write(b)
+                ser.flush()
+
+# The menus need every handler above
+initUi()
 
 thread2 = threading.Thread(target=controllerThread, daemon=True)
 thread2.start()
@@ -29,11 +29,16 @@
 
 /***************************** Include Files *********************************/
 
+#include <string.h>
 #include "displayport.h"
 
 #include "xil_exception.h"
 #include "xil_printf.h"
 #include "xil_cache.h"
+#include "xil_mmu.h"
+#include "xil_io.h"
+#include "sleep.h"
+#include "parameters.h"
 
 /************************** Constant Definitions *****************************/
 #define DPPSU_DEVICE_ID		XPAR_PSU_DP_DEVICE_ID
@@ -47,18 +52,71 @@
 #define AVBUF_BASEADDR		XPAR_PSU_DP_BASEADDR
 #define DPDMA_BASEADDR		XPAR_PSU_DPDMA_BASEADDR
 
-#define BUFFERSIZE			1920 * 1080 * 4		/* HTotal * VTotal * BPP */
-#define LINESIZE			1920 * 4			/* HTotal * BPP */
-#define STRIDE				LINESIZE			/* The stride value should
-													be aligned to 256*/
+#define BUFFERSIZE			2560 * 1440 * 4		/* largest HActive * VActive * BPP */
+
+/* DP audio registers past TX_AUDIO_CHANNELS (UG1087) */
+#define TX_AUDIO_INFO_DATA(n)	(0x308 + 4 * (n))	/* audio infoframe, 8 words */
+#define TX_AUDIO_MAUD		0x328
+#define TX_AUDIO_NAUD		0x32C
+#define AUDIO_REF_KHZ		24576	/* DP_AUDIO_REF_CTRL in design_1.tcl, 512 * 48Khz */
+
+/*
+ * Output timings. The index is nes_dp's timing input (reg0 command 13 of
+ * NES_KV260), and clk_wiz_0 makes the pixel clock, reprogrammed here through
+ * its dynamic reconfiguration registers (PG065). It runs off pl_clk0, 250Mhz:
+ * 250Mhz / ClkDivide * ClkMult / ClkOutDivide.
+ */
+typedef struct {
+	const char *Name;
+	XVidC_VideoMode VideoMode;
+	u16 Width, Height;
+	u32 PixClkKhz;
+	u16 LockVTotal;		/* lines a frame with genlock on average, a NES frame (16.639ms) */
+	u8 ClkDivide;
+	u32 ClkMult;		/* x1000, steps of 125 */
+	u32 ClkOutDivide;	/* x1000, steps of 125 */
+} Timing;
+
+static const Timing Timings[] = {
+	{"1080p60", XVIDC_VM_1920x1080_60_P, 1920, 1080, 148500, 1123, 23, 126375, 9250},
+	{"720p60", XVIDC_VM_1280x720_60_P, 1280, 720, 74250, 749, 23, 126375, 18500},
+	{"1440p60", XVIDC_VM_2560x1440_60_P, 2560, 1440, 241500, 1477, 10, 60375, 6250},
+};
+
+#define CLK_WIZ_BASEADDR	XPAR_CLK_WIZ_0_BASEADDR
+#define CLK_WIZ_STATUS		0x04	/* bit 0: locked */
+#define CLK_WIZ_CONFIG0		0x200	/* [7:0] DIVCLK_DIVIDE, [15:8] CLKFBOUT_MULT, [25:16] its fraction x1000 */
+#define CLK_WIZ_CONFIG2		0x208	/* [7:0] CLKOUT0_DIVIDE, [17:8] its fraction x1000 */
+#define CLK_WIZ_CONFIG23	0x25C	/* 3: load the values above and relock */
+
+#define EDID_ADDR			0x50	/* I2C address of EDID, read over AUX */
+
+void command(u32 v);				/* main.c, reg0 of NES_KV260 */
+static int PickTiming(Run_Config *RunCfgPtr);
+static int SetPixelClock(const Timing *T);
+static u8 TrainLanes(Run_Config *RunCfgPtr);
+static u8 LinkRateFor(const Timing *T, u8 Lanes, u8 MaxRate);
+#if DP_AUDIO
+static void DpPsu_SetupAudio(XDpPsu *DpPsuPtr);
+#endif
 
 /************************** Variable Declarations ***************************/
-XDpDma DpDma;
 XDpPsu DpPsu;
 XAVBuf AVBuf;
 Run_Config RunCfg;
-
-u8 Frame[BUFFERSIZE] __attribute__ ((__aligned__(256)));
+const Timing *OutTiming = &Timings[VIDEO_TIMING_1080P];
+int Genlock;						/* nes_dp's genlock is on, see displayport_genlock() */
+
+/*
+ * Memory the DPDMA reads by itself: the frame buffer, and DpDma which holds
+ * the descriptors. It takes whole 2MB MMU blocks that are marked
+ * non-cacheable, so caches can stay on for the rest of the program.
+ */
+#define NONCACHED_BLOCK		0x200000	/* A53 MMU block size for DDR */
+struct {
+	u8 Frame[BUFFERSIZE] __attribute__ ((__aligned__(256)));
+	XDpDma DpDma;
+} __attribute__ ((__aligned__(NONCACHED_BLOCK))) DpMem;		/* size is rounded up to whole blocks too */
 XDpDma_FrameBuffer FrameBuffer;
 
 /**************************** Type Definitions *******************************/
@@ -80,8 +138,10 @@ void displayport_init(XScuGic *Intr)
 	int Status;
 	Run_Config *RunCfgPtr = &RunCfg;
 
-	Xil_DCacheDisable();
-	Xil_ICacheDisable();
+	/* Write back whatever is cached of DpMem, then make it non-cacheable */
+	Xil_DCacheFlushRange((INTPTR)&DpMem, sizeof(DpMem));
+	for (INTPTR a = (INTPTR)&DpMem; a < (INTPTR)&DpMem + sizeof(DpMem); a += NONCACHED_BLOCK)
+		Xil_SetTlbAttributes(a, NORM_NONCACHE);
 
 	/* Initialize the application configuration */
 	InitRunConfig(RunCfgPtr, Intr);
@@ -91,14 +151,28 @@ void displayport_init(XScuGic *Intr)
 		return;
 	}
 
+	/* Output timing, for the pixel clock, nes_dp and DP. nes_dp only gets it
+	   once the clock has locked, so it never runs a timing the clock is not at. */
+	const Timing *T = &Timings[PickTiming(RunCfgPtr)];
+	if (SetPixelClock(T) != XST_SUCCESS) {
+		xil_printf("Pixel clock did not lock for %s\r\n", T->Name);
+		T = &Timings[VIDEO_TIMING_1080P];
+		if (SetPixelClock(T) != XST_SUCCESS)
+			xil_printf("Pixel clock did not lock\r\n");
+	}
+	OutTiming = T;
+	RunCfgPtr->VideoMode = OutTiming->VideoMode;
+	command(13 | (u32)(OutTiming - Timings) << 8);
+	xil_printf("Output timing %s\r\n", OutTiming->Name);
+
 	xil_printf("Generating Overlay.....\n\r");
-	GraphicsOverlay(Frame, RunCfgPtr);
+	GraphicsOverlay(DpMem.Frame, RunCfgPtr);
 
 	/* Populate the FrameBuffer structure with the frame attributes */
-	FrameBuffer.Address = (INTPTR)Frame;
-	FrameBuffer.Stride = STRIDE;
-	FrameBuffer.LineSize = LINESIZE;
-	FrameBuffer.Size = BUFFERSIZE;
+	FrameBuffer.Address = (INTPTR)DpMem.Frame;
+	FrameBuffer.Stride = OutTiming->Width * 4;	/* multiple of 256 */
+	FrameBuffer.LineSize = OutTiming->Width * 4;
+	FrameBuffer.Size = OutTiming->Width * OutTiming->Height * 4;
 
 	SetupInterrupts(RunCfgPtr, Intr);
 	if (Status != XST_SUCCESS) {
@@ -127,7 +201,7 @@ void InitRunConfig(Run_Config *RunCfgPtr, XScuGic *Intr)
 		RunCfgPtr->DpPsuPtr   = &DpPsu;
 		RunCfgPtr->IntrPtr   = Intr;
 		RunCfgPtr->AVBufPtr  = &AVBuf;
-		RunCfgPtr->DpDmaPtr  = &DpDma;
+		RunCfgPtr->DpDmaPtr  = &DpMem.DpDma;
 		RunCfgPtr->VideoMode = XVIDC_VM_1920x1080_60_P;
 		RunCfgPtr->Bpc		 = XVIDC_BPC_8;
 		RunCfgPtr->ColorEncode			= XDPPSU_CENC_RGB;
@@ -136,7 +210,127 @@ void InitRunConfig(Run_Config *RunCfgPtr, XScuGic *Intr)
 		RunCfgPtr->LinkRate				= LINK_RATE_540GBPS;
 		RunCfgPtr->EnSynchClkMode		= 0;
 		RunCfgPtr->UseMaxLaneCount		= 1;
-		RunCfgPtr->UseMaxLinkRate		= 1;
+		RunCfgPtr->UseMaxLinkRate		= 0;
+}
+
+/*****************************************************************************/
+/**
+*
+* Pick the output timing, VIDEO_TIMING of parameters.h. With VIDEO_TIMING_AUTO,
+* the largest one that is no larger than the preferred mode of the monitor
+* (the first detailed timing of its EDID), and that its link can carry.
+* 1080p if there is no monitor or no EDID.
+*
+* @param	RunCfgPtr is a pointer to the application configuration structure.
+*
+* @return	Index into Timings.
+*
+*****************************************************************************/
+static int PickTiming(Run_Config *RunCfgPtr)
+{
+	XDpPsu *DpPsuPtr = RunCfgPtr->DpPsuPtr;
+	XDpPsu_LinkConfig *LinkCfgPtr = &DpPsuPtr->LinkConfig;
+	static const u8 Header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+	u8 Edid[128], Sum = 0;
+	int i;
+
+	if (VIDEO_TIMING != VIDEO_TIMING_AUTO)
+		return VIDEO_TIMING;
+	if (!XDpPsu_IsConnected(DpPsuPtr) ||
+			XDpPsu_GetRxCapabilities(DpPsuPtr) != XST_SUCCESS ||
+			XDpPsu_IicRead(DpPsuPtr, EDID_ADDR, 0, sizeof(Edid), Edid) != XST_SUCCESS) {
+		xil_printf("No EDID from the monitor\r\n");
+		return VIDEO_TIMING_1080P;
+	}
+	for (i = 0; i < sizeof(Edid); i++)
+		Sum += Edid[i];
+	if (memcmp(Edid, Header, sizeof(Header)) || Sum != 0 || (Edid[54] | Edid[55]) == 0) {
+		xil_printf("Bad EDID\r\n");
+		return VIDEO_TIMING_1080P;
+	}
+	int Width = Edid[56] | (Edid[58] & 0xf0) << 4;
+	int Height = Edid[59] | (Edid[61] & 0xf0) << 4;
+	u8 Lanes = TrainLanes(RunCfgPtr);
+	xil_printf("Monitor prefers %dx%d, link %d lanes at %d x 270Mbps\r\n", Width, Height,
+			Lanes, LinkCfgPtr->MaxLinkRate);
+
+	static const int Order[] = {VIDEO_TIMING_1440P, VIDEO_TIMING_1080P, VIDEO_TIMING_720P};
+	for (i = 0; i < sizeof(Order) / sizeof(Order[0]); i++) {
+		const Timing *T = &Timings[Order[i]];
+		if (T->Width <= Width && T->Height <= Height &&
+				LinkRateFor(T, Lanes, LinkCfgPtr->MaxLinkRate))
+			return Order[i];
+	}
+	return VIDEO_TIMING_720P;
+}
+
+/*****************************************************************************/
+/**
+*
+* Lane count DpPsu_Hpd_Train trains the link with.
+*
+* @param	RunCfgPtr is a pointer to the application configuration structure.
+*
+* @return	Lane count.
+*
+*****************************************************************************/
+static u8 TrainLanes(Run_Config *RunCfgPtr)
+{
+	XDpPsu_LinkConfig *LinkCfgPtr = &RunCfgPtr->DpPsuPtr->LinkConfig;
+
+	return RunCfgPtr->UseMaxLaneCount ? LinkCfgPtr->MaxLaneCount : RunCfgPtr->LaneCount;
+}
+
+/*****************************************************************************/
+/**
+*
+* Lowest link rate that carries a timing on a number of lanes. The capacity is
+* lanes * rate (in 270Mbps) * 27MB/s after 8b/10b, at 3 bytes a pixel.
+*
+* @param	T is the timing.
+* @param	Lanes is the lane count the link is trained with.
+* @param	MaxRate is the highest link rate of the link.
+*
+* @return	Link rate, or 0 if none up to MaxRate carries it.
+*
+*****************************************************************************/
+static u8 LinkRateFor(const Timing *T, u8 Lanes, u8 MaxRate)
+{
+	static const u8 Rates[] = {LINK_RATE_162GBPS, LINK_RATE_270GBPS, LINK_RATE_540GBPS};
+	int i;
+
+	for (i = 0; i < sizeof(Rates) / sizeof(Rates[0]); i++)
+		if (Rates[i] <= MaxRate && Lanes * Rates[i] * 27000 / 3 >= T->PixClkKhz)
+			return Rates[i];
+	return 0;
+}
+
+/*****************************************************************************/
+/**
+*
+* Reprogram clk_wiz_0 for the pixel clock of a timing, and wait for it to lock.
+* The pixel clock domain of PL is held in reset until then.
+*
+* @param	T is the timing.
+*
+* @return	XST_SUCCESS if the clock locked.
+*
+*****************************************************************************/
+static int SetPixelClock(const Timing *T)
+{
+	int i;
+
+	Xil_Out32(CLK_WIZ_BASEADDR + CLK_WIZ_CONFIG0,
+			T->ClkDivide | (T->ClkMult / 1000) << 8 | (T->ClkMult % 1000) << 16);
+	Xil_Out32(CLK_WIZ_BASEADDR + CLK_WIZ_CONFIG2,
+			T->ClkOutDivide / 1000 | (T->ClkOutDivide % 1000) << 8);
+	Xil_Out32(CLK_WIZ_BASEADDR + CLK_WIZ_CONFIG23, 3);
+	for (i = 0; i < 100; i++) {
+		usleep(100);
+		if (Xil_In32(CLK_WIZ_BASEADDR + CLK_WIZ_STATUS) & 1)
+			return XST_SUCCESS;
+	}
+	return XST_FAILURE;
 }
 
 /*****************************************************************************/
@@ -203,7 +397,8 @@ int InitDpDmaSubsystem(Run_Config *RunCfgPtr)
 	/* Set the output Video Format */
 	XAVBuf_SetOutputVideoFormat(AVBufPtr, RGB_8BPC);
 
-//	XAVBuf_EnableAudio0Buffers(AVBufPtr, 1);
+	/* Live audio from dp_audio.v in PL */
+	XAVBuf_EnableAudio0Buffers(AVBufPtr, DP_AUDIO);
 
 	/* Select the Input Video Sources.
 	 * Here in this example we are going to demonstrate
@@ -212,7 +407,8 @@ int InitDpDmaSubsystem(Run_Config *RunCfgPtr)
 	// sonycman reported the same issue about a year ago and claimed he has overcome it
 	// ("...vsync and hsync have to be strictly aligned to each other..."),
 	XAVBuf_InputVideoSelect(AVBufPtr, XAVBUF_VIDSTREAM1_LIVE, XAVBUF_VIDSTREAM2_NONE/*XAVBUF_VIDSTREAM2_NONLIVE_GFX*/);
-//	XAVBuf_InputAudioSelect(AVBufPtr, XAVBUF_AUDSTREAM1_LIVE, XAVBUF_AUDSTREAM2_NO_AUDIO);
+	XAVBuf_InputAudioSelect(AVBufPtr, DP_AUDIO ? XAVBUF_AUDSTREAM1_LIVE : XAVBUF_AUDSTREAM1_NO_AUDIO,
+			XAVBUF_AUDSTREAM2_NO_AUDIO);
 
 	/* Configure Video pipeline for graphics channel */
 	XAVBuf_ConfigureGraphicsPipeline(AVBufPtr);
@@ -392,15 +588,22 @@ static u32 DpPsu_Hpd_Train(Run_Config *RunCfgPtr)
 		return XST_FAILURE;
 	}
 
-	Status = XDpPsu_SetLaneCount(DpPsuPtr,
-			(RunCfgPtr->UseMaxLaneCount) ?
-				LinkCfgPtr->MaxLaneCount :
-				RunCfgPtr->LaneCount);
+	Status = XDpPsu_SetLaneCount(DpPsuPtr, TrainLanes(RunCfgPtr));
 	if (Status != XST_SUCCESS) {
 		xil_printf("\t! Lane count set failed.\n\r");
 		return XST_FAILURE;
 	}
 
+	/* The rate the timing needs on the lanes just set, which the monitor of a
+	   hot plug may have fewer of than the one the timing was picked for */
+	RunCfgPtr->LinkRate = LinkRateFor(OutTiming, DpPsuPtr->LinkConfig.LaneCount,
+			LinkCfgPtr->MaxLinkRate);
+	if (RunCfgPtr->LinkRate == 0) {
+		xil_printf("\t! %s does not fit on %d lanes.\n\r", OutTiming->Name,
+				DpPsuPtr->LinkConfig.LaneCount);
+		return XST_FAILURE;
+	}
+
 	Status = XDpPsu_SetLinkRate(DpPsuPtr,
 			(RunCfgPtr->UseMaxLinkRate) ?
 				LinkCfgPtr->MaxLinkRate :
@@ -608,12 +811,69 @@ void DpPsu_SetupVideoStream(Run_Config *RunCfgPtr)
 	XDpPsu_WriteReg(DpPsuPtr->Config.BaseAddr, XDPPSU_SOFT_RESET, 0x0);
 
 	XDpPsu_SetMsaValues(DpPsuPtr);
+	displayport_genlock(Genlock);
 	/* Issuing a soft-reset (AV_BUF_SRST_REG). */
 	XDpPsu_WriteReg(DpPsuPtr->Config.BaseAddr, 0xB124, 0x3); // Assert reset.
 	usleep(10);
 	XDpPsu_WriteReg(DpPsuPtr->Config.BaseAddr, 0xB124, 0x0); // De-ssert reset.
 
+#if DP_AUDIO
+	DpPsu_SetupAudio(DpPsuPtr);
+#endif
+
 	XDpPsu_EnableMainLink(DpPsuPtr, 1);
 
 	xil_printf("DONE!\n\r");
 }
+
+/******************************************************************************/
+/**
+ * Send audio, 2 channels. The samples come from the live audio input, which
+ * is timed by the PS audio clock, 512 * 48Khz. Maud / Naud is that clock over
+ * the link symbol clock, so Naud follows the link rate.
+ *
+ * @param	DpPsuPtr is the DP transmitter, with the link trained.
+ *
+ * @return	None.
+ *
+*******************************************************************************/
+#if DP_AUDIO
+static void DpPsu_SetupAudio(XDpPsu *DpPsuPtr)
+{
+	u32 Base = DpPsuPtr->Config.BaseAddr;
+	/* Audio infoframe SDP: header (type 0x84, length 0x1B, version 0x11),
+	 * then 2 channels, everything else from the stream. */
+	static const u32 InfoFrame[8] = {0x441B8400, 0x00000001};
+
+	XDpPsu_WriteReg(Base, XDPPSU_TX_AUDIO_CONTROL, 0x0);
+	XDpPsu_WriteReg(Base, TX_AUDIO_MAUD, AUDIO_REF_KHZ);
+	XDpPsu_WriteReg(Base, TX_AUDIO_NAUD, DpPsuPtr->LinkConfig.LinkRate * 27000);
+	for (int i = 0; i < 8; i++)
+		XDpPsu_WriteReg(Base, TX_AUDIO_INFO_DATA(i), InfoFrame[i]);
+	XDpPsu_WriteReg(Base, XDPPSU_TX_AUDIO_CHANNELS, 0x1);	/* channels - 1 */
+	XDpPsu_WriteReg(Base, XDPPSU_TX_AUDIO_CONTROL, 0x1);
+}
+#endif
+
+/******************************************************************************/
+/**
+ * Tell the sink about genlock. nes_dp then makes frames of varying length
+ * (SCREEN +- VADJ lines), on average as long as a NES frame, while the
+ * standard mode in the MSA says 1125 lines (1080p). Sinks recover the pixel
+ * clock and frame rate from the MSA, so give them the average instead.
+ *
+ * @param	On is 1 if genlock is on.
+ *
+ * @return	None.
+ *
+*******************************************************************************/
+void displayport_genlock(int On)
+{
+	XDpPsu *DpPsuPtr = &DpPsu;
+	XDpPsu_MainStreamAttributes *MsaConfig = &DpPsuPtr->MsaConfig;
+	u32 VTotal = On ? OutTiming->LockVTotal : MsaConfig->Vtm.Timing.F0PVTotal;
+
+	Genlock = On;
+	if (MsaConfig->PixelClockHz)		/* the stream is set up */
+		XDpPsu_WriteReg(DpPsuPtr->Config.BaseAddr, XDPPSU_MAIN_STREAM_VTOTAL, VTotal);
+}
@@ -87,6 +87,7 @@ void DpPsu_IsrHpdEvent(void *ref);
 void DpPsu_IsrHpdPulse(void *ref);
 
 void displayport_init();
+void displayport_genlock(int On);
 
 /************************** Variable Definitions *****************************/
 
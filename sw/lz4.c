@@ -0,0 +1,116 @@
+/*
+ * LZ4 block decoder, see lz4.h.
+ *
+ * A block is a list of sequences:
+ *   token (lit_len:4 | match_len:4), [lit_len ext], literals,
+ *   offset (u16 LE), [match_len ext]
+ * The last sequence stops after its literals. Length nibbles of 15 are
+ * followed by extension bytes that are added up until one is not 255.
+ * Match length is nibble + 4.
+ */
+#include "lz4.h"
+
+#define WMASK	(LZ4_WINDOW-1)
+#define HALF	(LZ4_WINDOW/2)
+
+enum { S_TOKEN, S_LIT_EXT, S_LIT, S_OFF_LO, S_OFF_HI, S_MATCH_EXT, S_DONE, S_ERROR };
+
+static void flush(lz4_stream *s) {
+	if (s->out_len > s->flushed) {
+		s->sink(s->window + (s->flushed & WMASK), s->out_len - s->flushed);
+		s->flushed = s->out_len;
+	}
+}
+
+static inline void emit(lz4_stream *s, u8 b) {
+	s->window[s->out_len & WMASK] = b;
+	s->out_len++;
+	if ((s->out_len & (HALF-1)) == 0)	// hand over every full half of the window
+		flush(s);
+}
+
+// Copy a match out of the history. Returns 0 if the match is invalid.
+static int copy_match(lz4_stream *s) {
+	if (s->offset == 0 || s->offset > s->out_len ||
+			s->match_len > s->out_total - s->out_len)
+		return 0;
+	u32 from = s->out_len - s->offset;
+	for (u32 i = 0; i < s->match_len; i++)		// may overlap itself, so byte by byte
+		emit(s, s->window[(from + i) & WMASK]);
+	return 1;
+}
+
+// Literals are done. Either the block ends here or a match follows.
+static int after_literals(lz4_stream *s) {
+	if (s->out_len == s->out_total) {
+		flush(s);
+		return S_DONE;
+	}
+	return S_OFF_LO;
+}
+
+void lz4_init(lz4_stream *s, u32 out_total, lz4_sink sink) {
+	s->state = S_TOKEN;
+	s->lit_len = s->match_len = s->offset = 0;
+	s->out_len = s->flushed = 0;
+	s->out_total = out_total;
+	s->sink = sink;
+}
+
+int lz4_feed(lz4_stream *s, const u8 *buf, int len) {
+	int i = 0;
+	while (i < len && s->state != S_DONE && s->state != S_ERROR) {
+		u8 b = buf[i++];
+		switch (s->state) {
+		case S_TOKEN:
+			s->lit_len = b >> 4;
+			s->match_len = (b & 15) + 4;
+			if (s->lit_len == 15)
+				s->state = S_LIT_EXT;
+			else if (s->lit_len > 0)
+				s->state = S_LIT;
+			else
+				s->state = after_literals(s);
+			break;
+		case S_LIT_EXT:
+			s->lit_len += b;
+			if (b != 255)
+				s->state = S_LIT;
+			break;
+		case S_LIT:
+			i--;
+			while (i < len && s->lit_len > 0) {
+				if (s->out_len == s->out_total) {	// more literals than expected
+					s->state = S_ERROR;
+					break;
+				}
+				emit(s, buf[i++]);
+				s->lit_len--;
+			}
+			if (s->state != S_ERROR && s->lit_len == 0)
+				s->state = after_literals(s);
+			break;
+		case S_OFF_LO:
+			s->offset = b;
+			s->state = S_OFF_HI;
+			break;
+		case S_OFF_HI:
+			s->offset |= b << 8;
+			if (s->match_len == 15 + 4)
+				s->state = S_MATCH_EXT;
+			else
+				s->state = copy_match(s) ? S_TOKEN : S_ERROR;
+			break;
+		case S_MATCH_EXT:
+			s->match_len += b;
+			if (b != 255)
+				s->state = copy_match(s) ? S_TOKEN : S_ERROR;
+			break;
+		}
+	}
+	if (s->state == S_TOKEN && s->out_len == s->out_total) {	// block ended with a match
+		flush(s);
+		s->state = S_DONE;
+	}
+	return s->state == S_DONE ? 1 : s->state == S_ERROR ? -1 : 0;
+}
@@ -0,0 +1,41 @@
+#ifndef MY_LZ4_H
+#define MY_LZ4_H
+
+#include "xil_types.h"
+
+/*
+ * Streaming decoder for the LZ4 block format (no frame header), as produced
+ * by pc/lz4.py. Compressed data can be fed in pieces of any size. Decoded
+ * bytes go through a 64KB history window and are handed to the sink in
+ * pieces of at most LZ4_WINDOW/2 bytes, so the whole ROM never needs to be
+ * held in memory.
+ */
+#define LZ4_WINDOW	(64*1024)
+
+typedef void (*lz4_sink)(u8 *buf, int len);
+
+typedef struct {
+	int state;
+	u32 lit_len;		// literals left to copy
+	u32 match_len;
+	u32 offset;
+	u32 out_len;		// bytes decoded so far
+	u32 out_total;		// bytes expected
+	u32 flushed;		// bytes already given to sink
+	lz4_sink sink;
+	u8 window[LZ4_WINDOW];
+} lz4_stream;
+
+/*
+ * Start decoding a block that expands to out_total bytes.
+ */
+void lz4_init(lz4_stream *s, u32 out_total, lz4_sink sink);
+
+/*
+ * Feed len bytes of compressed data.
+ * Return: 1 when all out_total bytes are decoded (and sent to the sink),
+ *         0 when more input is needed, -1 if data is corrupt.
+ */
+int lz4_feed(lz4_stream *s, const u8 *buf, int len);
+
+#endif
@@ -1,14 +1,28 @@
+#include <string.h>
 #include "xuartps.h"
 #include "xscugic.h"		/* Interrupt controller device driver */
 #include "xil_printf.h"
+#include "xil_cache.h"
+#include "xtime_l.h"
 #include "platform.h"
+#ifdef XPAR_AXIDMA_0_DEVICE_ID
+#include "xaxidma.h"
+#endif
 
 #include "displayport.h"
+#include "parameters.h"
 #include "uart.h"
+#include "lz4.h"
+#include "rewind.h"
 
 u32 *reg0 = (u32 *)XPAR_NES_KV260_0_BASEADDR;
 u32 *reg1 = (u32 *)(XPAR_NES_KV260_0_BASEADDR+4);
+u32 *reg2 = (u32 *)(XPAR_NES_KV260_0_BASEADDR+8);
+u32 *reg3 = (u32 *)(XPAR_NES_KV260_0_BASEADDR+12);
+u32 *reg4 = (u32 *)(XPAR_NES_KV260_0_BASEADDR+16);	// ROM data, see loader_send()
+u32 *perf_reg = (u32 *)(XPAR_NES_KV260_0_BASEADDR+0x40);	// registers 16-31
 
+// Commands can go out at any time, also while a ROM loads (its data is in reg4)
 void command(u32 v) {
 	*reg0 = v;
 }
@@ -17,6 +31,25 @@ u32 status() {
 	return *reg1;
 }
 
+#define STATUS_VIDEO_LOCKED	(1 << 4)	// nes_dp output is locked to NES frames
+#define STATUS_DDR_ROM		(1 << 5)	// FPGA reads cartridge ROM from DDR, see RomImage
+#define STATUS_TURBO		(1 << 6)	// NES runs at 2x
+#define STATUS_FROZEN		(1 << 7)	// NES is stopped, save state is accessible through reg3
+#define STATUS_SS_ERROR		(1 << 8)	// save state chain does not fit in the FPGA buffer
+#define STATUS_BUTTONS		16			// bits 31:16, the buttons the NES has, pad 2 on top
+
+// Read one of the FPGA counters
+#define COUNTER_ROM_HITS		0
+#define COUNTER_ROM_MISSES		1
+#define COUNTER_ROM_STALL		2		// clk cycles the NES waited for ROM data
+#define COUNTER_ROM_MAX_STALL	3
+#define COUNTER_CHAIN_LEN		4		// bits of NES registers in a save state
+#define COUNTER_FRAMES			5		// vblanks since the game started
+u32 counter(int i) {
+	command(7 | i << 8);
+	return *reg2;
+}
+
 // return 1 if not successful
 int expect(int got, int exp, char *msg) {
 	if (got == exp) {
@@ -28,32 +61,929 @@ int expect(int got, int exp, char *msg) {
 	}
 }
 
-#define UART_CMD_INES 1
+#ifdef XPAR_AXIDMA_0_DEVICE_ID
+/*
+ * AXI DMA (MM2S) that streams ROM data into NES_KV260's s00_axis port.
+ * A whole ROM goes across in a few large bursts, instead of one AXI-Lite
+ * write per byte.
+ */
+XAxiDma Dma;
+int dma_ready = 0;
+
+#define DMA_CHUNK	(1024*1024)		// max bytes per transfer, DMA length register is 23 bits
+#define DMA_TIMEOUT_MS	1000		// a chunk takes ~50ms to drain into GameLoader
+
+int dma_init() {
+	XAxiDma_Config *cfg = XAxiDma_LookupConfig(XPAR_AXIDMA_0_DEVICE_ID);
+	if (cfg == NULL || XAxiDma_CfgInitialize(&Dma, cfg) != XST_SUCCESS)
+		return XST_FAILURE;
+	if (XAxiDma_HasSg(&Dma))		// we only do simple mode
+		return XST_FAILURE;
+	XAxiDma_IntrDisable(&Dma, XAXIDMA_IRQ_ALL_MASK, XAXIDMA_DMA_TO_DEVICE);
+	dma_ready = 1;
+	return XST_SUCCESS;
+}
+
+// Stop a transfer that does not finish, and get the DMA ready for the next
+void dma_reset() {
+	XAxiDma_Reset(&Dma);
+	for (int i = 0; i < 10000 && !XAxiDma_ResetIsDone(&Dma); i++) {}
+	XAxiDma_IntrDisable(&Dma, XAXIDMA_IRQ_ALL_MASK, XAXIDMA_DMA_TO_DEVICE);
+}
+
+// Send len bytes to the loader through the DMA. Blocks until done, or until
+// the loader stops taking data for DMA_TIMEOUT_MS.
+int dma_send(u8 *buf, int len) {
+	XTime start, now;
+	Xil_DCacheFlushRange((UINTPTR)buf, len);
+	while (len > 0) {
+		int n = len < DMA_CHUNK ? len : DMA_CHUNK;
+		if (XAxiDma_SimpleTransfer(&Dma, (UINTPTR)buf, n, XAXIDMA_DMA_TO_DEVICE) != XST_SUCCESS)
+			return XST_FAILURE;
+		XTime_GetTime(&start);
+		while (XAxiDma_Busy(&Dma, XAXIDMA_DMA_TO_DEVICE)) {
+			XTime_GetTime(&now);
+			if (now - start > COUNTS_PER_SECOND / 1000 * DMA_TIMEOUT_MS) {
+				dma_reset();
+				return XST_FAILURE;
+			}
+		}
+		buf += n;
+		len -= n;
+	}
+	return XST_SUCCESS;
+}
+#endif
+
+/*
+ * With a DDR_ROM bitstream, the FPGA reads cartridge ROM from this copy in DDR,
+ * through a small cache in PL, instead of keeping all of it in UltraRAM.
+ * Layout is the same as NES memory addresses: PRG ROM at 0, CHR ROM at 2MB.
+ * The loader still gets the whole ines file, for the header.
+ */
+#define ROM_PRG_MAX		(2*1024*1024)
+#define ROM_CHR_MAX		(1024*1024)
+#if DDR_ROM
+u8 RomImage[ROM_PRG_MAX + ROM_CHR_MAX] __attribute__ ((aligned(4096)));
+#endif
+int rom_image;			// 1: ines data also goes to RomImage
+int loader_failed;		// ines data could not be sent, the rest is dropped
+u32 rom_pos;			// bytes of ines data seen so far
+u8 rom_header[16];
+
+// Copy ines data into RomImage, as it goes to the loader. The header is
+// kept even without rom_image, for the save state layout.
+void rom_image_send(u8 *buf, int len) {
+	while (len > 0) {
+		if (rom_pos < 16) {
+			rom_header[rom_pos++] = *buf++;
+			len--;
+			continue;
+		}
+#if DDR_ROM
+		u32 prg = rom_header[4] * 16384, chr = rom_header[5] * 8192;
+		u32 pos = rom_pos - 16;
+		u32 dst, end, n;
+		if (pos < prg) {
+			dst = pos;
+			end = prg < ROM_PRG_MAX ? prg : ROM_PRG_MAX;
+			n = prg - pos;
+		} else if (pos < prg + chr) {
+			dst = ROM_PRG_MAX + pos - prg;
+			end = ROM_PRG_MAX + (chr < ROM_CHR_MAX ? chr : ROM_CHR_MAX);
+			n = prg + chr - pos;
+		} else
+			return;			// trailing data
+		if (n > len)
+			n = len;
+		if (rom_image && dst < end)		// anything too large is dropped, see rom_image_done()
+			memcpy(RomImage + dst, buf, dst + n <= end ? n : end - dst);
+		rom_pos += n;
+		buf += n;
+		len -= n;
+#else
+		return;				// only the header is needed
+#endif
+	}
+}
+
+#if DDR_ROM
+// Hand RomImage over to the FPGA, after all ines data is sent
+void rom_image_done() {
+	if (rom_header[4] * 16384 > ROM_PRG_MAX || rom_header[5] * 8192 > ROM_CHR_MAX)
+		prt("ROM too large, max 2MB PRG and 1MB CHR\r\n");
+	Xil_DCacheFlushRange((UINTPTR)RomImage, sizeof(RomImage));
+	command(6);		// command: ROM image address
+	command((u32)(UINTPTR)RomImage);
+}
+#endif
+
+// Start a ROM transfer of len bytes. Data writes are then packed, 4 bytes
+// per word (little-endian). The loader drops the extra bytes in the last word.
+// Data goes to reg4, so commands through reg0 can still go out in between.
+void loader_start(int len) {
+	rom_image = (status() & STATUS_DDR_ROM) != 0;
+	if (rom_image && !DDR_ROM) {
+		prt("The bitstream reads ROM from DDR, set DDR_ROM in parameters.h\r\n");
+		rom_image = 0;
+	}
+	rom_pos = 0;
+	loader_failed = 0;
+	command(2);		// reset loader
+	command(4);		// command: ines, packed
+	command(len);
+}
+
+// Send ROM data to the loader, after loader_start()
+void loader_send(u8 *buf, int len) {
+	if (loader_failed)
+		return;
+	rom_image_send(buf, len);
+#ifdef XPAR_AXIDMA_0_DEVICE_ID
+	if (dma_ready) {
+		if (dma_send(buf, len) != XST_SUCCESS) {
+			// The rest of the transfer still comes in from the PC, and is dropped
+			prt("DMA transfer failed, loading stopped\r\n");
+			loader_failed = 1;
+			command(2);		// reset loader, ends the transfer
+		}
+		return;
+	}
+#endif
+	// buf may not be word aligned, so assemble words byte by byte
+	for (int i = 0; i < len; i += 4) {
+		u32 w = buf[i];
+		if (i+1 < len) w |= buf[i+1] << 8;
+		if (i+2 < len) w |= buf[i+2] << 16;
+		if (i+3 < len) w |= buf[i+3] << 24;
+		*reg4 = w;
+	}
+}
+
+#define UART_CMD_INES 1			// followed by u32 len, then chunks
 #define UART_CMD_BTNS 2
+#define UART_CMD_INES_LZ4 3		// followed by u32 raw_len, u32 comp_len, then chunks of LZ4 block
+#define UART_CMD_BAUD 4			// followed by u32 baud, see uart_change_baud()
+#define UART_CMD_INPUT 5		// followed by flags, pad 1, pad 2, [u32 timestamp]. No echo,
+								// unless asked for with INPUT_FLAG_ECHO.
+#define UART_CMD_STATS 6		// print input stats
+#define UART_CMD_CHUNK 7		// followed by next chunk of ines data and its CRC32
+#define UART_CMD_VIDEO 8		// followed by video flags, see below
+#define UART_CMD_SPEED 9		// followed by emulation speed: 1 (normal), 2 (2x)
+#define UART_CMD_STATE 10		// followed by op (1: save, 2: load) and slot, see below
+#define UART_CMD_REWIND 11		// followed by frames between rewind snapshots, 0: off
+#define UART_CMD_PERF 12		// followed by seconds between performance reports, 0: off
+#define UART_CMD_PALETTE 13		// followed by sets (1 or 8), then sets * 64 colors of RGB
+
+#define INPUT_FLAG_TS	1		// flags bit 0: timestamp (PC time in us) follows
+#define INPUT_FLAG_ECHO	2		// flags bit 1: send UART_ECHO and the timestamp back once the
+								// buttons are written to PL, for the PC to time the round trip
+								// flags bits 7:4: number of button changes in this frame
+#define VIDEO_FLAG_GENLOCK	1	// video flags bit 0: lock output frames to NES frames
+#define VIDEO_FLAG_SCALE	6	// bits 2:1: 0 integer (4x), 1 fill lines (4.5x), 2 4.5x with 8:7 pixels
+#define VIDEO_FLAG_SCANLINES	8	// bit 3: darken the last output line of every NES line
+#define VIDEO_FLAG_SMOOTH	16	// bit 4: mix the NES pixels an output pixel falls between
+
+static const char *video_scales[] = {"4x", "4.5x", "4.5x 8:7", "4x"};
+
+#define MAX_INES_LEN	(16 + ROM_PRG_MAX + ROM_CHR_MAX)
+#define CHUNK_TIMEOUT_MS	200	// a chunk that stops half way is NAK'ed
+
+lz4_stream Lz4;
+int lz4_result;
+
+// Decompress a received chunk of an LZ4 block straight into the loader
+void loader_send_lz4(u8 *buf, int len) {
+	if (lz4_result == 0)
+		lz4_result = lz4_feed(&Lz4, buf, len);
+}
+
+/*
+ * Frame interrupt. NES_KV260 pulses pl_ps_irq0 as the NES enters vblank. The
+ * handler only counts; the main loop sees the count change and does the work
+ * of the frame in frame_poll(), so it never cuts into a reg0 command sequence.
+ *
+ * Controller input is latched by the FPGA: buttons written with command 3 are
+ * pending until the NES enters vblank, and then taken all at once, right
+ * before its NMI handler reads the joypads, at the same point of every frame
+ * however late the main loop is. They are written as soon as they come in,
+ * except that a button changing a second time before the vblank (a tap
+ * shorter than a frame) waits in PadQueue for the next one, so the game still
+ * sees the tap. Without frame interrupts (no game running) nothing waits.
+ */
+#ifdef XPAR_FABRIC_NES_KV260_0_FRAME_IRQ_INTR
+#define FRAME_INTR_ID	XPAR_FABRIC_NES_KV260_0_FRAME_IRQ_INTR
+#else
+#define FRAME_INTR_ID	121		// pl_ps_irq0[0]
+#endif
+#define FRAME_SYNC_MS	100		// longer without a vblank: no game running
+#define PAD_QUEUE		8		// changes between two vblanks
+
+volatile u32 Frames;			// vblanks seen
+volatile XTime FrameTime;		// of the last one
+u32 FrameDone;					// last frame handled by frame_poll()
+
+struct {
+	u32 cmd;					// command(3 | pad1 << 8 | pad2 << 16)
+	XTime time;					// when it came in
+	int echo;					// send ts back once written
+	u32 ts;
+} PadQueue[PAD_QUEUE];
+int PadHead, PadCount;
+u32 PadLast = 3;				// last command written
+
+struct {
+	u32 count;					// changes written since the last vblank
+	XTime first;				// when the first of them came in
+	XTime time_sum;				// when they came in, summed
+	XTime written;				// when the last was written
+} PadNew;
+
+struct {
+	u32 frames;					// handled by frame_poll()
+	u32 skipped;				// vblanks frame_poll() was too late for
+	u64 late_sum;				// vblank to frame_poll(), in XTime ticks
+	u64 late_max;
+	u32 pads;					// button changes latched at vblank
+	u64 wait_sum;				// input arriving to its vblank
+	u64 wait_max;
+} FrameStats;
+
+void frame_isr(void *arg) {
+	XTime now;
+	XTime_GetTime(&now);
+	FrameTime = now;
+	Frames++;
+}
+
+int frame_init(XScuGic *intr) {
+	if (XScuGic_Connect(intr, FRAME_INTR_ID, (Xil_ExceptionHandler)frame_isr, NULL) != XST_SUCCESS)
+		return XST_FAILURE;
+	XScuGic_SetPriorityTriggerType(intr, FRAME_INTR_ID, 0xA0, 0x03);	// rising edge
+	XScuGic_Enable(intr, FRAME_INTR_ID);
+	return XST_SUCCESS;
+}
+
+// Frame interrupts are coming in
+int frame_sync() {
+	XTime now;
+	XTime_GetTime(&now);
+	return now - FrameTime < COUNTS_PER_SECOND / 1000 * FRAME_SYNC_MS;
+}
+
+// Tell the PC its input frame with timestamp ts has reached the NES
+void input_echo(u32 ts) {
+	u8 b[5] = {UART_ECHO, ts, ts >> 8, ts >> 16, ts >> 24};
+	uart_send(b, 5);
+}
+
+// Buttons the NES has now, as a command 3
+u32 pads_latched() {
+	return 3 | (status() >> STATUS_BUTTONS) << 8;
+}
+
+// Write buttons, which came in at time, to PL for the next vblank
+void pads_write(u32 cmd, XTime time) {
+	command(cmd);
+	PadLast = cmd;
+	if (PadNew.count++ == 0)
+		PadNew.first = time;
+	PadNew.time_sum += time;
+	XTime_GetTime(&PadNew.written);
+}
+
+// Buttons for the NES, at the next vblank. Echo *ts back if not NULL.
+void pads_push(u32 cmd, XTime time, const u32 *ts) {
+	if (!frame_sync() ||
+			(PadCount == 0 && !((cmd ^ PadLast) & (PadLast ^ pads_latched())))) {
+		for (; PadCount > 0; PadCount--) {		// no vblank to wait for
+			if (PadQueue[PadHead].echo)
+				input_echo(PadQueue[PadHead].ts);
+			PadHead = (PadHead + 1) % PAD_QUEUE;
+		}
+		pads_write(cmd, time);
+		if (ts)
+			input_echo(*ts);
+		return;
+	}
+	if (PadCount == PAD_QUEUE)		// full, the last one is replaced
+		PadCount--;
+	int i = (PadHead + PadCount++) % PAD_QUEUE;
+	PadQueue[i].cmd = cmd;
+	PadQueue[i].time = time;
+	PadQueue[i].echo = ts != NULL;
+	PadQueue[i].ts = ts ? *ts : 0;
+}
+
+// Called from the main loop
+void frame_poll() {
+	XTime now, t = FrameTime;
+	u32 frames = Frames;
+	if (frames == FrameDone)
+		return;
+	XTime_GetTime(&now);
+	// What was written before the vblank went to the NES then
+	if (PadNew.count && PadNew.written < t) {
+		FrameStats.pads += PadNew.count;
+		FrameStats.wait_sum += PadNew.count * t - PadNew.time_sum;
+		if (t - PadNew.first > FrameStats.wait_max)
+			FrameStats.wait_max = t - PadNew.first;
+		memset(&PadNew, 0, sizeof(PadNew));
+	}
+	if (PadCount > 0) {
+		// Write the entries up to one that changes a button again
+		u32 latched = pads_latched(), cmd = PadLast;
+		while (PadCount > 0) {
+			u32 next = PadQueue[PadHead].cmd;
+			if ((next ^ cmd) & (cmd ^ latched))
+				break;
+			cmd = next;
+			pads_write(cmd, PadQueue[PadHead].time);
+			if (PadQueue[PadHead].echo)
+				input_echo(PadQueue[PadHead].ts);
+			PadHead = (PadHead + 1) % PAD_QUEUE;
+			PadCount--;
+		}
+	}
+	if (FrameDone != 0)
+		FrameStats.skipped += frames - FrameDone - 1;
+	FrameDone = frames;
+	FrameStats.frames++;
+	FrameStats.late_sum += now - t;
+	if (now - t > FrameStats.late_max)
+		FrameStats.late_max = now - t;
+}
+
+void frame_stats() {
+	u32 us = COUNTS_PER_SECOND / 1000000;
+	u32 n = FrameStats.frames ? FrameStats.frames : 1, p = FrameStats.pads ? FrameStats.pads : 1;
+	prt("Frames: %u (FPGA %u), %u skipped, handled avg %u us after vblank, max %u us\r\n",
+			FrameStats.frames, counter(COUNTER_FRAMES), FrameStats.skipped,
+			(u32)(FrameStats.late_sum / n / us), (u32)(FrameStats.late_max / us));
+	prt("Input: %u latched at vblank, waited avg %u us, max %u us\r\n",
+			FrameStats.pads, (u32)(FrameStats.wait_sum / p / us), (u32)(FrameStats.wait_max / us));
+}
+
+/*
+ * Save states. The FPGA stops the NES at the end of a frame, then the whole
+ * machine state is copied word by word through reg3. See SaveState in
+ * NES_KV260.v for the address map.
+ *
+ * StateCur is a copy of the state at the last freeze. Once it has been read in
+ * full, a freeze only reads the regions the FPGA does not track and the blocks
+ * it reports dirty, which is what makes rewind snapshots cheap.
+ *
+ * How much PRG RAM and CHR RAM there is comes from the ines header of the
+ * game (state_layout()). The FPGA tracks the first 8KB of each, the rest is
+ * read in full at every freeze.
+ */
+#define STATE_SLOTS		4
+#define STATE_FREEZE_MS	100		// a frame is 17ms
+#define STATE_DIRTY		0x00c00	// dirty block bits, 4 words
+#define STATE_TRACKED	0x2000	// bytes of PRG RAM and CHR RAM with dirty bits
+#define STATE_PRG_MAX	0x10000	// $10000-$1ffff
+#define STATE_CHR_MAX	0x20000	// $20000-$3ffff
+
+enum { SR_PRG = 4, SR_PRG_REST, SR_CHR, SR_CHR_REST };
+struct {
+	u32 addr, len;
+	int dirty;				// bit of the first 256-byte block, -1: not tracked
+} StateRegions[] = {
+	{0x00000, 0x540, -1},	// OAM, palette and MMC5 expansion RAM
+	{0x00800, 0x400, -1},	// chain buffer, all NES registers
+	{0x01000, 0x800, 0},	// internal RAM
+	{0x01800, 0x800, 8},	// VRAM
+	{0x10000, 0x2000, 16},	// PRG RAM, lengths set by state_layout()
+	{0x12000, 0, -1},
+	{0x20000, 0x2000, 48},	// CHR RAM
+	{0x22000, 0, -1},
+};
+#define STATE_REGIONS	(sizeof(StateRegions) / sizeof(StateRegions[0]))
+#define STATE_WORDS		((0x540 + 0x400 + 0x800 + 0x800 + STATE_PRG_MAX + STATE_CHR_MAX) / 4)
+
+struct {
+	u32 valid;
+	u32 chain_len;			// has to match the running bitstream
+	u32 data[STATE_WORDS];
+} StateSlots[STATE_SLOTS];
+
+u32 StateCur[STATE_WORDS];
+u32 StateWords = (0x540 + 0x400 + 0x800 + 0x800 + 0x2000 + 0x2000) / 4;	// used by the game
+int StateSynced;			// StateCur is the state at the last freeze
+u32 StateBuf[STATE_TRACKED / 4];	// largest read at once
+
+// Bytes of memory from an NES 2.0 size nibble
+static u32 nes2_size(int n) {
+	return n ? 64 << n : 0;
+}
+
+// Size the PRG RAM and CHR RAM regions from an ines header
+void state_layout(const u8 *h) {
+	u32 prg, chr;
+	if ((h[7] & 0x0c) == 0x08) {	// NES 2.0: volatile and battery-backed RAM
+		prg = nes2_size(h[10] & 15) + nes2_size(h[10] >> 4);
+		chr = nes2_size(h[11] & 15) + nes2_size(h[11] >> 4);
+	} else {
+		prg = (h[8] ? h[8] : 1) * 0x2000;	// 0 means 8KB
+		chr = h[5] ? 0 : 0x2000;			// 8KB of CHR RAM without CHR ROM
+	}
+	prg = prg > STATE_PRG_MAX ? STATE_PRG_MAX : (prg + 255) & ~255;
+	chr = chr > STATE_CHR_MAX ? STATE_CHR_MAX : (chr + 255) & ~255;
+	StateRegions[SR_PRG].len = prg < STATE_TRACKED ? prg : STATE_TRACKED;
+	StateRegions[SR_PRG_REST].len = prg - StateRegions[SR_PRG].len;
+	StateRegions[SR_CHR].len = chr < STATE_TRACKED ? chr : STATE_TRACKED;
+	StateRegions[SR_CHR_REST].len = chr - StateRegions[SR_CHR].len;
+	StateWords = 0;
+	for (int i = 0; i < STATE_REGIONS; i++)
+		StateWords += StateRegions[i].len / 4;
+}
+rewind_ring Rewind;
+
+// Stop the NES at the end of the current frame. Return 0 if it does not
+// stop, i.e. no game is running.
+int state_freeze() {
+	XTime start, now;
+	command(9 | 1 << 8);
+	XTime_GetTime(&start);
+	while (!(status() & STATUS_FROZEN)) {
+		XTime_GetTime(&now);
+		if (now - start > COUNTS_PER_SECOND / 1000 * STATE_FREEZE_MS) {
+			command(9 | 2 << 8);	// cancel
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Read n words of the frozen state from addr
+void state_read(u32 addr, u32 *data, int n) {
+	command(10 | addr << 8);
+	for (int i = 0; i < n; i++)
+		data[i] = *reg3;
+}
+
+// Write StateCur into the frozen FPGA
+void state_write() {
+	u32 *data = StateCur;
+	for (int i = 0; i < STATE_REGIONS; i++) {
+		command(10 | StateRegions[i].addr << 8);
+		for (int j = 0; j < StateRegions[i].len / 4; j++)
+			*reg3 = *data++;
+	}
+}
+
+// Bring StateCur up to date after a freeze. With record, the change also
+// goes into the rewind ring. Returns the number of words read.
+int state_sync(int record) {
+	u32 dirty[4];
+	int off = 0, words = 4;
+	state_read(STATE_DIRTY, dirty, 4);
+	if (!StateSynced) {
+		rewind_clear(&Rewind);		// nothing to go back to
+		record = 0;
+	}
+	if (record)
+		rewind_begin(&Rewind);
+	for (int i = 0; i < STATE_REGIONS; i++) {
+		int n = StateRegions[i].len / 4;
+		if (!StateSynced || StateRegions[i].dirty < 0) {
+			for (int j = 0; j < n; j += STATE_TRACKED / 4) {
+				int k = n - j < STATE_TRACKED / 4 ? n - j : STATE_TRACKED / 4;
+				state_read(StateRegions[i].addr + j * 4, StateBuf, k);
+				rewind_update(&Rewind, StateCur, off + j, StateBuf, k);
+			}
+			words += n;
+		} else {
+			for (int b = 0; b < n / 64; b++) {
+				int bit = StateRegions[i].dirty + b;
+				if (!(dirty[bit / 32] & 1u << bit % 32))
+					continue;
+				state_read(StateRegions[i].addr + b * 256, StateBuf, 64);
+				rewind_update(&Rewind, StateCur, off + b * 64, StateBuf, 64);
+				words += 64;
+			}
+		}
+		off += n;
+	}
+	if (record)
+		rewind_end(&Rewind);
+	StateSynced = 1;
+	return words;
+}
+
+/*
+ * Rewind. Every RewindFrames frames the main loop freezes the NES, brings
+ * StateCur up to date and records the change in the Rewind ring. While the
+ * chord is held on controller 1, each step instead writes the previous
+ * snapshot back and lets the NES run one frame of it to show the picture.
+ */
+#define REWIND_CHORD	(1 << 2 | 1 << 6)	// Select + Left
+#define FRAME_TICKS		(COUNTS_PER_SECOND / 60)
 
+enum { RW_RUN, RW_FREEZE, RW_FROZEN };
+int RewindFrames;			// frames between snapshots, 0: off
+int Rewinding;				// chord is held
+int RewindStepped;			// FPGA runs a snapshot written back by a step
+int RewindState = RW_RUN;
+XTime RewindLast;			// last snapshot or step
+u32 RewindFrame;			// Frames at the last snapshot
+XTime RewindAsked;			// freeze command
+
+struct {
+	u32 snapshots;
+	u64 words;				// read through reg3
+	u64 time_sum;			// in XTime ticks, NES frozen
+	u64 time_max;
+} RewindStats;
+
+// Controller buttons from the PC, which came in at time. The chord stays
+// out of the game.
+void buttons(u32 pad1, u32 pad2, XTime time, const u32 *ts) {
+	Rewinding = RewindFrames && (pad1 & REWIND_CHORD) == REWIND_CHORD;
+	if (Rewinding)
+		pad1 = pad2 = 0;
+	pads_push(3 | pad1 << 8 | pad2 << 16, time, ts);	// the 2 bytes are packed with the command
+}
+
+// The NES was frozen and resumed outside of rewind_poll()
+void rewind_restart() {
+	RewindState = RW_RUN;
+	RewindStepped = 0;
+	XTime_GetTime(&RewindLast);
+	RewindFrame = Frames;
+}
+
+// Called from the main loop
+void rewind_poll() {
+	XTime now, done;
+	if (!RewindFrames)
+		return;
+	XTime_GetTime(&now);
+	switch (RewindState) {
+	case RW_RUN:
+		if (Rewinding || Frames - RewindFrame >= RewindFrames) {
+			command(9 | 1 << 8);	// freeze at the end of the next frame
+			RewindAsked = now;
+			RewindState = RW_FREEZE;
+		}
+		break;
+	case RW_FREEZE:
+		if (status() & STATUS_FROZEN) {
+			RewindState = RW_FROZEN;
+		} else if (now - RewindAsked > COUNTS_PER_SECOND / 1000 * STATE_FREEZE_MS) {
+			command(9 | 2 << 8);	// no game running, cancel
+			rewind_restart();
+		}
+		break;
+	case RW_FROZEN:
+		if (status() & STATUS_SS_ERROR) {
+			prt("Rewind: chain too long for the FPGA buffer, off\r\n");
+			RewindFrames = 0;
+			command(9 | 2 << 8);
+			rewind_restart();
+		} else if (Rewinding && StateSynced) {
+			if (now - RewindLast < FRAME_TICKS * RewindFrames)
+				break;				// keep showing the last step
+			// The first step goes to the last snapshot itself
+			if (RewindStepped && !rewind_pop(&Rewind, StateCur))
+				break;				// at the oldest snapshot
+			state_write();
+			RewindStepped = 1;
+			RewindLast = now;
+			command(9 | 2 << 8);	// resume, with the snapshot
+			command(9 | 1 << 8);	// and stop again after one frame
+			RewindAsked = now;
+			RewindState = RW_FREEZE;
+		} else {
+			int words = state_sync(1);
+			command(9 | 2 << 8);
+			XTime_GetTime(&done);
+			RewindStats.snapshots++;
+			RewindStats.words += words;
+			RewindStats.time_sum += done - now;
+			if (done - now > RewindStats.time_max)
+				RewindStats.time_max = done - now;
+			rewind_restart();
+		}
+		break;
+	}
+}
+
+void rewind_config(int frames) {
+	if (RewindState != RW_RUN) {
+		if (RewindState == RW_FREEZE)
+			state_freeze();			// let it finish, or cancel
+		command(9 | 2 << 8);
+		StateSynced = 0;
+	}
+	RewindFrames = frames;
+	memset(&RewindStats, 0, sizeof(RewindStats));
+	rewind_clear(&Rewind);
+	rewind_restart();
+	if (frames)
+		prt("Rewind: snapshot every %d frames, hold Select+Left to go back\r\n", frames);
+	else
+		prt("Rewind: off\r\n");
+}
+
+void rewind_stats() {
+	u32 us = COUNTS_PER_SECOND / 1000000;
+	u32 n = RewindStats.snapshots;
+	if (!RewindFrames || !n)
+		return;
+	u32 avg = RewindStats.time_sum / n / us;
+	// The FPGA shifts the chain out, measures it and shifts it back in, at 21.477MHz
+	u32 chain_us = (8192 + 2 * counter(COUNTER_CHAIN_LEN)) / 21;
+	prt("Rewind: %u snapshots, avg %u us + %u us chain (%u us per frame), max %u us, %u words read\r\n",
+			n, avg, chain_us, (avg + chain_us) / RewindFrames, (u32)(RewindStats.time_max / us),
+			(u32)(RewindStats.words / n));
+	prt("Rewind: %u snapshots kept, %u KB, %u seconds\r\n", Rewind.count, Rewind.used / 256,
+			Rewind.count * RewindFrames / 60);
+}
+
+void state_save(int slot) {
+	if (!state_freeze()) {
+		prt("Save state: no game running\r\n");
+		return;
+	}
+	if (status() & STATUS_SS_ERROR) {
+		prt("Save state: chain too long for the FPGA buffer\r\n");
+		StateSynced = 0;
+	} else {
+		state_sync(RewindFrames != 0);
+		StateSlots[slot].chain_len = counter(COUNTER_CHAIN_LEN);
+		memcpy(StateSlots[slot].data, StateCur, StateWords * 4);
+		StateSlots[slot].valid = 1;
+	}
+	command(9 | 2 << 8);		// resume
+	rewind_restart();
+}
+
+void state_load(int slot) {
+	if (!StateSlots[slot].valid) {
+		prt("Load state: slot %d is empty\r\n", slot + 1);
+		return;
+	}
+	if (!state_freeze()) {
+		prt("Load state: no game running\r\n");
+		return;
+	}
+	if (counter(COUNTER_CHAIN_LEN) == StateSlots[slot].chain_len) {
+		memcpy(StateCur, StateSlots[slot].data, StateWords * 4);
+		state_write();
+		rewind_clear(&Rewind);		// snapshots are of another timeline now
+		StateSynced = 1;
+	} else {
+		prt("Load state: slot %d is from a different bitstream\r\n", slot + 1);
+		StateSynced = 0;
+	}
+	command(9 | 2 << 8);		// resume, with the loaded state
+	rewind_restart();
+}
+
+// States belong to the game they were saved from
+void state_clear() {
+	for (int i = 0; i < STATE_SLOTS; i++)
+		StateSlots[i].valid = 0;
+	StateSynced = 0;
+	rewind_clear(&Rewind);
+	rewind_restart();
+}
+
+/*
+ * Performance counters of the FPGA, see NES_KV260.v. They run freely, so a
+ * report shows what changed since the last one.
+ */
+const char *PerfNames[] = {
+	"frames", "CPU cycles", "paused for DMA", "mapper IRQs", "NMIs", "overflow lines",
+	"CPU reads", "PPU reads", "writes", "loader bytes", "stalled clk",
+};
+#define PERF_COUNTERS	(sizeof(PerfNames) / sizeof(PerfNames[0]))
+
+int PerfSeconds;			// between reports, 0: off
+XTime PerfLast;
+u32 PerfPrev[PERF_COUNTERS];
+
+void perf_report() {
+	XTime now;
+	u32 d[PERF_COUNTERS];
+	XTime_GetTime(&now);
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		u32 v = perf_reg[i];
+		d[i] = v - PerfPrev[i];
+		PerfPrev[i] = v;
+	}
+	u32 ms = (now - PerfLast) / (COUNTS_PER_SECOND / 1000);
+	u32 frames = d[0] ? d[0] : 1;
+	PerfLast = now;
+	prt("Perf %u ms: %u frames", ms, d[0]);
+	for (int i = 1; i < PERF_COUNTERS; i++)		// per frame, if there are any
+		prt(", %s %u%s", PerfNames[i], d[i] / frames, d[0] ? "/f" : "");
+	prt("\r\n");
+}
+
+void perf_config(int seconds) {
+	PerfSeconds = seconds;
+	for (int i = 0; i < PERF_COUNTERS; i++)
+		PerfPrev[i] = perf_reg[i];
+	XTime_GetTime(&PerfLast);
+	if (seconds)
+		prt("Performance report every %d s\r\n", seconds);
+}
+
+// Called from the main loop
+void perf_poll() {
+	XTime now;
+	if (!PerfSeconds)
+		return;
+	XTime_GetTime(&now);
+	if (now - PerfLast >= (XTime)COUNTS_PER_SECOND * PerfSeconds)
+		perf_report();
+}
+
+/*
+ * Palette of nes_dp: 64 colors for each of the 8 combinations of the PPU
+ * emphasis bits, entry {emphasis, color}, as in a 512-color .pal file. A
+ * 64-color palette gets the emphasized ones made the way nes_dp makes its
+ * built-in ones, with the two other components dimmed to ~82%.
+ */
+#define PALETTE_COLORS	64
+#define PALETTE_SETS	8		// emphasis bits: 1 red, 2 green, 4 blue
+
+static u8 dim(u8 c) {
+	return c * 209 >> 8;
+}
+
+void palette_load(const u8 *rgb, int sets) {
+	command(11);			// palette address 0, writes go on from there
+	for (int e = 0; e < PALETTE_SETS; e++)
+		for (int i = 0; i < PALETTE_COLORS; i++) {
+			const u8 *p = rgb + ((sets == 1 ? 0 : e) * PALETTE_COLORS + i) * 3;
+			u8 r = p[0], g = p[1], b = p[2];
+			if (sets == 1) {
+				if (e & 6) r = dim(r);
+				if (e & 5) g = dim(g);
+				if (e & 3) b = dim(b);
+			}
+			command(12 | (u32)r << 24 | g << 16 | b << 8);
+		}
+	prt("Palette loaded, %d colors\r\n", sets * PALETTE_COLORS);
+}
+
+/*
+ * Input latency counters. Latency here is the PS part only: from the main
+ * loop seeing the command byte of an input frame to the buttons being
+ * written to loader_btn, or queued for the next vblank (see FrameStats).
+ * End to end latency, including the UART, is measured by the PC: it sets
+ * INPUT_FLAG_ECHO on some frames and times the UART_ECHO coming back.
+ */
+struct {
+	u32 frames;				// input frames
+	u32 changes;			// button changes coalesced into them (by PC)
+	u64 lat_sum;			// in XTime ticks
+	u64 lat_max;
+	u32 last_ts;			// PC timestamp of last frame
+} InputStats;
+
+// Buttons of an input frame go out first, stats after
+void input_frame(u32 flags, u32 pad1, u32 pad2, XTime start, const u32 *ts) {
+	XTime now;
+	buttons(pad1, pad2, start, ts);
+	XTime_GetTime(&now);
+	InputStats.frames++;
+	InputStats.changes += flags >> 4;
+	InputStats.lat_sum += now - start;
+	if (now - start > InputStats.lat_max)
+		InputStats.lat_max = now - start;
+}
+
+void input_stats() {
+	u32 us = COUNTS_PER_SECOND / 1000000;
+	u32 avg = InputStats.frames ? InputStats.lat_sum / InputStats.frames / us : 0;
+	prt("Input: %d frames, %d changes, latency avg %d us, max %d us, last ts %u\r\n",
+			InputStats.frames, InputStats.changes, avg, (u32)(InputStats.lat_max / us),
+			InputStats.last_ts);
+	frame_stats();
+	prt("Video: genlock %s\r\n", status() & STATUS_VIDEO_LOCKED ? "locked" : "not locked");
+	if (status() & STATUS_DDR_ROM)
+		prt("ROM cache: %u hits, %u misses, stalled %u cycles, max %u\r\n",
+				counter(COUNTER_ROM_HITS), counter(COUNTER_ROM_MISSES),
+				counter(COUNTER_ROM_STALL), counter(COUNTER_ROM_MAX_STALL));
+	rewind_stats();
+}
+
+/*
+ * ines transfer in progress. Data comes in UART_CMD_CHUNK commands, so other
+ * commands (controller input) can still get through between chunks.
+ */
+int xfer_len;				// bytes of ines data (compressed for LZ4)
+int xfer_left;				// bytes still to come
+int xfer_lz4;
+void (*xfer_sink)(u8 *buf, int len);
+
+void xfer_start(int ines_len, int comp_len) {
+	state_clear();
+	loader_start(ines_len);
+	xfer_lz4 = comp_len > 0;
+	if (xfer_lz4) {
+		lz4_init(&Lz4, ines_len, loader_send);
+		lz4_result = 0;
+		xfer_sink = loader_send_lz4;
+		xfer_len = comp_len;
+	} else {
+		xfer_sink = loader_send;
+		xfer_len = ines_len;
+	}
+	xfer_left = xfer_len;
+}
+
+void xfer_done() {
+	if (loader_failed) {
+		prt("ROM not loaded, send it again\r\n");
+		return;
+	}
+	if (xfer_lz4 && lz4_result != 1) {
+		prt("Bad compressed ines data\r\n");
+		return;
+	}
+#if DDR_ROM
+	if (rom_image)
+		rom_image_done();
+#endif
+	state_layout(rom_header);
+	prt("Successfully received %d bytes of %sines data.\r\n", xfer_len, xfer_lz4 ? "compressed " : "");
+	prt("Ines data sent to FPGA.\r\n");
+}
+
+u8 CmdBuffer[UART_CHUNK+4];
+
+/*
+ * Main loop. Commands are parsed once all their bytes are in, so nothing here
+ * waits on the UART, and other work can be added to the loop.
+ */
 int uart_process()
 {
-	int ines_len = 0;
 	prt("Waiting for PC...\r\n");
 
-	int state = 0;	// 0: idle, 1: expecting_ines_len, 2:expecting_ines_data, 3: expecting_btns
-	u32 btn_cmd;
+	int state = 0;	// 0: idle, 1: expecting_ines_len, 2: expecting_chunk, 3: expecting_btns,
+					// 4: expecting_lz4_lens, 6: expecting_baud, 7: expecting_input,
+					// 8: expecting_input_ts, 9: expecting_video, 10: expecting_speed,
+					// 11: expecting_state, 12: expecting_rewind, 13: expecting_perf,
+					// 14: expecting_palette_sets, 15: expecting_palette
+	u8 *buf = CmdBuffer;
+	u32 baud;
+	int n, pal_sets = 0;
+	u32 input_flags = 0, input_pads = 0;
+	XTime input_start, now, state_start;
 
 	while (1) {
+		if (uart_poll() == UART_LINK_RESET) {
+			state = 0;
+			xfer_left = 0;
+			continue;
+		}
+		frame_poll();
+		rewind_poll();
+		perf_poll();
+
 		int len = 1;		// command is 1-byte
 		if (state == 1)
 			len = 4;		// ines_len is 4-byte
 		else if (state == 2)
-			len = ines_len;	// actual ines length in bytes
+			len = (xfer_left < UART_CHUNK ? xfer_left : UART_CHUNK) + 4;	// chunk and CRC
 		else if (state == 3)
 			len = 2;		// two bytes for buttons
+		else if (state == 4)
+			len = 8;		// raw and compressed lengths
+		else if (state == 6)
+			len = 4;		// baud rate
+		else if (state == 7)
+			len = 3;		// flags and two pads
+		else if (state == 8)
+			len = 4;		// timestamp
+		else if (state == 9)
+			len = 1;		// video flags
+		else if (state == 10)
+			len = 1;		// speed
+		else if (state == 11)
+			len = 2;		// op and slot
+		else if (state == 12)
+			len = 1;		// rewind frames
+		else if (state == 13)
+			len = 1;		// perf seconds
+		else if (state == 14)
+			len = 1;		// palette sets
+		else if (state == 15)
+			len = pal_sets * PALETTE_COLORS * 3;
 
-		u8 *buf = uart_recv(len);
-		if (buf == 0) {
-			prt("Error receiving %d bytes from UART\r\n", len);
-			state = 0;
+		if (uart_rx_count() < len) {
+			if (state == 2 && uart_rx_count() > 0 && uart_idle_ms() >= CHUNK_TIMEOUT_MS) {
+				uart_nak();	// chunk stopped half way, have PC send it again
+				state = 0;
+			}
 			continue;
 		}
+		uart_read(buf, len);
 
 		switch (state) {
 		case 0:
@@ -64,37 +994,133 @@ int uart_process()
 			} else if (*buf == UART_CMD_BTNS) {
 //				prt("Command: buttons\r\n");
 				state = 3;
+			} else if (*buf == UART_CMD_INES_LZ4) {
+				state = 4;
+			} else if (*buf == UART_CMD_CHUNK && xfer_left > 0) {
+				state = 2;
+			} else if (*buf == UART_CMD_BAUD) {
+				state = 6;
+			} else if (*buf == UART_CMD_INPUT) {
+				XTime_GetTime(&input_start);
+				state = 7;
+			} else if (*buf == UART_CMD_STATS) {
+				input_stats();
+			} else if (*buf == UART_CMD_VIDEO) {
+				state = 9;
+			} else if (*buf == UART_CMD_SPEED) {
+				state = 10;
+			} else if (*buf == UART_CMD_STATE) {
+				state = 11;
+			} else if (*buf == UART_CMD_REWIND) {
+				state = 12;
+			} else if (*buf == UART_CMD_PERF) {
+				state = 13;
+			} else if (*buf == UART_CMD_PALETTE) {
+				state = 14;
+			} else if (*buf == 0) {
+				// left over from a break, ignore
 			} else {
 				prt("Unknown command: %d\r\n", *buf);
 			}
 			break;
 		case 1:
-			ines_len = *((u32 *)buf);
-			if (ines_len > 0 && ines_len < 3*1024*1024) {
-//				prt("ines data length: %d\r\n", ines_len);
-				state = 2;	// continue to get data
+			n = *((u32 *)buf);
+			if (n > 0 && n < MAX_INES_LEN) {
+//				prt("ines data length: %d\r\n", n);
+				xfer_start(n, 0);
 			} else {
-//				prt("bad ines_len: %d\r\n", ines_len);
-				state = 0;
+//				prt("bad ines_len: %d\r\n", n);
 			}
+			state = 0;
 			break;
 		case 2:
-			prt("Successfully received %d bytes of ines data.\r\n", len);
-			command(2);	// reset loader
-			command(1);	// command: ines
-			command(ines_len);
-			for (int i = 0; i < ines_len; i++)
-				command(buf[i]);
+			n = len - 4;
+			if (uart_crc32(buf, n) == (buf[n] | buf[n+1] << 8 | buf[n+2] << 16 | (u32)buf[n+3] << 24)) {
+				uart_ack();		// PC sends the next chunk while we forward this one
+				xfer_sink(buf, n);
+				xfer_left -= n;
+				if (xfer_left == 0)
+					xfer_done();
+			} else
+				uart_nak();
 			state = 0;
-			prt("Ines data sent to FPGA.\r\n");
 			break;
 		case 3:
 			prt("Button update %02x, %02x\r\n", buf[0], buf[1]);
-			btn_cmd = 3;
-			btn_cmd |= buf[0] << 8;
-			btn_cmd |= buf[1] << 16;
-			command(btn_cmd);		// for simplicity the 2 bytes are packed with the command
-									// as a single 32-bit word
+			XTime_GetTime(&now);
+			buttons(buf[0], buf[1], now, NULL);
+			state = 0;
+			break;
+		case 4:
+			n = ((u32 *)buf)[0];
+			len = ((u32 *)buf)[1];
+			if (n > 0 && n < MAX_INES_LEN && len > 0 && len < MAX_INES_LEN)
+				xfer_start(n, len);
+			state = 0;
+			break;
+		case 6:
+			baud = *((u32 *)buf);
+			if (uart_change_baud(baud) == XST_SUCCESS)
+				prt("Baud rate: %d\r\n", baud);
+			state = 0;
+			break;
+		case 7:
+			if (buf[0] & INPUT_FLAG_TS) {
+				input_flags = buf[0];	// buttons go out with the timestamp
+				input_pads = buf[1] | buf[2] << 8;
+				state = 8;
+				break;
+			}
+			input_frame(buf[0], buf[1], buf[2], input_start, NULL);
+			state = 0;
+			break;
+		case 8:
+			InputStats.last_ts = buf[0] | buf[1] << 8 | buf[2] << 16 | (u32)buf[3] << 24;
+			input_frame(input_flags, input_pads & 0xff, input_pads >> 8, input_start,
+					input_flags & INPUT_FLAG_ECHO ? &InputStats.last_ts : NULL);
+			state = 0;
+			break;
+		case 9:
+			command(5 | buf[0] << 8);	// video config, flags packed with the command
+			displayport_genlock(buf[0] & VIDEO_FLAG_GENLOCK);
+			prt("Genlock %s, scale %s%s%s\r\n", buf[0] & VIDEO_FLAG_GENLOCK ? "on" : "off",
+				video_scales[(buf[0] & VIDEO_FLAG_SCALE) >> 1],
+				buf[0] & VIDEO_FLAG_SCANLINES ? ", scanlines" : "",
+				buf[0] & VIDEO_FLAG_SMOOTH ? ", smooth" : "");
+			state = 0;
+			break;
+		case 10:
+			command(8 | buf[0] << 8);	// speed, packed with the command
+			prt("Speed: %dx\r\n", status() & STATUS_TURBO ? 2 : 1);
+			state = 0;
+			break;
+		case 11:
+			if (buf[1] < STATE_SLOTS && (buf[0] == 1 || buf[0] == 2)) {
+				XTime_GetTime(&state_start);
+				if (buf[0] == 1)
+					state_save(buf[1]);
+				else
+					state_load(buf[1]);
+				XTime_GetTime(&now);
+				prt("State %s slot %d, %d us\r\n", buf[0] == 1 ? "save" : "load", buf[1] + 1,
+						(u32)((now - state_start) / (COUNTS_PER_SECOND / 1000000)));
+			}
+			state = 0;
+			break;
+		case 12:
+			rewind_config(buf[0]);
+			state = 0;
+			break;
+		case 13:
+			perf_config(buf[0]);
+			state = 0;
+			break;
+		case 14:
+			pal_sets = buf[0];
+			state = pal_sets == 1 || pal_sets == PALETTE_SETS ? 15 : 0;
+			break;
+		case 15:
+			palette_load(buf, pal_sets);
 			state = 0;
 			break;
 		}
@@ -124,8 +1150,14 @@ int main() {
     }
 
     prt("Starting...\r\n");
+#ifdef XPAR_AXIDMA_0_DEVICE_ID
+    if (dma_init() != XST_SUCCESS)
+    	prt("Cannot init AXI DMA, ROM loading will be slow\r\n");
+#endif
     displayport_init(&Intr);
 	prt("Entire video pipeline activated\r\n");
+	if (frame_init(&Intr) != XST_SUCCESS)
+		prt("Cannot init frame interrupt\r\n");
 
 	uart_process();
 
@@ -41,4 +41,21 @@ SOFTWARE.
 #define VIDEO_COLUMNS	1920
 #define VIDEO_ROWS		1080
 
+/* Output timing, see Timings in displayport.c. AUTO takes the largest one that
+ * fits in the monitor's preferred mode (from its EDID) and on its DP link. */
+#define VIDEO_TIMING_1080P	0
+#define VIDEO_TIMING_720P	1
+#define VIDEO_TIMING_1440P	2
+#define VIDEO_TIMING_AUTO	3
+
+#define VIDEO_TIMING		VIDEO_TIMING_AUTO
+
+/* 1 sends the NES audio with the video, through DP live audio (dp_audio.v).
+ * fpga/sim/audio_test.cpp checks the stream; 0 if a monitor will not take it. */
+#define DP_AUDIO		1
+
+/* 1 for a bitstream built with DDR_ROM (top of NES_KV260.v), which reads
+ * cartridge ROM from a copy in PS DDR, RomImage in main.c. */
+#define DDR_ROM			0
+
 #endif /* SRC_PARAMETERS_H_ */
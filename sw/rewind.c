@@ -0,0 +1,90 @@
+/*
+ * Rewind ring, see rewind.h.
+ */
+#include "rewind.h"
+
+#define MASK	(REWIND_WORDS-1)
+#define NO_RUN	(~0u)
+
+void rewind_clear(rewind_ring *r) {
+	r->head = 0;
+	r->used = 0;
+	r->count = 0;
+	r->len = 0;
+	r->run = NO_RUN;
+}
+
+// Drop the oldest snapshot
+static void drop(rewind_ring *r) {
+	u32 tail = (r->head - r->len - r->used) & MASK;
+	r->used -= r->buf[tail];
+	r->count--;
+}
+
+// Append a word to the snapshot being recorded, dropping old snapshots to
+// make room. Returns 0 and gives up the snapshot if it fills the whole ring.
+static int put(rewind_ring *r, u32 w) {
+	while (r->used + r->len >= REWIND_WORDS) {
+		if (r->count == 0) {
+			r->head = (r->head - r->len) & MASK;
+			r->len = 0;
+			return 0;
+		}
+		drop(r);
+	}
+	r->buf[r->head] = w;
+	r->head = (r->head + 1) & MASK;
+	r->len++;
+	return 1;
+}
+
+void rewind_begin(rewind_ring *r) {
+	r->len = 0;
+	r->run = NO_RUN;
+	put(r, 0);			// len, filled in by rewind_end()
+}
+
+void rewind_update(rewind_ring *r, u32 *state, u32 off, const u32 *data, u32 n) {
+	for (u32 i = 0; i < n; i++) {
+		u32 d = state[off + i] ^ data[i];
+		state[off + i] = data[i];
+		if (d == 0 || r->len == 0)
+			continue;
+		if (r->run == NO_RUN || r->run_next != off + i) {
+			r->run = r->head;
+			if (!put(r, off + i))
+				continue;
+		}
+		if (!put(r, d))
+			continue;
+		r->buf[r->run] += 1 << 16;
+		r->run_next = off + i + 1;
+	}
+}
+
+void rewind_end(rewind_ring *r) {
+	if (r->len == 0 || !put(r, r->len + 1))
+		return;
+	r->buf[(r->head - r->len) & MASK] = r->len;
+	r->used += r->len;
+	r->count++;
+	r->len = 0;
+	r->run = NO_RUN;
+}
+
+int rewind_pop(rewind_ring *r, u32 *state) {
+	if (r->len != 0 || r->count == 0)
+		return 0;
+	u32 len = r->buf[(r->head - 1) & MASK];
+	u32 start = (r->head - len) & MASK;
+	for (u32 p = 1; p < len - 1; ) {
+		u32 h = r->buf[(start + p++) & MASK];
+		u32 off = h & 0xffff, cnt = h >> 16;
+		for (u32 j = 0; j < cnt; j++)
+			state[off + j] ^= r->buf[(start + p++) & MASK];
+	}
+	r->head = start;
+	r->used -= len;
+	r->count--;
+	return 1;
+}
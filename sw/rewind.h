@@ -0,0 +1,47 @@
+#ifndef MY_REWIND_H
+#define MY_REWIND_H
+
+#include "xil_types.h"
+
+/*
+ * Rewind ring. The caller keeps the current machine state as an array of
+ * words, and makes every change to it through rewind_update(), between
+ * rewind_begin() and rewind_end(). The ring keeps each such snapshot as the
+ * XOR of the old and new words, with the unchanged (zero) words left out.
+ * XOR works both ways, so rewind_pop() applies the last snapshot to the
+ * state again to get back the one before. When the ring is full, the oldest
+ * snapshots are dropped.
+ *
+ * A snapshot is [len] [run]... [len], with len counting all of its words,
+ * so it can be walked from either end. A run is a header word
+ * (offset | count << 16) followed by count words of XOR.
+ */
+#define REWIND_WORDS	(2*1024*1024)	// 8MB
+
+typedef struct {
+	u32 head;			// where the next word goes
+	u32 used;			// words in complete snapshots
+	u32 count;			// complete snapshots
+	u32 len;			// words of the snapshot being recorded, 0 if none
+	u32 run;			// position of the open run's header, ~0 if none
+	u32 run_next;		// state offset that extends the open run
+	u32 buf[REWIND_WORDS];
+} rewind_ring;
+
+// Drop all snapshots
+void rewind_clear(rewind_ring *r);
+
+// Start recording a snapshot
+void rewind_begin(rewind_ring *r);
+
+// Set n words of state at offset off to data. The old words are
+// recorded if a snapshot was begun. Offsets are below 64K words.
+void rewind_update(rewind_ring *r, u32 *state, u32 off, const u32 *data, u32 n);
+
+// Finish the snapshot
+void rewind_end(rewind_ring *r);
+
+// Take the last snapshot back out of state. Return 0 if there is none.
+int rewind_pop(rewind_ring *r, u32 *state);
+
+#endif
@@ -40,17 +40,20 @@
 /***************************** Include Files *******************************/
 
 #include <stdio.h>
+#include <string.h>
 #include "xparameters.h"
 #include "xplatform_info.h"
 #include "xuartps.h"
 #include "xil_exception.h"
 #include "xil_printf.h"
+#include "xtime_l.h"
 
 #ifdef XPAR_INTC_0_DEVICE_ID
 #include "xintc.h"
 #else
 #include "xscugic.h"
 #endif
+#include "uart.h"
 /************************** Constant Definitions **************************/
 
 /*
@@ -91,20 +94,33 @@ XUartPs UartPs	;		/* Instance of the UART Device */
 INTC InterruptController;	/* Instance of the Interrupt Controller */
 
 /*
- * zf: 3MB of total buffer
+ * Received bytes are put into RxRing by the interrupt handler, and text/replies
+ * to send are queued in TxRing and sent out from the interrupt handler as well,
+ * so nothing here needs to busy-wait for the UART.
  */
-u8 SendBuffer[1024];	/* Buffer for Transmitting Data */
-u8 RecvBuffer[3*1024*1024];	/* Buffer for Receiving Data */
-u32 ines_len;
+#define RX_RING_SIZE	(16*1024)
+#define TX_RING_SIZE	(8*1024)
+u8 RxRing[RX_RING_SIZE];
+u8 TxRing[TX_RING_SIZE];
+volatile u32 RxHead, RxTail;		/* written by handler / main loop */
+volatile u32 TxHead, TxTail;		/* written by main loop / handler */
+volatile u32 TxSending;				/* bytes handed to XUartPs_Send, 0 if idle */
+XScuGic *UartIntc;					/* to mask the UART interrupt, see tx_poke() */
+volatile u32 RxOverflow;			/* bytes dropped because RxRing was full */
+volatile XTime RxLastTime;			/* time last byte was received */
+
+u8 RxStage[64];		/* XUartPs receives into this, the handler moves it to RxRing */
+u32 RxStaged;		/* bytes of RxStage already moved */
 
-
-/*
- * The following counters are used to determine when the entire buffer has
- * been sent and received.
- */
-volatile int TotalReceivedCount;
-volatile int TotalSentCount;
 int TotalErrorCount;
+volatile int UartBreak;		/* Break seen, link goes back to UART_DEFAULT_BAUD */
+u32 UartBaud = UART_DEFAULT_BAUD;
+
+int Draining;				/* discarding input until the line is quiet, then NAK */
+
+#define RECV_TIMEOUT_MS		200		/* silence that ends a drain or a baud probe */
+
+static void rx_start();
 
 // Call this first
 int uart_init(XScuGic *intr) {
@@ -132,7 +148,7 @@ int uart_init(XScuGic *intr) {
 		return XST_FAILURE;
 	}
 //	if (XUartPs_SetBaudRate(UartInstPtr, 115200) != XST_SUCCESS) {
-	if (XUartPs_SetBaudRate(UartInstPtr, 230400) != XST_SUCCESS) {
+	if (XUartPs_SetBaudRate(UartInstPtr, UART_DEFAULT_BAUD) != XST_SUCCESS) {
 		xil_printf("Cannot set baud rate\r\n");
 		return XST_FAILURE;
 	}
@@ -151,6 +167,7 @@ int uart_init(XScuGic *intr) {
 	if (Status != XST_SUCCESS) {
 		return XST_FAILURE;
 	}
+	UartIntc = intr;
 
 	/*
 	 * Setup the handlers for the UART that will be called from the
@@ -187,30 +204,208 @@ int uart_init(XScuGic *intr) {
 	 */
 	XUartPs_SetRecvTimeout(UartInstPtr, 2);
 
+	rx_start();
+
 	return XST_SUCCESS;
 
 }
 
+/*
+ * RX side, in interrupt context. EventData is the number of bytes in RxStage.
+ */
+static void rx_move(u32 count) {
+	while (RxStaged < count) {
+		if (RxHead - RxTail < RX_RING_SIZE) {
+			RxRing[RxHead % RX_RING_SIZE] = RxStage[RxStaged];
+			RxHead++;
+		} else
+			RxOverflow++;
+		RxStaged++;
+	}
+	XTime t;
+	XTime_GetTime(&t);
+	RxLastTime = t;
+}
+
+// (Re)start receiving into RxStage. XUartPs_Recv() takes what is already in
+// the FIFO right away, so keep going while that fills RxStage.
+static void rx_start() {
+	u32 n;
+	do {
+		RxStaged = 0;
+		n = XUartPs_Recv(&UartPs, RxStage, sizeof(RxStage));
+		rx_move(n);
+	} while (n == sizeof(RxStage));
+}
+
+// Called for every receive event from the driver
+static void rx_event(u32 count) {
+	rx_move(count);
+	if (UartPs.ReceiveBuffer.RemainingBytes == 0)	// RxStage is full, receive again
+		rx_start();
+}
+
+/*
+ * TX side. Send the next contiguous piece of TxRing, if idle.
+ * Called from the handler when a piece is done, and through tx_poke() from
+ * the main loop.
+ */
+static void tx_kick() {
+	if (TxSending || TxHead == TxTail)
+		return;
+	u32 start = TxTail % TX_RING_SIZE;
+	u32 n = TxHead - TxTail;
+	if (n > TX_RING_SIZE - start)
+		n = TX_RING_SIZE - start;
+	TxSending = n;
+	XUartPs_Send(&UartPs, TxRing + start, n);
+}
+
+/*
+ * tx_kick() from the main loop. The UART interrupt is masked meanwhile, or a
+ * short piece could be sent before XUartPs_Send returns, and the handler would
+ * then update TxTail/TxSending and start the next piece in the middle of it.
+ * An interrupt that comes in meanwhile is taken right after.
+ */
+static void tx_poke() {
+	XScuGic_Disable(UartIntc, UART_INT_IRQ_ID);
+	tx_kick();
+	XScuGic_Enable(UartIntc, UART_INT_IRQ_ID);
+}
+
+void uart_send(const u8 *buf, int len) {
+	for (int i = 0; i < len; i++) {
+		while (TxHead - TxTail >= TX_RING_SIZE)		// full, wait for the handler
+			tx_poke();
+		TxRing[TxHead % TX_RING_SIZE] = buf[i];
+		TxHead++;
+	}
+	tx_poke();
+}
+
+static void send_byte(u8 b) {
+	uart_send(&b, 1);
+}
+
 void uart_printf(char *fmt, ...) {
 	char s[1024];
 	va_list args;
 	va_start(args, fmt);
 	int len = vsnprintf(s, 1024, fmt, args);
-	XUartPs_Send(&UartPs, (u8 *) s, len);
-	while (TotalSentCount < len) {};	// wait for transfer to complete
 	va_end(args);
+	if (len > sizeof(s) - 1)
+		len = sizeof(s) - 1;
+	uart_send((u8 *)s, len);
 }
 
-#define prt(fmt,...) prt_uart1(fmt,##__VA_ARGS__)
+void uart_flush() {
+	while (TxHead != TxTail || TxSending || XUartPs_IsSending(&UartPs))
+		tx_poke();
+}
 
+int uart_rx_count() {
+	if (Draining)
+		return 0;
+	return RxHead - RxTail;
+}
+
+int uart_read(u8 *buf, int len) {
+	int n = uart_rx_count();
+	if (n > len)
+		n = len;
+	for (int i = 0; i < n; i++)
+		buf[i] = RxRing[(RxTail + i) % RX_RING_SIZE];
+	RxTail += n;
+	return n;
+}
+
+u32 uart_idle_ms() {
+	XTime now;
+	XTime_GetTime(&now);
+	return (now - RxLastTime) / (COUNTS_PER_SECOND / 1000);
+}
+
+static void set_baud(u32 baud) {
+	uart_flush();
+	if (XUartPs_SetBaudRate(&UartPs, baud) == XST_SUCCESS)
+		UartBaud = baud;
+}
+
+void uart_ack() {
+	send_byte(UART_ACK);
+}
 
-u8 *uart_recv(int len) {
-	TotalReceivedCount = 0;
-	XUartPs_Recv(&UartPs, RecvBuffer, len);
-	// wait for interrupt handler to update TotalReceivedCount to len
-	while (TotalReceivedCount < len) {
+void uart_nak() {
+	TotalErrorCount++;
+	Draining = 1;
+}
+
+int uart_poll() {
+	if (UartBreak) {
+		// After a break (PC sends one when it connects or gives up on a fast
+		// link), go back to the default baud rate and start over.
+		UartBreak = 0;
+		Draining = 0;
+		set_baud(UART_DEFAULT_BAUD);
+		RxTail = RxHead;
+		return UART_LINK_RESET;
+	}
+	if (Draining) {
+		RxTail = RxHead;
+		if (uart_idle_ms() >= RECV_TIMEOUT_MS) {
+			Draining = 0;
+			send_byte(UART_NAK);
+		}
+	}
+	tx_poke();
+	return 0;
+}
+
+u32 uart_crc32(const u8 *buf, int len) {
+	u32 crc = 0xffffffff;
+	for (int i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (int k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+int uart_change_baud(u32 baud) {
+	u32 old = UartBaud;
+	XUartPs_Config *cfg = &UartPs.Config;
+	// Reject rates the baud generator cannot make (XUartPs allows 3% error)
+	if (baud < UART_DEFAULT_BAUD || baud > cfg->InputClockHz / 8) {
+		send_byte(UART_NAK);
+		return XST_FAILURE;
+	}
+	send_byte(UART_ACK);
+	set_baud(baud);
+	if (UartBaud != baud) {
+		set_baud(old);		// PC will time out and fall back as well
+		return XST_FAILURE;
 	}
-	return RecvBuffer;
+	// PC switches too, then sends a probe, which we ACK at the new rate.
+	// Nothing else comes in during this, so simply wait for it.
+	u8 probe[4];
+	XTime start, now;
+	XTime_GetTime(&start);
+	do {
+		if (UartBreak)
+			break;
+		if (uart_rx_count() >= 4) {
+			uart_read(probe, 4);
+			if (memcmp(probe, UART_PROBE, 4) != 0)
+				break;
+			send_byte(UART_ACK);
+			return XST_SUCCESS;
+		}
+		XTime_GetTime(&now);
+	} while (now - start < 5 * RECV_TIMEOUT_MS * (COUNTS_PER_SECOND / 1000));
+	UartBreak = 0;
+	set_baud(UART_DEFAULT_BAUD);
+	RxTail = RxHead;
+	return XST_FAILURE;
 }
 
 /**************************************************************************/
@@ -236,15 +431,16 @@ u8 *uart_recv(int len) {
 ***************************************************************************/
 void Handler(void *CallBackRef, u32 Event, unsigned int EventData)
 {
-	/* All of the data has been sent */
+	/* All of the data has been sent, send more from TxRing */
 	if (Event == XUARTPS_EVENT_SENT_DATA) {
-		TotalSentCount = EventData;
+		TxTail += TxSending;
+		TxSending = 0;
+		tx_kick();
 	}
 
-	/* All of the data has been received */
+	/* RxStage is full, move it to RxRing and receive again */
 	if (Event == XUARTPS_EVENT_RECV_DATA) {
-		TotalReceivedCount = EventData;
-//		xil_printf("RECV: %u\r\n", TotalReceivedCount);
+		rx_event(EventData);
 	}
 
 	/*
@@ -252,8 +448,7 @@ void Handler(void *CallBackRef, u32 Event, unsigned int EventData)
 	 * timeout just indicates the data stopped for 8 character times
 	 */
 	if (Event == XUARTPS_EVENT_RECV_TOUT) {
-		TotalReceivedCount = EventData;
-//		xil_printf("TOUT: %u\r\n", TotalReceivedCount);
+		rx_event(EventData);
 	}
 
 	/*
@@ -261,20 +456,23 @@ void Handler(void *CallBackRef, u32 Event, unsigned int EventData)
 	 * what kind of errors occurred
 	 */
 	if (Event == XUARTPS_EVENT_RECV_ERROR) {
-		TotalReceivedCount = EventData;
+		rx_event(EventData);
 		TotalErrorCount++;
-//		xil_printf("ERROR: %u\r\n", TotalReceivedCount);
 	}
 
 	/*
 	 * Data was received with an parity or frame or break error, keep the data
 	 * but determine what kind of errors occurred. Specific to Zynq Ultrascale+
-	 * MP.
+	 * MP. Only a real break resets the link: a framing error from a glitch at
+	 * a fast rate would otherwise drop PS to UART_DEFAULT_BAUD while PC stays
+	 * fast. The driver clears the status after this returns, so RBRK is still
+	 * there to look at.
 	 */
 	if (Event == XUARTPS_EVENT_PARE_FRAME_BRKE) {
-		TotalReceivedCount = EventData;
+		rx_event(EventData);
 		TotalErrorCount++;
-//		xil_printf("FRAME_BRKE: %u\r\n", TotalReceivedCount);
+		if (XUartPs_ReadReg(UartPs.Config.BaseAddress, XUARTPS_ISR_OFFSET) & XUARTPS_IXR_RBRK)
+			UartBreak = 1;
 	}
 
 	/*
@@ -282,9 +480,8 @@ void Handler(void *CallBackRef, u32 Event, unsigned int EventData)
 	 * what kind of errors occurred. Specific to Zynq Ultrascale+ MP.
 	 */
 	if (Event == XUARTPS_EVENT_RECV_ORERR) {
-		TotalReceivedCount = EventData;
+		rx_event(EventData);
 		TotalErrorCount++;
-//		xil_printf("ORERR: %u\r\n", TotalReceivedCount);
 	}
 }
 
@@ -10,14 +10,90 @@
  */
 int uart_init(XScuGic *intr);
 
+#define UART_DEFAULT_BAUD	230400
+
+#define UART_ACK	0x06
+#define UART_NAK	0x15
+#define UART_PROBE	"NES!"	// sent by PC at the new rate after a baud change
+#define UART_ECHO	0x02	// followed by u32 PC timestamp, see UART_CMD_INPUT in main.c
+
+/*
+ * All UART I/O is non-blocking. Received bytes are collected in a ring
+ * buffer by the interrupt handler, and output is queued in another one.
+ * The main loop calls uart_poll() and reads what is there.
+ */
+
+/*
+ * Housekeeping, call this from the main loop.
+ * Return: UART_LINK_RESET if a break was received. The link is back at
+ * UART_DEFAULT_BAUD and any input so far is discarded.
+ */
+#define UART_LINK_RESET	1
+int uart_poll();
+
+/*
+ * Number of received bytes ready to be read.
+ */
+int uart_rx_count();
+
+/*
+ * Read up to len received bytes, without waiting.
+ * Return: number of bytes read.
+ */
+int uart_read(u8 *buf, int len);
+
+/*
+ * Milliseconds since the last byte was received.
+ */
+u32 uart_idle_ms();
+
+/*
+ * Queue bytes to be sent. Only waits if the send buffer is full.
+ */
+void uart_send(const u8 *buf, int len);
+
+/*
+ * Wait until everything queued is sent.
+ */
+void uart_flush();
+
+/*
+ * Accept a received chunk.
+ */
+void uart_ack();
+
+/*
+ * Reject a received chunk: throw away input until the line is quiet for a
+ * while, then send UART_NAK, after which PC sends the chunk again.
+ * uart_rx_count() stays 0 until then.
+ */
+void uart_nak();
+
+/*
+ * ines data is sent in chunks of up to UART_CHUNK bytes, each followed by its
+ * CRC32 (u32 LE), and answered with UART_ACK or UART_NAK.
+ */
+#define UART_CHUNK	4096
+
+/*
+ * Handle a baud rate change request from PC:
+ *   PC -> PS: (command) u32 baud
+ *   PS -> PC: UART_ACK, or UART_NAK if the rate is not possible
+ *   both switch to the new rate
+ *   PC -> PS: UART_PROBE
+ *   PS -> PC: UART_ACK
+ * If the probe does not come through, PS goes back to UART_DEFAULT_BAUD.
+ * A break on the line also sets it back to UART_DEFAULT_BAUD.
+ */
+int uart_change_baud(u32 baud);
+
 /*
- * Blocking function to receive a fixed number of bytes from UART.
- * Return: buffer containing the result, or NULL if error.
+ * CRC32 (same as zlib.crc32)
  */
-u8 *uart_recv(int len);
+u32 uart_crc32(const u8 *buf, int len);
 
 /*
- * Printf through UART1.
+ * Printf through UART1. Queued like uart_send().
  */
 void uart_printf(char *fmt,...);
 